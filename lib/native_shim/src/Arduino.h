@@ -0,0 +1,64 @@
+#pragma once
+// Minimal Arduino-ESP32 surface for host builds. Only what the firmware
+// headers actually touch lives here; grow it as more of src/ is pulled in.
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#include "native_shim.h"
+
+#define PI 3.1415926535897932384626433832795
+#define HALF_PI 1.5707963267948966192313216916398
+#define TWO_PI 6.283185307179586476925286766559
+
+#define constrain(amt, low, high)                                              \
+  ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+// FreeRTOS, single-threaded: tasks never run and locks always succeed
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef void *SemaphoreHandle_t;
+#define portTICK_PERIOD_MS 1
+#define portMAX_DELAY 0xffffffffUL
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  static int token;
+  return &token;
+}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+TickType_t xTaskGetTickCount();
+
+namespace shim {
+float countedSinf(float x);
+double countedSin(double x);
+} // namespace shim
+
+// Route trig through the shim so benchmarks can count it. Defined after the
+// standard headers above, so libstdc++ itself is unaffected.
+#define sinf(x) shim::countedSinf(x)
+#define sin(x) shim::countedSin(x)
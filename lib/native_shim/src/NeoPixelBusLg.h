@@ -0,0 +1,154 @@
+#pragma once
+// Host stand-in for NeoPixelBus: same color types and bus API as the parts
+// of NeoPixelBusLg the firmware uses, backed by a plain RGB buffer.
+#include <vector>
+
+#include "Arduino.h"
+
+struct HsbColor;
+
+struct RgbColor {
+  RgbColor() : R(0), G(0), B(0) {}
+  RgbColor(uint8_t r, uint8_t g, uint8_t b) : R(r), G(g), B(b) {}
+  explicit RgbColor(uint8_t brightness)
+      : R(brightness), G(brightness), B(brightness) {}
+  RgbColor(const HsbColor &color);
+
+  bool operator==(const RgbColor &other) const {
+    return R == other.R && G == other.G && B == other.B;
+  }
+  bool operator!=(const RgbColor &other) const { return !(*this == other); }
+
+  uint8_t R;
+  uint8_t G;
+  uint8_t B;
+};
+
+struct HsbColor {
+  HsbColor(float h, float s, float b) : H(h), S(s), B(b) {}
+  HsbColor(const RgbColor &color) {
+    // same algorithm as NeoPixelBus' HsbColor(const RgbColor&)
+    shim::counters.floatOps += 14;
+    float r = color.R / 255.0f;
+    float g = color.G / 255.0f;
+    float b = color.B / 255.0f;
+    float max = (r > g && r > b) ? r : (g > b) ? g : b;
+    float min = (r < g && r < b) ? r : (g < b) ? g : b;
+    float d = max - min;
+    float h = 0.0f;
+    float v = max;
+    float s = (v == 0.0f) ? 0.0f : (d / v);
+    if (d != 0.0f) {
+      if (r == max) {
+        h = (g - b) / d + (g < b ? 6.0f : 0.0f);
+      } else if (g == max) {
+        h = (b - r) / d + 2.0f;
+      } else {
+        h = (r - g) / d + 4.0f;
+      }
+      h /= 6.0f;
+    }
+    H = h;
+    S = s;
+    B = v;
+  }
+
+  float H;
+  float S;
+  float B;
+};
+
+inline RgbColor::RgbColor(const HsbColor &color) {
+  shim::counters.floatOps += 14;
+  float r, g, b;
+  if (color.S == 0.0f) {
+    r = g = b = color.B;
+  } else {
+    float h = (color.H == 1.0f) ? 0.0f : (color.H * 6.0f);
+    int i = static_cast<int>(h);
+    float f = h - i;
+    float p = color.B * (1.0f - color.S);
+    float q = color.B * (1.0f - color.S * f);
+    float t = color.B * (1.0f - color.S * (1.0f - f));
+    switch (i) {
+    case 0:
+      r = color.B, g = t, b = p;
+      break;
+    case 1:
+      r = q, g = color.B, b = p;
+      break;
+    case 2:
+      r = p, g = color.B, b = t;
+      break;
+    case 3:
+      r = p, g = q, b = color.B;
+      break;
+    case 4:
+      r = t, g = p, b = color.B;
+      break;
+    default:
+      r = color.B, g = p, b = q;
+      break;
+    }
+  }
+  R = static_cast<uint8_t>(r * 255.0f);
+  G = static_cast<uint8_t>(g * 255.0f);
+  B = static_cast<uint8_t>(b * 255.0f);
+}
+
+class NeoGrbFeature {};
+class NeoWs2812xMethod {};
+
+template <typename T_COLOR_FEATURE, typename T_METHOD> class NeoPixelBusLg {
+public:
+  NeoPixelBusLg(uint16_t countPixels, uint8_t pin)
+      : _pixels(countPixels), _luminance(255), _dirty(false) {
+    (void)pin;
+  }
+
+  void Begin() { _dirty = true; }
+
+  void Show(bool maintainBufferConsistency = true) {
+    (void)maintainBufferConsistency;
+    shim::counters.showCalls++;
+    if (!_dirty) {
+      return;
+    }
+    shim::counters.shows++;
+    _dirty = false;
+  }
+
+  bool CanShow() const { return true; }
+  bool IsDirty() const { return _dirty; }
+  void Dirty() { _dirty = true; }
+  void ResetDirty() { _dirty = false; }
+
+  uint16_t PixelCount() const { return _pixels.size(); }
+
+  void SetLuminance(uint8_t luminance) { _luminance = luminance; }
+  uint8_t GetLuminance() const { return _luminance; }
+
+  void SetPixelColor(uint16_t indexPixel, RgbColor color) {
+    shim::counters.pixelWrites++;
+    if (indexPixel < _pixels.size()) {
+      _pixels[indexPixel] = color;
+      _dirty = true;
+    }
+  }
+
+  RgbColor GetPixelColor(uint16_t indexPixel) const {
+    return indexPixel < _pixels.size() ? _pixels[indexPixel] : RgbColor();
+  }
+
+  void ClearTo(RgbColor color) {
+    for (auto &pixel : _pixels) {
+      pixel = color;
+    }
+    _dirty = true;
+  }
+
+private:
+  std::vector<RgbColor> _pixels;
+  uint8_t _luminance;
+  bool _dirty;
+};
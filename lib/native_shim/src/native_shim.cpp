@@ -0,0 +1,65 @@
+#include "native_shim.h"
+
+#include "Arduino.h"
+
+namespace shim {
+
+Counters counters = {};
+static uint64_t virtualMicros = 0;
+static uint32_t rngState = 0x12345678;
+
+void resetCounters() { counters = {}; }
+
+uint64_t nowMicros() { return virtualMicros; }
+void setMicros(uint64_t us) { virtualMicros = us; }
+void advanceMicros(uint64_t us) { virtualMicros += us; }
+
+void seedRandom(uint32_t seed) { rngState = seed ? seed : 0x12345678; }
+
+static uint32_t nextRandom() {
+  // xorshift32, deterministic so benchmark runs are comparable
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+float countedSinf(float x) {
+  counters.floatOps++;
+  return (std::sin)(x);
+}
+
+double countedSin(double x) {
+  counters.floatOps++;
+  return (std::sin)(x);
+}
+
+} // namespace shim
+
+unsigned long millis() { return shim::nowMicros() / 1000; }
+unsigned long micros() { return shim::nowMicros(); }
+void delay(uint32_t ms) { shim::advanceMillis(ms); }
+void delayMicroseconds(uint32_t us) { shim::advanceMicros(us); }
+
+long random(long howbig) {
+  if (howbig <= 0)
+    return 0;
+  return shim::nextRandom() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig)
+    return howsmall;
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) { shim::seedRandom(seed); }
+
+long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  const long run = in_max - in_min;
+  if (run == 0)
+    return out_min;
+  return (x - in_min) * (out_max - out_min) / run + out_min;
+}
+
+TickType_t xTaskGetTickCount() { return millis() / portTICK_PERIOD_MS; }
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+
+// Host-side hooks for code running under the native shim: a virtual clock
+// that only moves when told to, and counters the benchmarks read back.
+namespace shim {
+
+struct Counters {
+  uint64_t floatOps;    // float math done by the color model and trig calls
+  uint64_t pixelWrites; // SetPixelColor() calls
+  uint64_t shows;       // Show() calls that actually pushed a frame
+  uint64_t showCalls;   // every Show() call, including skipped ones
+};
+
+extern Counters counters;
+
+void resetCounters();
+
+uint64_t nowMicros();
+void setMicros(uint64_t us);
+void advanceMicros(uint64_t us);
+inline void advanceMillis(uint64_t ms) { advanceMicros(ms * 1000); }
+
+void seedRandom(uint32_t seed);
+
+} // namespace shim
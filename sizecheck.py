@@ -0,0 +1,46 @@
+#!/usr/bin/env python3
+"""
+Fails the build when firmware.bin does not fit in an app slot of the
+partition table (board_build.partitions). The slots shrank to make room
+for the sound bank, so an image that still fits the old layout can be too
+big for the new one.
+
+PlatformIO:  used as a post: extra script on the esp32dev env.
+"""
+import os
+import sys
+
+
+def app_slot_size(csv_path):
+    sizes = []
+    with open(csv_path) as f:
+        for line in f:
+            fields = [x.strip() for x in line.split("#")[0].split(",")]
+            if len(fields) >= 5 and fields[1] == "app":
+                sizes.append(int(fields[4], 0))
+    if not sizes:
+        raise ValueError(f"no app partition in {csv_path}")
+    return min(sizes)
+
+
+def platformio_setup(env):
+    partitions = env.GetProjectOption("board_build.partitions", "")
+    if not partitions:
+        return
+    limit = app_slot_size(os.path.join(env.subst("$PROJECT_DIR"), partitions))
+
+    def check(target, source, env):
+        path = target[0].get_abspath()
+        size = os.path.getsize(path)
+        if size > limit:
+            sys.stderr.write(f"sizecheck: {os.path.basename(path)} is "
+                             f"{size} bytes, the app slot is {limit}\n")
+            env.Exit(1)
+        print(f"sizecheck: {size} of {limit} bytes "
+              f"({100 * size // limit}% of the app slot)")
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.bin", check)
+
+
+Import("env")  # noqa: F821
+platformio_setup(env)  # noqa: F821
@@ -0,0 +1,203 @@
+#!/usr/bin/env python3
+"""
+Packs the effect clips in sounds/ into one IMA-ADPCM sound bank (see
+src/soundbank.h for the layout), ready to be flashed raw into the spiffs
+partition and memory-mapped by the firmware.
+
+Standalone:  python soundbank.py [sounds_dir] [output.bin]
+PlatformIO:  used as a pre: extra script, records missing announcement
+             clips (tools/voice.py), rebuilds the bank when a clip
+             changes and adds the `uploadbank` target.
+
+MP3 decoding needs ffmpeg on PATH; durations come from mutagen like in
+getdurations.py.
+"""
+import os
+import shutil
+import struct
+import subprocess
+import sys
+
+SAMPLE_RATE = 22050
+NAME_LEN = 16
+# hum stays on the MP3 decoder stream, everything else is an effect voice
+EXCLUDE = {"hum.mp3"}
+
+STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+    230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+    963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+    3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385,
+    24623, 27086, 29794, 32767,
+]
+INDEX_STEPS = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def adpcm_encode(samples):
+    """IMA-ADPCM, predictor and index start at 0, low nibble first."""
+    predictor, index = 0, 0
+    out = bytearray((len(samples) + 1) // 2)
+    for i, sample in enumerate(samples):
+        step = STEPS[index]
+        diff = sample - predictor
+        code = 0
+        if diff < 0:
+            code = 8
+            diff = -diff
+        delta = step >> 3
+        if diff >= step:
+            code |= 4
+            diff -= step
+            delta += step
+        if diff >= step >> 1:
+            code |= 2
+            diff -= step >> 1
+            delta += step >> 1
+        if diff >= step >> 2:
+            code |= 1
+            delta += step >> 2
+        predictor += -delta if code & 8 else delta
+        predictor = max(-32768, min(32767, predictor))
+        index = max(0, min(88, index + INDEX_STEPS[code & 7]))
+        if i & 1:
+            out[i >> 1] |= code << 4
+        else:
+            out[i >> 1] = code
+    return bytes(out)
+
+
+def decode_mp3(path):
+    """Returns mono 16-bit samples at SAMPLE_RATE."""
+    pcm = subprocess.run(
+        ["ffmpeg", "-v", "error", "-i", path, "-f", "s16le", "-ac", "1",
+         "-ar", str(SAMPLE_RATE), "-"],
+        check=True, stdout=subprocess.PIPE).stdout
+    return struct.unpack("<%dh" % (len(pcm) // 2), pcm)
+
+
+def mp3_duration_ms(path):
+    from mutagen.mp3 import MP3
+
+    return int(MP3(path).info.length * 1000)
+
+
+def clip_names(directory):
+    return [f for f in sorted(os.listdir(directory))
+            if f.lower().endswith(".mp3") and f not in EXCLUDE]
+
+
+def build_bank(directory, output):
+    clips = []
+    for fname in clip_names(directory):
+        name = os.path.splitext(fname)[0]
+        if len(name) >= NAME_LEN:
+            raise ValueError(f"{fname}: name longer than {NAME_LEN - 1}")
+        path = os.path.join(directory, fname)
+        samples = decode_mp3(path)
+        clips.append((name, len(samples), mp3_duration_ms(path),
+                      adpcm_encode(samples)))
+
+    offset = 16 + 32 * len(clips)
+    index, data = bytearray(), bytearray()
+    for name, frames, duration, adpcm in clips:
+        index += struct.pack("<16sIIII", name.encode(), offset + len(data),
+                             len(adpcm), frames, duration)
+        data += adpcm
+        data += b"\0" * (-len(data) % 4)
+    header = struct.pack("<4sHHII", b"LSB1", 1, len(clips), SAMPLE_RATE, 0)
+    os.makedirs(os.path.dirname(output) or ".", exist_ok=True)
+    with open(output, "wb") as f:
+        f.write(header + index + data)
+    return len(header) + len(index) + len(data)
+
+
+def partition_offset(csv_path, name):
+    with open(csv_path) as f:
+        for line in f:
+            fields = [x.strip() for x in line.split("#")[0].split(",")]
+            if len(fields) >= 5 and fields[0] == name:
+                return int(fields[3], 0), int(fields[4], 0)
+    raise ValueError(f"no {name} partition in {csv_path}")
+
+
+def is_stale(directory, output):
+    if not os.path.exists(output):
+        return True
+    built = os.path.getmtime(output)
+    sources = [os.path.join(directory, f) for f in clip_names(directory)]
+    return any(os.path.getmtime(p) > built for p in sources + [__file__])
+
+
+def record_announcements(project_dir, directory):
+    """Speaks missing announcement clips with tools/voice.py, so a stock
+    build has them in the bank and announcements stay offline."""
+    sys.path.insert(0, os.path.join(project_dir, "tools"))
+    import voice
+    missing = voice.missing_clips(directory)
+    if not missing:
+        return
+    engine = voice.find_engine()
+    if engine is None:
+        print(f"soundbank: {len(missing)} announcement clips missing and no "
+              "espeak-ng/ffmpeg to record them, announcements are off")
+        return
+    try:
+        voice.record(engine, directory, missing)
+    except subprocess.CalledProcessError as e:
+        print(f"soundbank: announcement clips not recorded: {e}")
+
+
+def platformio_setup(env):
+    project_dir = env.subst("$PROJECT_DIR")
+    directory = os.path.join(project_dir, "sounds")
+    output = os.path.join(project_dir, ".pio", "soundbank", "soundbank.bin")
+    record_announcements(project_dir, directory)
+    if shutil.which("ffmpeg") is None:
+        print("soundbank: ffmpeg not found, sound bank not rebuilt")
+    elif is_stale(directory, output):
+        try:
+            size = build_bank(directory, output)
+            print(f"soundbank: {output} ({size} bytes)")
+        except (ImportError, subprocess.CalledProcessError) as e:
+            print(f"soundbank: sound bank not rebuilt: {e}")
+    env.Append(CPPDEFINES=[("SOUNDBANK_PATH", env.StringifyMacro(output))])
+
+    partitions = env.GetProjectOption("board_build.partitions", "")
+    if env.subst("$PIOPLATFORM") != "espressif32" or not partitions:
+        return
+    offset, size = partition_offset(os.path.join(project_dir, partitions),
+                                    "spiffs")
+    if os.path.exists(output) and os.path.getsize(output) > size:
+        sys.stderr.write(f"soundbank: bank does not fit in {size} bytes\n")
+        env.Exit(1)
+    if os.path.exists(output):
+        # the firmware copies hot assets from SD into the sectors after the
+        # bank (src/assetstore.h), one of them for the manifest
+        bank_end = -(-os.path.getsize(output) // 4096) * 4096
+        print(f"soundbank: {max(size - bank_end - 4096, 0)} bytes "
+              "left for hot assets")
+    env.AddCustomTarget(
+        name="uploadbank",
+        dependencies=None,
+        actions=[
+            f'"$PYTHONEXE" "$UPLOADER" $UPLOADERFLAGS {hex(offset)} "{output}"'
+        ],
+        title="Upload sound bank",
+        description="Flash the effect sound bank into the spiffs partition",
+    )
+
+
+try:
+    Import("env")  # noqa: F821
+    platformio_setup(env)  # noqa: F821
+except NameError:
+    if __name__ == "__main__":
+        directory = sys.argv[1] if len(sys.argv) > 1 else "sounds"
+        output = sys.argv[2] if len(sys.argv) > 2 else "soundbank.bin"
+        if not os.path.isdir(directory):
+            print(f"Error: {directory} is not a directory", file=sys.stderr)
+            sys.exit(1)
+        size = build_bank(directory, output)
+        print(f"{output}: {size} bytes")
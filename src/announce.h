@@ -0,0 +1,96 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+
+// Offline announcements. An announcement is a short string of tokens, each
+// one a pre-recorded clip in the sound bank (sounds/say*.mp3, made by
+// tools/voice.py), spoken back to back by one mixer voice:
+//
+//   '0'..'9'  digits          '.'  "point"
+//   'V'       "volts"         '%'  "percent"
+//   'I'       "my IP address is"
+//   'B'       "battery voltage is"
+//   'W'       "resetting Wi-Fi binding"
+//
+// e.g. "I192.168.4.1" or "B3.87V". Other characters are skipped.
+//
+// With ANNOUNCE_ONLINE set, a missing clip sends the same words to online
+// text-to-speech instead, see announceSpeech(). Plain C++ for the native
+// tests.
+
+#define ANNOUNCE_MAX_TOKENS 63
+
+inline const char *announceClip(char token) {
+  static const char *const digits[10] = {"say0", "say1", "say2", "say3",
+                                         "say4", "say5", "say6", "say7",
+                                         "say8", "say9"};
+  if (token >= '0' && token <= '9') {
+    return digits[token - '0'];
+  }
+  switch (token) {
+  case '.':
+    return "saypoint";
+  case 'V':
+    return "sayvolts";
+  case '%':
+    return "saypercent";
+  case 'I':
+    return "sayip";
+  case 'B':
+    return "saybattery";
+  case 'W':
+    return "saywifireset";
+  default:
+    return nullptr;
+  }
+}
+
+// What a token's clip says, as in tools/voice.py
+inline const char *announceWords(char token) {
+  static const char *const digits[10] = {"zero", "one", "two", "three",
+                                         "four", "five", "six", "seven",
+                                         "eight", "nine"};
+  if (token >= '0' && token <= '9') {
+    return digits[token - '0'];
+  }
+  switch (token) {
+  case '.':
+    return "point";
+  case 'V':
+    return "volts";
+  case '%':
+    return "percent";
+  case 'I':
+    return "My IP address is";
+  case 'B':
+    return "Battery voltage is";
+  case 'W':
+    return "Resetting Wi-Fi binding";
+  default:
+    return nullptr;
+  }
+}
+
+// The announcement as one sentence, truncated to fit. Returns its length.
+inline size_t announceSpeech(const char *tokens, char *out, size_t size) {
+  size_t len = 0;
+  if (size) {
+    out[0] = 0;
+  }
+  for (; *tokens; tokens++) {
+    const char *words = announceWords(*tokens);
+    if (!words) {
+      continue;
+    }
+    size_t n = strlen(words);
+    if (len + (len > 0) + n >= size) {
+      break;
+    }
+    if (len) {
+      out[len++] = ' ';
+    }
+    memcpy(out + len, words, n + 1);
+    len += n;
+  }
+  return len;
+}
@@ -0,0 +1,238 @@
+#include "assets.h"
+
+#include <SD.h>
+#include <esp_partition.h>
+
+#include <atomic>
+#include <memory>
+
+#include "assetstore.h"
+#include "config.h"
+#include "crc32.h"
+#include "debug.h"
+#include "sdcache.h"
+#include "soundbank.h"
+
+static const esp_partition_t *partition = NULL;
+static AssetManifest manifest = {}; // written once by assetsSync()
+// set after manifest is written and its files are in flash
+static std::atomic<bool> synced{false};
+
+// End of the sound bank at the start of the partition, 0 if there is none
+static uint32_t bankSize() {
+  SoundBankHeader header;
+  if (esp_partition_read(partition, 0, &header, sizeof(header)) != ESP_OK ||
+      !soundBankHeader((const uint8_t *)&header)) {
+    return 0;
+  }
+  uint32_t end = sizeof(header) + header.count * sizeof(SoundBankEntry);
+  for (uint16_t i = 0; i < header.count; i++) {
+    SoundBankEntry entry;
+    if (esp_partition_read(partition,
+                           sizeof(header) + i * sizeof(SoundBankEntry), &entry,
+                           sizeof(entry)) != ESP_OK) {
+      return partition->size; // unknown, leave the partition alone
+    }
+    end = max(end, entry.offset + entry.bytes);
+  }
+  return end;
+}
+
+// Size and last write time, the contents are only read if they changed
+static bool statSource(const char *path, AssetSource &source) {
+  File file = SD.open(path);
+  if (!file || file.isDirectory()) {
+    return false;
+  }
+  source = {path, (uint32_t)file.size(), (uint32_t)file.getLastWrite(), 0};
+  return true;
+}
+
+// Rewrites the entry's sectors and records the CRC of what went in
+static bool copyToFlash(AssetEntry &entry, uint32_t areaStart) {
+  File file = SD.open(entry.name);
+  if (!file) {
+    return false;
+  }
+  uint32_t at = areaStart + entry.offset;
+  if (esp_partition_erase_range(partition, at, assetSectors(entry.size)) !=
+      ESP_OK) {
+    return false;
+  }
+  uint8_t chunk[1024];
+  uint32_t done = 0;
+  uint32_t crc = 0;
+  size_t n;
+  while (done < entry.size && (n = file.read(chunk, sizeof(chunk))) > 0) {
+    n = min(n, (size_t)(entry.size - done));
+    if (esp_partition_write(partition, at + done, chunk, n) != ESP_OK) {
+      return false;
+    }
+    crc = crc32Update(crc, chunk, n);
+    done += n;
+  }
+  entry.crc = crc;
+  // the card could have changed since it was looked at
+  return done == entry.size;
+}
+
+bool assetsSync() {
+  partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "spiffs");
+  if (!partition) {
+    return false;
+  }
+  uint32_t areaStart = assetAreaStart(bankSize());
+  if (areaStart + ASSET_SECTOR > partition->size) {
+    LOG_W("Assets: no room after the sound bank");
+    return false;
+  }
+  AssetManifest current;
+  if (esp_partition_read(partition, areaStart, &current, sizeof(current)) !=
+          ESP_OK ||
+      current.areaStart != areaStart) {
+    memset(&current, 0, sizeof(current)); // the bank grew, nothing to keep
+  }
+  static const char *const hotFiles[] = {ASSET_HOT_FILES};
+  AssetSource sources[ASSET_MAX];
+  size_t count = 0;
+  for (const char *path : hotFiles) {
+    if (count < ASSET_MAX && statSource(path, sources[count])) {
+      // an unchanged file keeps its CRC and, if it stays put, its sectors
+      const AssetEntry *known = assetUnchanged(current, sources[count]);
+      sources[count].crc = known ? known->crc : 0;
+      count++;
+    }
+  }
+  AssetManifest wanted = assetLayout(sources, count, areaStart,
+                                     partition->size - areaStart);
+  for (size_t i = 0; i < count; i++) {
+    if (!assetFind(wanted, sources[i].name)) {
+      LOG_W("Assets: %s doesn't fit in flash, playing it from SD",
+            sources[i].name);
+    }
+  }
+  if (memcmp(&current, &wanted, sizeof(wanted)) == 0) {
+    manifest = wanted;
+    synced.store(true, std::memory_order_release);
+    LOG_I("Assets: %u files in flash up to date", wanted.count);
+    return true;
+  }
+  uint32_t start = millis();
+  // no valid manifest while files are rewritten
+  if (esp_partition_erase_range(partition, areaStart, ASSET_SECTOR) !=
+      ESP_OK) {
+    return false;
+  }
+  uint16_t copied = 0;
+  for (uint16_t i = 0; i < wanted.count; i++) {
+    if (assetInPlace(current, wanted.entries[i])) {
+      continue;
+    }
+    if (!copyToFlash(wanted.entries[i], areaStart)) {
+      LOG_W("Assets: copying %s failed", wanted.entries[i].name);
+      return false;
+    }
+    copied++;
+  }
+  if (esp_partition_write(partition, areaStart, &wanted, sizeof(wanted)) !=
+      ESP_OK) {
+    return false;
+  }
+  manifest = wanted;
+  synced.store(true, std::memory_order_release);
+  LOG_I("Assets: %u of %u files copied to flash in %lu ms", copied,
+        wanted.count, (unsigned long)(millis() - start));
+  return true;
+}
+
+// NULL until the sync is done
+static const AssetEntry *syncedAsset(const char *path) {
+  return synced.load(std::memory_order_acquire) ? assetFind(manifest, path)
+                                                : NULL;
+}
+
+class AssetFile : public fs::FileImpl {
+  const AssetEntry *entry;
+  uint32_t pos = 0;
+
+public:
+  explicit AssetFile(const AssetEntry *asset) : entry(asset) {}
+
+  size_t read(uint8_t *buf, size_t size) override {
+    if (!entry) {
+      return 0;
+    }
+    size_t n = min(size, (size_t)(entry->size - pos));
+    if (esp_partition_read(partition, manifest.areaStart + entry->offset + pos,
+                           buf, n) != ESP_OK) {
+      return 0;
+    }
+    pos += n;
+    return n;
+  }
+
+  // like fseek(), except that it can't go past the end
+  bool seek(uint32_t offset, SeekMode mode) override {
+    if (!entry) {
+      return false;
+    }
+    uint32_t base = mode == SeekCur ? pos : mode == SeekEnd ? entry->size : 0;
+    if (base + offset > entry->size) {
+      return false;
+    }
+    pos = base + offset;
+    return true;
+  }
+
+  size_t position() const override { return pos; }
+  size_t size() const override { return entry ? entry->size : 0; }
+  void close() override { entry = NULL; }
+  const char *path() const override { return entry ? entry->name : ""; }
+
+  const char *name() const override {
+    const char *slash = strrchr(path(), '/');
+    return slash ? slash + 1 : path();
+  }
+
+  size_t write(const uint8_t *, size_t) override { return 0; }
+  void flush() override {}
+  bool setBufferSize(size_t) override { return true; }
+  time_t getLastWrite() override { return 0; }
+  boolean isDirectory() override { return false; }
+  fs::FileImplPtr openNextFile(const char *) override {
+    return fs::FileImplPtr();
+  }
+  boolean seekDir(long) override { return false; }
+  String getNextFileName() override { return ""; }
+  String getNextFileName(bool *) override { return ""; }
+  void rewindDirectory() override {}
+  operator bool() override { return entry != NULL; }
+};
+
+class AssetFS : public fs::FSImpl {
+public:
+  fs::FileImplPtr open(const char *path, const char *mode,
+                       const bool) override {
+    const AssetEntry *entry = syncedAsset(path);
+    if (!entry || strcmp(mode, FILE_READ) != 0) {
+      return fs::FileImplPtr();
+    }
+    return std::make_shared<AssetFile>(entry);
+  }
+
+  bool exists(const char *path) override {
+    return syncedAsset(path) != NULL;
+  }
+
+  bool rename(const char *, const char *) override { return false; }
+  bool remove(const char *) override { return false; }
+  bool mkdir(const char *) override { return false; }
+  bool rmdir(const char *) override { return false; }
+};
+
+fs::FS flashAssets(std::make_shared<AssetFS>());
+
+fs::FS &assetFS(const char *path) {
+  return syncedAsset(path) ? flashAssets : sdCache;
+}
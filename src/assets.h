@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+// Hot assets in flash. The files the decoder streams on the hottest paths
+// (ASSET_HOT_FILES: the hum, the announcement carrier) are copied at boot
+// from SD into the free tail of the sound bank partition, and played from
+// there once the copy is complete: no FAT lookups, no SD bus traffic next to
+// a song being streamed.
+// The effect clips themselves are already in the sound bank.
+
+// Compares the SD files against the manifest in flash by size and last
+// write time, and copies over only those that changed (or moved). Call once
+// after sdInit(), on the storage task; the audio task plays from SD
+// meanwhile. false if flash isn't usable, everything keeps playing from SD.
+bool assetsSync();
+
+// Read-only, holds the synced files under their SD paths
+extern fs::FS flashAssets;
+
+// Where to play path from: flashAssets if it was synced, else SD
+fs::FS &assetFS(const char *path);
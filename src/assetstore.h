@@ -0,0 +1,125 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Hot sound assets copied from SD into the free tail of the sound bank
+// partition (see assets.h). The area starts at the first flash sector after
+// the bank: one sector holding the manifest, then the files, each from a
+// sector boundary so one can be rewritten without touching the others. A
+// sync erases the manifest first and writes it last, so one that is
+// interrupted leaves no valid manifest behind and simply runs again.
+// Plain C++ for the native tests.
+
+#define ASSET_MAGIC "LSA1"
+#define ASSET_VERSION 2
+#define ASSET_NAME_LEN 24
+#define ASSET_MAX 8
+#define ASSET_SECTOR 4096
+
+struct AssetEntry {
+  char name[ASSET_NAME_LEN]; // SD path, e.g. "/hum.mp3"
+  uint32_t offset;           // from the start of the area
+  uint32_t size;
+  uint32_t mtime; // last write time of the SD file, a change means a copy
+  uint32_t crc;   // CRC-32 of what was copied
+};
+
+struct AssetManifest {
+  char magic[4];
+  uint16_t version;
+  uint16_t count;
+  uint32_t areaStart; // partition offset, moves when the bank grows
+  uint32_t reserved;
+  AssetEntry entries[ASSET_MAX];
+};
+
+static_assert(sizeof(AssetEntry) == 40, "asset entry layout");
+static_assert(sizeof(AssetManifest) <= ASSET_SECTOR, "manifest sector");
+
+// A file on SD as the sync sees it; crc is only known for unchanged files
+struct AssetSource {
+  const char *name;
+  uint32_t size;
+  uint32_t mtime;
+  uint32_t crc;
+};
+
+// bytes rounded up to whole sectors
+inline uint32_t assetSectors(uint32_t bytes) {
+  return (bytes + ASSET_SECTOR - 1) / ASSET_SECTOR * ASSET_SECTOR;
+}
+
+inline uint32_t assetAreaStart(uint32_t bankSize) {
+  return assetSectors(bankSize);
+}
+
+// The manifest the area should hold for these sources: they are placed in
+// priority order, and whatever doesn't fit in areaSize bytes is left out.
+// Unused bytes stay zero, so manifests compare with memcmp().
+inline AssetManifest assetLayout(const AssetSource *sources, size_t count,
+                                 uint32_t areaStart, uint32_t areaSize) {
+  AssetManifest manifest;
+  memset(&manifest, 0, sizeof(manifest));
+  memcpy(manifest.magic, ASSET_MAGIC, 4);
+  manifest.version = ASSET_VERSION;
+  manifest.areaStart = areaStart;
+  uint32_t offset = ASSET_SECTOR;
+  for (size_t i = 0; i < count && manifest.count < ASSET_MAX; i++) {
+    const AssetSource &source = sources[i];
+    if (strlen(source.name) >= ASSET_NAME_LEN || offset > areaSize ||
+        source.size > areaSize - offset) {
+      continue;
+    }
+    AssetEntry &entry = manifest.entries[manifest.count++];
+    strcpy(entry.name, source.name);
+    entry.offset = offset;
+    entry.size = source.size;
+    entry.mtime = source.mtime;
+    entry.crc = source.crc;
+    offset += assetSectors(source.size);
+  }
+  return manifest;
+}
+
+// Bytes of the area the manifest uses, whole sectors
+inline uint32_t assetAreaUsed(const AssetManifest &manifest) {
+  uint32_t end = ASSET_SECTOR;
+  for (uint16_t i = 0; i < manifest.count; i++) {
+    const AssetEntry &entry = manifest.entries[i];
+    end = entry.offset + entry.size > end ? entry.offset + entry.size : end;
+  }
+  return assetSectors(end);
+}
+
+inline const AssetEntry *assetFind(const AssetManifest &manifest,
+                                   const char *name) {
+  if (memcmp(manifest.magic, ASSET_MAGIC, 4) != 0 ||
+      manifest.version != ASSET_VERSION) {
+    return nullptr;
+  }
+  for (uint16_t i = 0; i < manifest.count && i < ASSET_MAX; i++) {
+    if (strncmp(manifest.entries[i].name, name, ASSET_NAME_LEN) == 0) {
+      return &manifest.entries[i];
+    }
+  }
+  return nullptr;
+}
+
+// The entry of a file whose size and last write time are what was synced,
+// so its CRC carries over without reading it; nullptr if it has to be copied
+inline const AssetEntry *assetUnchanged(const AssetManifest &current,
+                                        const AssetSource &source) {
+  const AssetEntry *entry = assetFind(current, source.name);
+  if (!entry || entry->size != source.size || entry->mtime != source.mtime) {
+    return nullptr;
+  }
+  return entry;
+}
+
+// Whether entry's sectors already hold it: the same file at the same offset
+inline bool assetInPlace(const AssetManifest &current,
+                         const AssetEntry &entry) {
+  const AssetEntry *synced = assetFind(current, entry.name);
+  return synced && memcmp(synced, &entry, sizeof(entry)) == 0;
+}
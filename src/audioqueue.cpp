@@ -1,70 +1,194 @@
 #include "audioqueue.h"
 
+#include <WiFi.h>
+
+#include <atomic>
+
+#include "announce.h"
+#include "assets.h"
+#include "debug.h"
+#include "profiler.h"
+
 Audio audio;
-audioMessage audioTxMessage, audioRxMessage;
 QueueHandle_t audioSetQueue = NULL;
 QueueHandle_t audioGetQueue = NULL;
 
+static std::atomic<uint32_t> nextSeq{1};
+static std::atomic<uint32_t> postedCount{0};
+
+// seqlock around the published state: odd while the audio task writes it
+static std::atomic<uint32_t> stateVersion{0};
+static AudioPlayerState publishedState = {};
+// the looping stream is the hum, which SmoothSwing ducks
+static bool streamLooping = false;
+
 void CreateQueues() {
-  audioSetQueue = xQueueCreate(10, sizeof(struct audioMessage));
-  audioGetQueue = xQueueCreate(10, sizeof(struct audioMessage));
+  audioSetQueue = xQueueCreate(16, sizeof(struct audioMessage));
+  audioGetQueue = xQueueCreate(8, sizeof(struct audioMessage));
+}
+
+static void publishState(const AudioPlayerState &state) {
+  uint32_t version = stateVersion.load(std::memory_order_relaxed);
+  stateVersion.store(version + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  publishedState = state;
+  stateVersion.store(version + 2, std::memory_order_release);
+}
+
+AudioPlayerState audioGetState() {
+  AudioPlayerState state;
+  uint32_t before, after;
+  do {
+    before = stateVersion.load(std::memory_order_acquire);
+    state = publishedState;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = stateVersion.load(std::memory_order_relaxed);
+  } while (before != after || (before & 1));
+  return state;
+}
+
+static void runCommand(audioMessage &msg, AudioPlayerState &state) {
+  switch (msg.cmd) {
+  case SET_VOLUME:
+    audio.setVolume(msg.value1);
+    msg.ret = 1;
+    break;
+  case CONNECTTOHOST:
+    msg.ret = audio.connecttohost(msg.txt1, msg.txt2, msg.txt3);
+    state.looping = false;
+    strlcpy(state.file, msg.txt1, sizeof(state.file));
+    break;
+  case CONNECTTOSD:
+    msg.ret = audio.connecttoFS(assetFS(msg.txt1), msg.txt1, msg.value1);
+    // connecttoFS() resets the loop flag, so set it afterwards
+    audio.setFileLoop(msg.value2);
+    state.looping = msg.value2 && msg.ret;
+    strlcpy(state.file, msg.txt1, sizeof(state.file));
+    break;
+  case CONNECTTOSPEECH:
+    msg.ret = audio.connecttospeech(msg.txt1, msg.txt2);
+    state.looping = false;
+    strlcpy(state.file, "speech", sizeof(state.file));
+    break;
+  case STOPSONG:
+    msg.ret = audio.stopSong();
+    state.looping = false;
+    break;
+  case PLAYEFFECT:
+    msg.ret = mixerPlay(msg.txt1, msg.value1, msg.value2);
+    if (msg.value2) {
+      state.looping = false;
+      if (!msg.ret) {
+        audio.stopSong();
+      }
+    }
+    break;
+  case STOPEFFECTS:
+    mixerStopAll();
+    msg.ret = 1;
+    break;
+  case SMOOTHSWING:
+    msg.ret = mixerSmoothSwing(msg.value1);
+    break;
+  case ANNOUNCE:
+    // checked first, a failed announcement leaves the current stream playing
+    if (mixerCanAnnounce(msg.txt1) &&
+        assetFS(ANNOUNCE_CARRIER).exists(ANNOUNCE_CARRIER)) {
+      audio.stopSong();
+      state.looping = false;
+      msg.ret = mixerAnnounce(msg.txt1, MIXER_EFFECT_GAIN);
+      // a voice it took over ended the stream that was just stopped, not the
+      // carrier
+      mixerStreamEnded();
+      msg.ret = msg.ret &&
+                audio.connecttoFS(assetFS(ANNOUNCE_CARRIER), ANNOUNCE_CARRIER);
+      if (msg.ret) {
+        // the announcement voice stops the carrier when it is done
+        audio.setFileLoop(true);
+        strlcpy(state.file, "announce", sizeof(state.file));
+      } else {
+        mixerStopAll();
+      }
+#if ANNOUNCE_ONLINE
+    } else if (WiFi.status() == WL_CONNECTED) {
+      // clips not recorded (tools/voice.py), speak it online instead
+      char speech[sizeof(msg.txt1)];
+      announceSpeech(msg.txt1, speech, sizeof(speech));
+      msg.ret = audio.connecttospeech(speech, "en");
+      state.looping = false;
+      strlcpy(state.file, "speech", sizeof(state.file));
+#endif
+    } else {
+      LOG_W("announcement clips or carrier missing, see tools/voice.py");
+      msg.ret = 0;
+    }
+    break;
+  default:
+    LOG_E("unknown audioTaskMessage");
+    return;
+  }
 }
 
 void audioTask(void *parameter) {
   if (!audioSetQueue || !audioGetQueue) {
-    Serial.println("Error: queues are not initialized");
+    LOG_E("queues are not initialized");
     while (true) {
       ;
     }
   }
 
   struct audioMessage audioRxTaskMessage;
-  struct audioMessage audioTxTaskMessage;
+  AudioPlayerState state = {};
 
   audio.setPinout(I2S_BCLK, I2S_LRC, I2S_DOUT);
   audio.setVolume(currentVolume); // 0...21
+  if (!mixerInit()) {
+    LOG_E("sound bank not found, run pio run -t uploadbank");
+  }
 
   while (true) {
-    if (xQueueReceive(audioSetQueue, &audioRxTaskMessage, 1) == pdPASS) {
-      if (audioRxTaskMessage.cmd == SET_VOLUME) {
-        audioTxTaskMessage.cmd = SET_VOLUME;
-        audio.setVolume(audioRxTaskMessage.value1);
-        audioTxTaskMessage.ret = 1;
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else if (audioRxTaskMessage.cmd == IS_PLAYING) {
-        audioTxTaskMessage.cmd = IS_PLAYING;
-        audioTxTaskMessage.ret = audio.isRunning();
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else if (audioRxTaskMessage.cmd == CONNECTTOHOST) {
-        audioTxTaskMessage.cmd = CONNECTTOHOST;
-        const char *host = audioRxTaskMessage.txt1;
-        const char *user = audioRxTaskMessage.txt2;
-        const char *pwd = audioRxTaskMessage.txt3;
-        audioTxTaskMessage.ret = audio.connecttohost(host, user, pwd);
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else if (audioRxTaskMessage.cmd == CONNECTTOSD) {
-        audioTxTaskMessage.cmd = CONNECTTOSD;
-        audioTxTaskMessage.ret = audio.connecttoFS(SD, audioRxTaskMessage.txt1,
-                                                   audioRxTaskMessage.value1);
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else if (audioRxTaskMessage.cmd == CONNECTTOSPEECH) {
-        audioTxTaskMessage.cmd = CONNECTTOSPEECH;
-        audioTxTaskMessage.ret = audio.connecttospeech(audioRxTaskMessage.txt1,
-                                                       audioRxTaskMessage.txt2);
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else if (audioRxTaskMessage.cmd == STOPSONG) {
-        audioTxTaskMessage.cmd = STOPSONG;
-        audioTxTaskMessage.ret = audio.stopSong();
-        xQueueSend(audioGetQueue, &audioTxTaskMessage, portMAX_DELAY);
-      } else {
-        Serial.println("Error: unknown audioTaskMessage");
+    // with nothing to decode, block until the next command so the CPU can
+    // sleep too
+    TickType_t wait = state.playing ? 1 : portMAX_DELAY;
+    if (xQueueReceive(audioSetQueue, &audioRxTaskMessage, wait) == pdPASS) {
+      profileRecord(
+          ProfileStage::AUDIO_QUEUE,
+          profileMicrosToNs(micros() - audioRxTaskMessage.postedUs));
+      runCommand(audioRxTaskMessage, state);
+      state.completedSeq = audioRxTaskMessage.seq;
+      state.completedCount++;
+      if (audioRxTaskMessage.callback &&
+          xQueueSend(audioGetQueue, &audioRxTaskMessage, 0) != pdPASS) {
+        LOG_E("audio completion queue full");
       }
     }
     audio.loop();
-    vTaskDelay(1);
+    if (mixerStreamEnded()) {
+      audio.stopSong();
+      state.looping = false;
+    }
+    state.playing = audio.isRunning();
+    state.position = audio.getFilePos();
+    state.voices = mixerActiveVoices();
+    streamLooping = state.looping;
+    publishState(state);
+    if (state.playing) {
+      vTaskDelay(1);
+    }
   }
 }
 
+// Called by the decoder with every block before it goes to I2S
+void audio_process_i2s(int16_t *outBuff, uint16_t validSamples,
+                       uint8_t bitsPerSamples, uint8_t channels,
+                       bool *continueI2S) {
+  if (bitsPerSamples == 16) {
+    mixerMix(outBuff, validSamples, channels, audio.getSampleRate(),
+             MIXER_STREAM_GAIN, streamLooping);
+  }
+  *continueI2S = true;
+}
+
 void audioInit() {
   CreateQueues();
   xTaskCreatePinnedToCore(audioTask,      /* Function to implement the task
@@ -79,56 +203,145 @@ void audioInit() {
   );
 }
 
-audioMessage transmitReceive(audioMessage msg) {
-  xQueueSend(audioSetQueue, &msg, portMAX_DELAY);
-  if (xQueueReceive(audioGetQueue, &audioRxMessage, portMAX_DELAY) == pdPASS) {
-    if (msg.cmd != audioRxMessage.cmd) {
-      Serial.println("Error: wrong reply from message queue");
-    }
+void audioLoop() {
+  audioMessage msg;
+  while (xQueueReceive(audioGetQueue, &msg, 0) == pdPASS) {
+    profileRecord(ProfileStage::AUDIO_ROUNDTRIP,
+                  profileMicrosToNs(micros() - msg.postedUs));
+    msg.callback(msg.seq, msg.ret);
+  }
+}
+
+static uint32_t post(audioMessage &msg, audioCallback callback) {
+  msg.seq = nextSeq.fetch_add(1);
+  msg.callback = callback;
+  msg.postedUs = micros();
+  // counted first, the audio task may complete it before xQueueSend returns
+  postedCount++;
+  if (xQueueSend(audioSetQueue, &msg, 0) != pdPASS) {
+    postedCount--;
+    LOG_E("audio command queue full");
+    return 0;
   }
-  return audioRxMessage;
+  return msg.seq;
+}
+
+bool audioPending() {
+  return audioGetState().completedCount != postedCount.load();
+}
+
+uint32_t audioSetVolume(uint8_t vol, audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = SET_VOLUME;
+  msg.value1 = vol;
+  return post(msg, callback);
+}
+
+bool audioIsPlaying() { return audioGetState().playing; }
+
+uint32_t audioConnecttohost(const char *host, const char *user,
+                            const char *pwd, audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = CONNECTTOHOST;
+  strlcpy(msg.txt1, host, sizeof(msg.txt1));
+  strlcpy(msg.txt2, user, sizeof(msg.txt2));
+  strlcpy(msg.txt3, pwd, sizeof(msg.txt3));
+  return post(msg, callback);
+}
+
+uint32_t audioConnecttoSD(const char *filename, uint32_t resumeFilePos,
+                          bool loop, audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = CONNECTTOSD;
+  strlcpy(msg.txt1, filename, sizeof(msg.txt1));
+  msg.value1 = resumeFilePos;
+  msg.value2 = loop;
+  return post(msg, callback);
+}
+
+bool audioIsLooping() { return audioGetState().looping; }
+
+uint32_t audioConnecttospeech(const char *speech, const char *lang,
+                              audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = CONNECTTOSPEECH;
+  strlcpy(msg.txt1, speech, sizeof(msg.txt1));
+  strlcpy(msg.txt2, lang, sizeof(msg.txt2));
+  return post(msg, callback);
 }
 
-void audioSetVolume(uint8_t vol) {
-  audioTxMessage.cmd = SET_VOLUME;
-  audioTxMessage.value1 = vol;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  (void)RX;
+uint32_t audioStopSong(audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = STOPSONG;
+  return post(msg, callback);
 }
 
-bool audioIsPlaying() {
-  audioTxMessage.cmd = IS_PLAYING;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  return RX.ret;
+uint32_t audioPlayEffect(const char *name, uint16_t gain, bool endsStream,
+                         audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = PLAYEFFECT;
+  strlcpy(msg.txt1, name, sizeof(msg.txt1));
+  msg.value1 = gain;
+  msg.value2 = endsStream;
+  return post(msg, callback);
 }
 
-bool audioConnecttohost(const char *host, const char *user, const char *pwd) {
-  audioTxMessage.cmd = CONNECTTOHOST;
-  audioTxMessage.txt1 = host;
-  audioTxMessage.txt2 = user;
-  audioTxMessage.txt3 = pwd;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  return RX.ret;
+uint32_t audioStopEffects(audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = STOPEFFECTS;
+  return post(msg, callback);
 }
 
-bool audioConnecttoSD(const char *filename, uint32_t resumeFilePos) {
-  audioTxMessage.cmd = CONNECTTOSD;
-  audioTxMessage.txt1 = filename;
-  audioTxMessage.value1 = resumeFilePos;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  return RX.ret;
+uint32_t audioSmoothSwing(bool on, audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = SMOOTHSWING;
+  msg.value1 = on;
+  return post(msg, callback);
 }
 
-bool audioConnecttospeech(const char *speech, const char *lang) {
-  audioTxMessage.cmd = CONNECTTOSPEECH;
-  audioTxMessage.txt1 = speech;
-  audioTxMessage.txt2 = lang;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  return RX.ret;
+uint32_t audioAnnounce(const char *tokens, audioCallback callback) {
+  audioMessage msg = {};
+  msg.cmd = ANNOUNCE;
+  strlcpy(msg.txt1, tokens, sizeof(msg.txt1));
+  return post(msg, callback);
 }
 
-uint32_t audioStopSong() {
-  audioTxMessage.cmd = STOPSONG;
-  audioMessage RX = transmitReceive(audioTxMessage);
-  return RX.ret;
+// One second of 16-bit mono silence, the mixer only runs on decoded blocks
+bool audioPrepareAnnouncements() {
+  if (SD.exists(ANNOUNCE_CARRIER)) {
+    return true;
+  }
+  File file = SD.open(ANNOUNCE_CARRIER, FILE_WRITE);
+  if (!file) {
+    return false;
+  }
+  const uint32_t rate = ANNOUNCE_CARRIER_RATE;
+  const uint32_t dataBytes = rate * 2;
+  const uint32_t byteRate = rate * 2;
+  uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                        'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0};
+  auto put32 = [&](size_t at, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+      header[at + i] = value >> (8 * i);
+    }
+  };
+  put32(4, 36 + dataBytes);
+  put32(24, rate);
+  put32(28, byteRate);
+  header[32] = 2;  // block align
+  header[34] = 16; // bits per sample
+  memcpy(header + 36, "data", 4);
+  put32(40, dataBytes);
+  bool ok = file.write(header, sizeof(header)) == sizeof(header);
+  uint8_t zeros[512] = {};
+  for (uint32_t left = dataBytes; ok && left > 0;) {
+    size_t n = min(left, (uint32_t)sizeof(zeros));
+    ok = file.write(zeros, n) == n;
+    left -= n;
+  }
+  file.close();
+  if (!ok) {
+    SD.remove(ANNOUNCE_CARRIER);
+  }
+  return ok;
 }
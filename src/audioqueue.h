@@ -4,30 +4,52 @@
 #include <SD.h>
 
 #include "config.h"
+#include "mixer.h"
 
 extern Audio audio;
 extern uint32_t currentVolume;
 
 enum : uint8_t {
   SET_VOLUME,
-  IS_PLAYING,
   CONNECTTOHOST,
   CONNECTTOSD,
   CONNECTTOSPEECH,
   STOPSONG,
+  PLAYEFFECT,
+  STOPEFFECTS,
+  SMOOTHSWING,
+  ANNOUNCE,
 };
 
+// Called from audioLoop() on the caller's task once the audio task has run
+// the command. ret is the library's return value for the command.
+typedef void (*audioCallback)(uint32_t seq, uint32_t ret);
+
+// Commands carry copies of their strings, so callers may pass temporaries
 struct audioMessage {
   uint8_t cmd;
-  const char *txt1;
-  const char *txt2;
-  const char *txt3;
+  uint32_t seq;
+  audioCallback callback;
+  char txt1[128];
+  char txt2[32];
+  char txt3[32];
   uint32_t value1;
   uint32_t value2;
   uint32_t ret;
+  uint32_t postedUs; // micros() at post, for the profiler
+};
+
+// Snapshot published by the audio task after every iteration
+struct AudioPlayerState {
+  bool playing;
+  bool looping;
+  uint8_t voices;
+  uint32_t position;
+  uint32_t completedSeq; // last command the audio task has run
+  uint32_t completedCount;
+  char file[64];
 };
 
-extern audioMessage audioTxMessage, audioRxMessage;
 extern QueueHandle_t audioSetQueue;
 extern QueueHandle_t audioGetQueue;
 
@@ -37,17 +59,56 @@ void audioTask(void *parameter);
 
 void audioInit();
 
-audioMessage transmitReceive(audioMessage msg);
+// Runs completion callbacks, call from loop()
+void audioLoop();
+
+// Lock-free read of the latest published player state
+AudioPlayerState audioGetState();
+
+// true while commands posted by any caller haven't been run yet
+bool audioPending();
+
+// All commands below are fire-and-forget: they return the command's sequence
+// id, or 0 if the command queue was full.
 
-void audioSetVolume(uint8_t vol);
+uint32_t audioSetVolume(uint8_t vol, audioCallback callback = nullptr);
 
 bool audioIsPlaying();
 
-bool audioConnecttohost(const char *host, const char *user = "",
-                        const char *pwd = "");
+uint32_t audioConnecttohost(const char *host, const char *user = "",
+                            const char *pwd = "",
+                            audioCallback callback = nullptr);
+
+uint32_t audioConnecttoSD(const char *filename, uint32_t resumeFilePos = 0,
+                          bool loop = false, audioCallback callback = nullptr);
+
+// true while a looping SD stream is playing
+bool audioIsLooping();
+
+uint32_t audioConnecttospeech(const char *speech, const char *lang = "en",
+                              audioCallback callback = nullptr);
+
+uint32_t audioStopSong(audioCallback callback = nullptr);
+
+// Plays a sound bank clip on a mixer voice, on top of the current stream.
+// With endsStream the stream is muted and stopped once the clip is over.
+uint32_t audioPlayEffect(const char *name, uint16_t gain = MIXER_EFFECT_GAIN,
+                         bool endsStream = false,
+                         audioCallback callback = nullptr);
+
+uint32_t audioStopEffects(audioCallback callback = nullptr);
 
-bool audioConnecttoSD(const char *filename, uint32_t resumeFilePos = 0);
+// Speaks an announcement (tokens from announce.h) from the sound bank without
+// network access. The current stream is stopped and a silent carrier loops
+// under the clips until they are over, audioIsPlaying() is true till then.
+// If a clip or the carrier is missing ret is 0 and the current stream keeps
+// playing, or with ANNOUNCE_ONLINE it goes to online text-to-speech when
+// Wi-Fi is up.
+uint32_t audioAnnounce(const char *tokens, audioCallback callback = nullptr);
 
-bool audioConnecttospeech(const char *speech, const char *lang = "en");
+// Writes the silent announcement carrier to SD if it is missing
+bool audioPrepareAnnouncements();
 
-uint32_t audioStopSong();
\ No newline at end of file
+// Turns the gyro-driven SmoothSwing loops on or off (they fade either way).
+// ret is 1 once the loops are running, 0 if the bank has none or when off.
+uint32_t audioSmoothSwing(bool on, audioCallback callback = nullptr);
@@ -0,0 +1,245 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// LRU cache of fixed size file blocks shared by all open files, in front of
+// a slow source (the SD card). Every source read costs a command round trip
+// on the bus, so a miss in a sequential stream fetches a whole run of blocks
+// with one read into adjacent slots, and reads of a full run or more go
+// straight through. Plain C++ for the native tests.
+
+// A file as seen by the cache
+class BlockSource {
+public:
+  virtual ~BlockSource() {}
+  // Reads up to len bytes at offset, returns how many; short only at the end
+  virtual size_t readAt(uint32_t offset, uint8_t *out, size_t len) = 0;
+
+private:
+  template <size_t, size_t, size_t> friend class BlockCache;
+  uint32_t cacheId = 0;
+  uint32_t nextBlock = UINT32_MAX; // sequential if the next miss is here
+};
+
+struct BlockCacheStats {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t sourceReads;
+  uint32_t sourceBytes;
+};
+
+template <size_t BLOCK_SIZE, size_t BLOCKS, size_t READ_AHEAD>
+class BlockCache {
+  static_assert(READ_AHEAD >= 1 && READ_AHEAD <= BLOCKS, "run fits the cache");
+
+  struct Slot {
+    uint32_t owner; // cacheId, 0 = free
+    uint32_t index; // block number in the file
+    uint32_t len;   // valid bytes, short for the last block of a file
+    uint32_t lastUse;
+  };
+
+  Slot slots[BLOCKS] = {};
+  uint8_t data[BLOCKS][BLOCK_SIZE];
+  uint32_t clock = 0;
+  uint32_t nextId = 0;
+  BlockCacheStats counters = {};
+
+  int find(uint32_t owner, uint32_t index) {
+    for (size_t i = 0; i < BLOCKS; i++) {
+      if (slots[i].owner == owner && slots[i].index == index) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  // the run of n adjacent slots whose most recent use is the oldest
+  size_t victimRun(size_t n) {
+    size_t best = 0;
+    uint32_t bestAge = 0;
+    for (size_t start = 0; start + n <= BLOCKS; start++) {
+      uint32_t newest = 0;
+      for (size_t i = start; i < start + n; i++) {
+        uint32_t use = slots[i].owner ? slots[i].lastUse : 0;
+        newest = use > newest ? use : newest;
+      }
+      uint32_t age = clock - newest;
+      if (start == 0 || age > bestAge) {
+        best = start;
+        bestAge = age;
+      }
+    }
+    return best;
+  }
+
+  // Loads `run` blocks from `index` on, returns the slot of the first one
+  int load(BlockSource &source, uint32_t index, size_t run) {
+    size_t start = victimRun(run);
+    // a block already cached would end up in two slots
+    for (size_t i = 1; i < run; i++) {
+      if (find(source.cacheId, index + i) >= 0) {
+        run = i;
+        break;
+      }
+    }
+    size_t got = source.readAt(index * BLOCK_SIZE, data[start],
+                               run * BLOCK_SIZE);
+    counters.sourceReads++;
+    counters.sourceBytes += got;
+    if (got == 0) {
+      return -1;
+    }
+    for (size_t i = 0; i < run; i++) {
+      Slot &slot = slots[start + i];
+      size_t offset = i * BLOCK_SIZE;
+      if (offset >= got) {
+        slot.owner = 0;
+        continue;
+      }
+      slot.owner = source.cacheId;
+      slot.index = index + i;
+      slot.len = got - offset < BLOCK_SIZE ? got - offset : BLOCK_SIZE;
+      slot.lastUse = clock;
+    }
+    return start;
+  }
+
+public:
+  void attach(BlockSource &source) {
+    if (++nextId == 0) {
+      nextId = 1;
+    }
+    source.cacheId = nextId;
+    source.nextBlock = UINT32_MAX;
+  }
+
+  // Drops the file's blocks, call when it is closed or written
+  void detach(BlockSource &source) {
+    for (Slot &slot : slots) {
+      if (slot.owner == source.cacheId) {
+        slot.owner = 0;
+      }
+    }
+    source.cacheId = 0;
+  }
+
+  // Reads len bytes at offset through the cache, short only at the end
+  size_t read(BlockSource &source, uint32_t offset, uint8_t *out, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+      uint32_t index = offset / BLOCK_SIZE;
+      uint32_t within = offset % BLOCK_SIZE;
+      clock++;
+      int slot = find(source.cacheId, index);
+      if (slot >= 0) {
+        counters.hits++;
+      } else {
+        counters.misses++;
+        bool sequential = index == source.nextBlock;
+        size_t run = sequential ? READ_AHEAD : 1;
+        if (within == 0 && len - done >= READ_AHEAD * BLOCK_SIZE) {
+          // a large aligned read has nothing to gain from the cache
+          size_t want = (len - done) / BLOCK_SIZE * BLOCK_SIZE;
+          size_t got = source.readAt(offset, out + done, want);
+          counters.sourceReads++;
+          counters.sourceBytes += got;
+          done += got;
+          offset += got;
+          source.nextBlock = offset / BLOCK_SIZE;
+          if (got < want) {
+            break;
+          }
+          continue;
+        }
+        slot = load(source, index, run);
+        if (slot < 0) {
+          break;
+        }
+      }
+      Slot &hit = slots[slot];
+      hit.lastUse = clock;
+      if (within >= hit.len) {
+        break; // end of file
+      }
+      size_t n = hit.len - within;
+      n = n < len - done ? n : len - done;
+      memcpy(out + done, data[slot] + within, n);
+      done += n;
+      offset += n;
+      source.nextBlock = index + 1;
+      if (hit.len < BLOCK_SIZE && within + n == hit.len) {
+        break;
+      }
+    }
+    return done;
+  }
+
+  BlockCacheStats stats() const { return counters; }
+  void resetStats() { counters = {}; }
+};
+
+// Files the player closes are parked here open, keyed by path, so that
+// reopening the hum or a song skips the FAT directory walk. A handle is
+// taken out while in use, at most one user per parked handle.
+template <class Handle, size_t ENTRIES, size_t PATH_LEN = 48>
+class HandleCache {
+  struct Entry {
+    char path[PATH_LEN];
+    Handle handle;
+    uint32_t lastUse;
+    bool used;
+  };
+
+  Entry entries[ENTRIES] = {};
+  uint32_t clock = 0;
+
+public:
+  // Takes the parked handle for path out of the cache
+  bool take(const char *path, Handle &out) {
+    for (Entry &entry : entries) {
+      if (entry.used && strcmp(entry.path, path) == 0) {
+        out = entry.handle;
+        entry.handle = Handle();
+        entry.used = false;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool contains(const char *path) const {
+    for (const Entry &entry : entries) {
+      if (entry.used && strcmp(entry.path, path) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Parks a handle, returns the one the caller has to close: the oldest
+  // parked one if it had to make room, the handle itself if the path is
+  // too long, otherwise Handle()
+  Handle park(const char *path, const Handle &handle) {
+    if (strlen(path) >= PATH_LEN) {
+      return handle;
+    }
+    Entry *slot = nullptr;
+    for (Entry &entry : entries) {
+      if (!entry.used) {
+        slot = &entry;
+        break;
+      }
+      if (!slot || entry.lastUse < slot->lastUse) {
+        slot = &entry;
+      }
+    }
+    Handle evicted = slot->used ? slot->handle : Handle();
+    strcpy(slot->path, path);
+    slot->handle = handle;
+    slot->lastUse = ++clock;
+    slot->used = true;
+    return evicted;
+  }
+};
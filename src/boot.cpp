@@ -0,0 +1,102 @@
+#include "boot.h"
+
+#include <ESPAsyncWebServer.h>
+#include <NetWizard.h>
+#include <WiFi.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "debug.h"
+
+static const char *const phaseNames[(int)BootPhase::COUNT] = {
+    "settings", "blade",   "controls", "motion", "audio",
+    "ready",    "storage", "ignite",   "wifi",   "web"};
+
+static std::atomic<uint32_t> phaseMs[(int)BootPhase::COUNT];
+static std::atomic<bool> webUp{false};
+static NetWizard *wizard = NULL;
+static void (*connectedCallback)() = NULL;
+
+void bootMark(BootPhase phase) {
+  uint32_t ms = millis();
+  ms = max(ms, (uint32_t)1); // 0 is not reached yet
+  uint32_t unset = 0;
+  if (phaseMs[(int)phase].compare_exchange_strong(unset, ms)) {
+    LOG_I("Boot: %s at %lu ms", phaseNames[(int)phase], (unsigned long)ms);
+  }
+}
+
+static void storageTask(void *parameter) {
+  ((void (*)())parameter)();
+  bootMark(BootPhase::STORAGE);
+  vTaskDelete(NULL);
+}
+
+bool bootStorage(void (*mount)()) {
+  return xTaskCreatePinnedToCore(storageTask,      /* Function to implement
+                                                      the task */
+                                 "storage",        /* Name of the task */
+                                 4096,             /* Stack size in words */
+                                 (void *)mount,    /* Task input parameter */
+                                 STORAGETASK_PRIO, /* Priority of the task */
+                                 NULL,             /* Task handle. */
+                                 STORAGETASK_CORE  /* Core where the task
+                                                      should run */
+                                 ) == pdPASS;
+}
+
+static void networkTask(void *parameter) {
+  // blocks in the portal until someone enters credentials
+  wizard->setStrategy(NetWizardStrategy::BLOCKING);
+  wizard->autoConnect("Lightsaber_AP", "");
+  while (WiFi.status() != WL_CONNECTED) {
+    vTaskDelay(pdMS_TO_TICKS(500));
+  }
+  bootMark(BootPhase::WIFI);
+  connectedCallback();
+  webUp.store(true, std::memory_order_release);
+  bootMark(BootPhase::WEB);
+  vTaskDelete(NULL);
+}
+
+bool bootNetwork(NetWizard &nw, void (*onConnected)()) {
+  wizard = &nw;
+  connectedCallback = onConnected;
+  return xTaskCreatePinnedToCore(networkTask,      /* Function to implement
+                                                      the task */
+                                 "network",        /* Name of the task */
+                                 8192,             /* Stack size in words */
+                                 NULL,             /* Task input parameter */
+                                 NETWORKTASK_PRIO, /* Priority of the task */
+                                 NULL,             /* Task handle. */
+                                 NETWORKTASK_CORE  /* Core where the task
+                                                      should run */
+                                 ) == pdPASS;
+}
+
+bool networkReady() { return webUp.load(std::memory_order_acquire); }
+
+void reportBoot() {
+  for (int i = 0; i < (int)BootPhase::COUNT; i++) {
+    uint32_t ms = phaseMs[i].load(std::memory_order_relaxed);
+    if (ms) {
+      LOG_I("Boot: %-8s %lu ms", phaseNames[i], (unsigned long)ms);
+    } else {
+      LOG_I("Boot: %-8s -", phaseNames[i]);
+    }
+  }
+}
+
+void bootWriteMetrics(AsyncResponseStream *response) {
+  response->print("# HELP lightsaber_boot_phase_seconds Time from start to "
+                  "each boot phase\n"
+                  "# TYPE lightsaber_boot_phase_seconds gauge\n");
+  for (int i = 0; i < (int)BootPhase::COUNT; i++) {
+    uint32_t ms = phaseMs[i].load(std::memory_order_relaxed);
+    if (ms) {
+      response->printf("lightsaber_boot_phase_seconds{phase=\"%s\"} %.3f\n",
+                       phaseNames[i], ms / 1000.0);
+    }
+  }
+}
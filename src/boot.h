@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+
+class AsyncResponseStream;
+class NetWizard;
+
+// Staged startup. setup() brings up what the blade needs on its own (LEDs,
+// buttons, IMU and audio with the sound bank) and marks READY. The SD card
+// and the hot assets come up on the storage task, Wi-Fi, with the NetWizard
+// portal when there are no credentials, then the web services on the
+// network task, both while the saber is already usable. Each phase is
+// timestamped once, in ms since the app started, to track time-to-ignite.
+
+enum class BootPhase : uint8_t {
+  SETTINGS, // preferences loaded
+  BLADE,    // render task running, blade color set
+  CONTROLS, // buttons attached
+  MOTION,   // IMU and motion task
+  AUDIO,    // audio task
+  READY,    // end of setup(), the blade can ignite
+  STORAGE,  // SD card, announcements and hot assets
+  IGNITE,   // first ignition
+  WIFI,     // connected
+  WEB,      // web server, OTA and WebSerial up
+  COUNT
+};
+
+// Only the first mark of a phase counts, safe from any task
+void bootMark(BootPhase phase);
+
+// Starts the storage task, which runs mount (the SD card and whatever needs
+// it) and marks STORAGE
+bool bootStorage(void (*mount)());
+
+// Starts the network task; onConnected registers the web services, it runs
+// on that task once Wi-Fi is up and before the server starts
+bool bootNetwork(NetWizard &nw, void (*onConnected)());
+
+// True once the web services are up
+bool networkReady();
+
+void reportBoot();
+
+void bootWriteMetrics(AsyncResponseStream *response);
@@ -0,0 +1,148 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Button gestures from timestamped levels, as Button2 used to report them:
+// debounced press and release, a click, double or triple click once
+// BUTTON_CLICK_WINDOW_MS pass after the last release, and a long press
+// while held. On top of that, the two-button combos, timed from the second
+// press to the last release. Levels come from the interrupt queue (edges)
+// and from sampling the pins (timers, and changes whose edge was lost);
+// both go through update() in time order. Plain C++ for the native tests.
+
+#define BUTTON_COUNT 2
+#define BUTTON_DEBOUNCE_MS 50
+#define BUTTON_CLICK_WINDOW_MS 300 // Button2's DOUBLECLICK_MS
+#define BUTTON_LONG_PRESS_MS 1000
+
+#define COMBO_SUPPRESS_MS 500    // single clicks this soon after belong to it
+#define COMBO_ANNOUNCE_MS 1000   // shorter: announce the IP address
+#define COMBO_RADIO_MS 2000      // from COMBO_ANNOUNCE_MS: next audio mode
+#define COMBO_WIFI_RESET_MS 5000 // from COMBO_RADIO_MS: internet radio
+
+enum class ButtonEvent : uint8_t {
+  NONE,
+  PRESSED,
+  RELEASED,
+  CLICK,
+  DOUBLE_CLICK,
+  TRIPLE_CLICK,
+  LONG_PRESS // held for BUTTON_LONG_PRESS_MS, no click follows
+};
+
+enum class ComboAction : uint8_t {
+  NONE,
+  ANNOUNCE_IP,
+  SWITCH_AUDIO_MODE,
+  TOGGLE_RADIO,
+  RESET_WIFI
+};
+
+struct ButtonAction {
+  uint8_t button;
+  ButtonEvent event;
+  ComboAction combo; // on the RELEASED that ends a combo
+};
+
+struct ButtonMachine {
+  bool down;
+  uint32_t changedMs; // last accepted level change
+  uint8_t clicks;     // short presses waiting for the click window
+  bool longPress;     // fired for the current press
+
+  // One event per call, call again until NONE
+  ButtonEvent update(bool pressed, uint32_t ms) {
+    if (!down && clicks &&
+        (int32_t)(ms - changedMs) >= BUTTON_CLICK_WINDOW_MS) {
+      uint8_t count = clicks;
+      clicks = 0;
+      return count == 1   ? ButtonEvent::CLICK
+             : count == 2 ? ButtonEvent::DOUBLE_CLICK
+                          : ButtonEvent::TRIPLE_CLICK;
+    }
+    // a bounce, or an edge older than the last change
+    if (pressed != down && (int32_t)(ms - changedMs) >= BUTTON_DEBOUNCE_MS) {
+      down = pressed;
+      changedMs = ms;
+      if (pressed) {
+        longPress = false;
+        return ButtonEvent::PRESSED;
+      }
+      if (!longPress) {
+        clicks++;
+      }
+      return ButtonEvent::RELEASED;
+    }
+    if (down && !longPress &&
+        (int32_t)(ms - changedMs) >= BUTTON_LONG_PRESS_MS) {
+      longPress = true;
+      clicks = 0;
+      return ButtonEvent::LONG_PRESS;
+    }
+    return ButtonEvent::NONE;
+  }
+
+  // Still needs timely updates: held, or waiting for more clicks
+  bool busy() const { return down || clicks; }
+};
+
+struct ButtonPanel {
+  ButtonMachine buttons[BUTTON_COUNT];
+  uint8_t held;
+  uint32_t bothMs; // second press
+  bool comboCandidate;
+  uint32_t lastComboMs;
+
+  // Feeds one level of one button, out(const ButtonAction &) gets the result
+  template <typename Out>
+  void update(uint8_t button, bool pressed, uint32_t ms, Out &&out) {
+    ButtonEvent event;
+    while ((event = buttons[button].update(pressed, ms)) != ButtonEvent::NONE) {
+      ButtonAction action = {button, event, ComboAction::NONE};
+      if (event == ButtonEvent::PRESSED && ++held == 2) {
+        bothMs = ms;
+        comboCandidate = true;
+      } else if (event == ButtonEvent::RELEASED) {
+        if (held) {
+          held--;
+        }
+        if (!held && comboCandidate) {
+          action.combo = combo(ms - bothMs);
+          lastComboMs = ms;
+          comboCandidate = false;
+        }
+      } else if (event == ButtonEvent::CLICK &&
+                 (comboCandidate ||
+                  (int32_t)(ms - lastComboMs) < COMBO_SUPPRESS_MS)) {
+        continue;
+      }
+      out(action);
+    }
+  }
+
+  bool busy() const {
+    for (const ButtonMachine &button : buttons) {
+      if (button.busy()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Exactly COMBO_ANNOUNCE_MS or COMBO_RADIO_MS does nothing, as before
+  static ComboAction combo(uint32_t heldMs) {
+    if (heldMs > COMBO_WIFI_RESET_MS) {
+      return ComboAction::RESET_WIFI;
+    }
+    if (heldMs > COMBO_RADIO_MS) {
+      return ComboAction::TOGGLE_RADIO;
+    }
+    if (heldMs > COMBO_ANNOUNCE_MS && heldMs < COMBO_RADIO_MS) {
+      return ComboAction::SWITCH_AUDIO_MODE;
+    }
+    if (heldMs < COMBO_ANNOUNCE_MS) {
+      return ComboAction::ANNOUNCE_IP;
+    }
+    return ComboAction::NONE;
+  }
+};
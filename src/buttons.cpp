@@ -0,0 +1,74 @@
+#include "buttons.h"
+
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+
+#include "config.h"
+#include "debug.h"
+#include "jobs.h"
+
+struct ButtonEdge {
+  uint32_t ms;
+  uint8_t button;
+  bool pressed;
+};
+
+// in DRAM, the ISR reads it
+static DRAM_ATTR uint8_t pins[BUTTON_COUNT] = {BTN1_PIN, BTN2_PIN};
+static QueueHandle_t edgeQueue = NULL;
+static ButtonPanel panel = {};
+static ButtonHandler actionHandler = NULL;
+static int wakeJob = -1;
+
+static inline bool IRAM_ATTR pinHigh(uint8_t pin) {
+  return pin < 32 ? (GPIO.in >> pin) & 1 : (GPIO.in1.data >> (pin - 32)) & 1;
+}
+
+// Buttons pull the pin low
+static void IRAM_ATTR onLevel(void *arg) {
+  uint8_t button = (uintptr_t)arg;
+  uint8_t pin = pins[button];
+  bool high = pinHigh(pin);
+  // wait for the other level, the wakeup enable bit stays
+  GPIO.pin[pin].int_type = high ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL;
+  ButtonEdge edge = {(uint32_t)(esp_timer_get_time() / 1000), button, !high};
+  BaseType_t woken = pdFALSE;
+  xQueueSendFromISR(edgeQueue, &edge, &woken);
+  jobsWakeFromISR(wakeJob, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+bool buttonsInit(ButtonHandler handler, int jobId) {
+  actionHandler = handler;
+  wakeJob = jobId;
+  edgeQueue = xQueueCreate(BUTTON_QUEUE_LEN, sizeof(ButtonEdge));
+  if (!edgeQueue) {
+    return false;
+  }
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    pinMode(pins[i], INPUT_PULLUP);
+    bool high = digitalRead(pins[i]);
+    attachInterruptArg(pins[i], onLevel, (void *)(uintptr_t)i,
+                       high ? ONLOW : ONHIGH);
+    gpio_wakeup_enable((gpio_num_t)pins[i],
+                       high ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+  }
+  return true;
+}
+
+static void dispatch(const ButtonAction &action) { actionHandler(action); }
+
+bool buttonsPoll() {
+  ButtonEdge edge;
+  while (xQueueReceive(edgeQueue, &edge, 0) == pdPASS) {
+    panel.update(edge.button, edge.pressed, edge.ms, dispatch);
+  }
+  // timers, and a change whose edge didn't fit in the queue
+  uint32_t now = millis();
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    panel.update(i, digitalRead(pins[i]) == LOW, now, dispatch);
+  }
+  return panel.busy();
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <Arduino.h>
+
+#include "buttongesture.h"
+
+// Buttons on GPIO interrupts. BTN1_PIN and BTN2_PIN interrupt on the level
+// opposite to the one they are at, flipped in the ISR with every change, so
+// each change is caught and either button can also wake the chip from light
+// sleep (which only wakes on levels). The ISR queues the timestamped level
+// and wakes the buttons job, which feeds the queue and then the current pin
+// levels to the gesture machine in buttongesture.h.
+
+typedef void (*ButtonHandler)(const ButtonAction &action);
+
+// jobId is the loop job that calls buttonsPoll()
+bool buttonsInit(ButtonHandler handler, int jobId);
+
+// From the buttons job, true while a gesture needs the short period
+bool buttonsPoll();
@@ -9,14 +9,15 @@
 #define I2S_BCLK 27
 #define I2S_LRC 14
 #define LED_PIN 13
+#ifndef NUM_PIXELS
 #define NUM_PIXELS 120
+#endif
 #define BTN1_PIN 33
 #define BTN2_PIN 32
 #define KNOCK_PIN 35
 #define VOLT_PIN 34
 
 // Voltage measuring config
-#define NO_OF_SAMPLES 100
 #define ADC_UNIT ADC_UNIT_1
 #define ADC_CHANNEL ADC_CHANNEL_6
 #define ADC_ATTEN ADC_ATTEN_DB_12
@@ -24,15 +25,153 @@
 #define DIVIDER_COEFFICIENT 11
 #define VOLTAGE_FIXUP 150
 
+// Battery monitor config
+#define BATTERYTASK_PRIO 1
+#define BATTERYTASK_CORE 0
+#define BATTERY_PERIOD_MS 100
+#define BATTERY_BURST 9     // one-shot reads per median
+#define BATTERY_EMA_SHIFT 4 // EMA weight 1/16 per period, ~1.6 s
+// load compensation: sag = load current * pack and wiring resistance
+#define BATTERY_RESISTANCE_MOHM 150
+#define LED_MA_PER_CHANNEL 20 // WS2812 channel at full brightness
+#define AUDIO_LOAD_MA 300     // amplifier at full volume while playing
+
 // Audio config
 #define AUDIOTASK_PRIO 2
 #define AUDIOTASK_CORE 0
 
+// Mixer config, gains are Q8 (256 = unity)
+#define MIXER_VOICES 2
+#define MIXER_STREAM_GAIN 256
+#define MIXER_EFFECT_GAIN 256
+
+// Announcements play sound bank clips over a silent WAV written to SD
+#define ANNOUNCE_CARRIER "/silence.wav"
+#define ANNOUNCE_CARRIER_RATE 16000
+#ifndef ANNOUNCE_ONLINE
+#define ANNOUNCE_ONLINE 0 // 1: online text-to-speech when a clip is missing
+#endif
+
+// SmoothSwing config, the two looping tones come from the sound bank
+#define SMOOTHSWING_LOW "swingl"
+#define SMOOTHSWING_HIGH "swingh"
+#define SMOOTHSWING_THRESHOLD_DPS 20    // tones stay silent below this
+#define SMOOTHSWING_SENSITIVITY_DPS 450 // full swing level
+#define SMOOTHSWING_PERIOD_DEG 180      // rotation for low -> high -> low
+#define SMOOTHSWING_SMOOTH_MS 30        // angular speed smoothing
+#define SMOOTHSWING_GAIN 256            // tone level at full swing, Q8
+#define SMOOTHSWING_HUM_DUCKING 192     // hum gain taken at full swing, Q8
+
+// Motion task config
+#define MOTIONTASK_PRIO 3
+#define MOTIONTASK_CORE 1
+#define MOTION_RATE_HZ 500
+#define MOTION_IDLE_RATE_HZ 50  // while the blade is off
+#define MOTION_WAKE_THRESHOLD 20 // idle motion interrupt, 2 mg per step
+
+// IMU trace recorder config
+#define RECORDERTASK_PRIO 1
+#define RECORDERTASK_CORE 0
+#define RECORDER_PERIOD_MS 100 // well inside the motion ring's 512 ms
+
+// Log config, levels from logring.h
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO // higher levels are compiled out
+#endif
+#define LOG_RING_SIZE 64 // records, power of two
+#define LOGTASK_PRIO 1
+#define LOGTASK_CORE 0
+#define LOG_DRAIN_MS 20
+
+// Loop profiler config
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 1 // 0 compiles the timestamps out of loop()
+#endif
+
+// Loop job periods in ms, see jobs.h
+#define JOB_MOTION_MS 5    // detection on the peaks since the last run
+#define JOB_BUTTONS_MS 5
+#define JOB_AUDIO_MS 5     // audio command completions
+#define JOB_SERVICE_MS 20  // OTA, WebSerial and queued commands
+#define JOB_BATTERY_MS 25  // one pixel of the battery bar
+#define JOB_VOLUME_MS 100  // one step while a volume button is held
+#define JOB_SETTINGS_MS 100
+#define JOB_IDLE_MS 100    // motion, buttons and audio while nothing happens
+
+// Buttons config, gesture timing in buttongesture.h
+#define BUTTON_QUEUE_LEN 16 // edges between two runs of the buttons job
+
+// Power config, see power.h
+#ifndef POWER_SAVE
+#define POWER_SAVE 1
+#endif
+#define POWER_MAX_MHZ 240
+#define POWER_MIN_MHZ 80 // keeps the APB clock for the LEDs and I2S
+#define POWER_IDLE_MS 1000 // render, log, battery and battery bar while idle
+
+// Heap tracker config
+#define HEAP_SAMPLE_MS 60000    // 2 hours in the trend ring
+#define HEAP_SHRINK_WARN 4096.0 // largest free block loss, bytes per hour
+
+// Telemetry config
+#define TELEMETRYTASK_PRIO 1
+#define TELEMETRYTASK_CORE 0
+#define TELEMETRY_RATE_HZ 20 // frames per second until a client asks
+#define TELEMETRY_MAX_RATE_HZ 50
+#define TELEMETRY_DECIMATION 1 // every n-th motion sample is sent
+#define TELEMETRY_MAX_DECIMATION 50
+#define TELEMETRY_MAX_SAMPLES 128 // per frame, the rest is counted as lost
+
+// SD config
+#define SD_SAFE_HZ 4000000 // the SD library default, reference for the probe
+#define SD_MAX_HZ 40000000
+#define SD_TUNE_SECTORS 16 // read back per probe, spread over the card
+#define SD_TUNE_PASSES 3   // a clock has to pass this many probes
+#define SDCACHE_BLOCK_SIZE 1024
+#define SDCACHE_BLOCKS 8     // 8 KB
+#define SDCACHE_READ_AHEAD 4 // blocks per card read in a sequential stream
+#define SDCACHE_OPEN_FILES 3 // parked handles, hum + song + carrier
+#define SD_BENCH_BYTES (256 * 1024)
+#define SDBENCHTASK_PRIO 1 // below the audio task, away from the loop
+#define SDBENCHTASK_CORE 0
+#define SD_BENCH_CHUNK 1600 // about what the MP3 decoder asks for
+
+// Hot assets, copied from SD into flash at boot in this order while they fit
+#define ASSET_HOT_FILES "/hum.mp3", ANNOUNCE_CARRIER
+
+// Network task config, Wi-Fi and the web services come up on it
+#define NETWORKTASK_PRIO 1
+#define NETWORKTASK_CORE 0
+
+// Storage task config, the SD card and the hot assets come up on it
+#define STORAGETASK_PRIO 1
+#define STORAGETASK_CORE 0
+
+// OTA config
+#define OTA_CONFIRM_MS 30000 // a new image that runs this long is kept
+#define OTA_RESTART_MS 1000  // after a finished update, lets the reply out
+
+// Settings config
+#define SETTINGS_NAMESPACE "lightsaber"
+#define SETTINGS_QUIET_MS 3000 // flush once nothing changed for this long
+
+// Render task config
+#define RENDERTASK_PRIO 2
+#define RENDERTASK_CORE 1
+#define RENDER_FPS 33
+
 // Blink config
 
 #define BLINK_ALLOW 1
 #define BLINK_AMPL 40
-#define BLINK_DELAY 30
 #define FLASH_DELAY 80
 
+// Ignition/retraction config, durations in ms
+#define IGNITION_DELAY 200
+#define IGNITION_DURATION 600
+#define IGNITION_EASING Easing::EASE_OUT
+#define RETRACTION_DELAY 200
+#define RETRACTION_DURATION 600
+#define RETRACTION_EASING Easing::EASE_IN
+
 #define GYRO_DEBUG 0
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "debug.h"
+
+#include <WebSerial.h>
+
+#include <atomic>
+
+#include "power.h"
+
+LogRing<LOG_RING_SIZE> logRing;
+
+static const char levelTags[] = "EWID";
+static std::atomic<bool> webSerial{false};
+
+static void logTask(void *parameter) {
+  LogRecord record;
+  char line[256];
+  uint32_t reportedDrops = 0;
+  while (true) {
+    while (logRing.pop(record)) {
+      size_t len = snprintf(line, sizeof(line), "[%lu.%03lu] %c ",
+                            (unsigned long)record.millis / 1000,
+                            (unsigned long)record.millis % 1000,
+                            levelTags[record.level & 3]);
+      len += logFormat(record, line + len, sizeof(line) - len - 1);
+      line[len++] = '\n';
+      line[len] = '\0';
+      Serial.write((const uint8_t *)line, len);
+      if (webSerial.load(std::memory_order_acquire)) {
+        WebSerial.print(line);
+      }
+    }
+    uint32_t drops = logRing.dropped.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+      LOG_W("%lu log lines dropped", (unsigned long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+    // the ring holds a second of the few lines an idle saber logs
+    vTaskDelay(pdMS_TO_TICKS(powerIdle() ? POWER_IDLE_MS : LOG_DRAIN_MS));
+  }
+}
+
+void logAttachWebSerial() {
+  webSerial.store(true, std::memory_order_release);
+}
+
+void logInit() {
+  xTaskCreatePinnedToCore(logTask,      /* Function to implement the task */
+                          "log",        /* Name of the task */
+                          4096,         /* Stack size in words */
+                          NULL,         /* Task input parameter */
+                          LOGTASK_PRIO, /* Priority of the task */
+                          NULL,         /* Task handle. */
+                          LOGTASK_CORE  /* Core where the task should run */
+  );
+}
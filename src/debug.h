@@ -1,22 +1,49 @@
 #pragma once
 #include <Arduino.h>
-#include <WebSerial.h>
+
+#include "config.h"
+#include "logring.h"
+
+// Asynchronous logging. LOG_E/W/I/D only push the format pointer and the
+// arguments into logRing; the log task formats each record once and writes
+// it to Serial and WebSerial. Levels above LOG_LEVEL are compiled out.
+// Formats must be string literals, one record is one line (no trailing \n).
+
+extern LogRing<LOG_RING_SIZE> logRing;
 
 template <typename... Args>
-size_t d_printf(const char *format, Args &&...args) {
-  size_t ret = Serial.printf(format, std::forward<Args>(args)...);
-  WebSerial.printf(format, std::forward<Args>(args)...);
-  return ret;
+inline void logWrite(uint8_t level, const char *format, const Args &...args) {
+  static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+  const LogArg packed[sizeof...(Args) + 1] = {logArg(args)...};
+  logRing.push(level, millis(), format, packed, sizeof...(Args));
 }
 
-template <typename T> size_t d_print(const T &v) {
-  size_t ret = Serial.print(v);
-  WebSerial.print(v);
-  return ret;
-}
+// "" format rejects anything but a literal
+#define LOG_AT(level, format, ...) logWrite(level, "" format, ##__VA_ARGS__)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_E(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOG_E(format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#else
+#define LOG_W(format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_I(format, ...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define LOG_D(format, ...) ((void)0)
+#endif
+
+// Starts the log task, records pushed before that are kept until it runs
+void logInit();
 
-template <typename T> size_t d_println(const T &v) {
-  size_t ret = Serial.println(v);
-  WebSerial.println(v);
-  return ret;
-}
\ No newline at end of file
+// Once WebSerial is up, lines go there too
+void logAttachWebSerial();
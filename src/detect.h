@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+
+// Clash/swing detection. Kept free of Arduino so the host replay tool in
+// tools/replay runs recorded traces through exactly this logic.
+
+// thresholds on the peak magnitudes, m/s^2 and rad/s
+#define STRIKE_LIGHT 15.0f
+#define STRIKE_STRONG 20.0f
+#define SWING_LIGHT 2.0f
+#define SWING_STRONG 2.5f
+
+#define STRIKE_COOLDOWN 300 // ms
+#define SWING_COOLDOWN 1000 // ms
+
+enum class MotionEvent : uint8_t { NONE, CLASH, SWING };
+
+struct Trigger {
+  float lightTh;
+  float strongTh;
+  unsigned long cooldown;
+  unsigned long lastTime;
+};
+
+struct MotionDetector {
+  Trigger strike = {STRIKE_LIGHT, STRIKE_STRONG, STRIKE_COOLDOWN, 0};
+  Trigger swing = {SWING_LIGHT, SWING_STRONG, SWING_COOLDOWN, 0};
+  // effect currently playing, a swing may be cut short by a clash but
+  // nothing interrupts a clash
+  MotionEvent effect = MotionEvent::NONE;
+  unsigned long effectStart = 0;
+  unsigned long effectLength = 0;
+};
+
+inline bool tryTrigger(float value, Trigger &trigger, unsigned long now) {
+  if (now - trigger.lastTime < trigger.cooldown)
+    return false;
+  if (value < trigger.lightTh)
+    return false;
+  trigger.lastTime = now;
+  return true;
+}
+
+inline bool effectPlaying(const MotionDetector &detector, unsigned long now) {
+  return now - detector.effectStart < detector.effectLength;
+}
+
+// Feeds one window's peak magnitudes, clash wins over swing
+inline MotionEvent detectMotion(MotionDetector &detector, float acc, float gyr,
+                                unsigned long now) {
+  if (effectPlaying(detector, now) && detector.effect != MotionEvent::SWING)
+    return MotionEvent::NONE;
+  if (tryTrigger(acc, detector.strike, now))
+    return MotionEvent::CLASH;
+  if (tryTrigger(gyr, detector.swing, now))
+    return MotionEvent::SWING;
+  return MotionEvent::NONE;
+}
+
+// The caller picks the clip, the detector only needs its length
+inline void effectStarted(MotionDetector &detector, MotionEvent effect,
+                          unsigned long now, unsigned long length) {
+  detector.effect = effect;
+  detector.effectStart = now;
+  detector.effectLength = length;
+}
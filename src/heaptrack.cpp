@@ -0,0 +1,137 @@
+#include "heaptrack.h"
+
+#include <ESPAsyncWebServer.h>
+#include <esp_heap_caps.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "debug.h"
+#include "histogram.h"
+
+// The wraps can run with the flash cache disabled (IDF keeps the heap
+// functions in IRAM for that), so they and everything they touch live in
+// IRAM and DRAM
+static DRAM_ATTR std::atomic<uint32_t> allocations{0};
+static DRAM_ATTR std::atomic<uint32_t> loopAllocations{0};
+static DRAM_ATTR std::atomic<TaskHandle_t> loopTask{NULL};
+static Histogram perLoop;
+static HeapTrend trend;
+static uint32_t lastSampleMs = 0;
+static bool warned = false;
+
+static inline void IRAM_ATTR countAllocation() {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  TaskHandle_t task = loopTask.load(std::memory_order_relaxed);
+  if (task && xTaskGetCurrentTaskHandle() == task) {
+    loopAllocations.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *IRAM_ATTR __wrap_malloc(size_t size) {
+  countAllocation();
+  return __real_malloc(size);
+}
+
+void *IRAM_ATTR __wrap_calloc(size_t count, size_t size) {
+  countAllocation();
+  return __real_calloc(count, size);
+}
+
+void *IRAM_ATTR __wrap_realloc(void *ptr, size_t size) {
+  countAllocation();
+  return __real_realloc(ptr, size);
+}
+}
+
+static HeapSample sampleHeap() {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
+  return {(uint32_t)millis(), (uint32_t)info.total_free_bytes,
+          (uint32_t)info.largest_free_block};
+}
+
+void heapLoop() {
+  if (!loopTask.load(std::memory_order_relaxed)) {
+    loopTask = xTaskGetCurrentTaskHandle();
+    trend.add(sampleHeap());
+    lastSampleMs = millis();
+    return;
+  }
+  perLoop.record(loopAllocations.exchange(0, std::memory_order_relaxed));
+  if ((uint32_t)(millis() - lastSampleMs) < HEAP_SAMPLE_MS) {
+    return;
+  }
+  lastSampleMs = millis();
+  HeapSample sample = sampleHeap();
+  trend.add(sample);
+  LOG_D("Heap: %lu free, largest block %lu, %.0f B/h",
+        (unsigned long)sample.freeBytes, (unsigned long)sample.largest,
+        trend.largestSlope());
+  bool full = trend.count == HEAP_TREND_SAMPLES;
+  if (full && !warned && trend.largestSlope() < -HEAP_SHRINK_WARN) {
+    warned = true;
+    LOG_W("Heap: largest free block shrinking %.0f B/h, %lu bytes left",
+          -trend.largestSlope(), (unsigned long)sample.largest);
+  }
+}
+
+// Copies, loop() keeps recording while a report reads them
+static Histogram loops;
+static HeapTrend window;
+
+void reportHeap() {
+  loops = perLoop;
+  window = trend;
+  HeapSample now = sampleHeap();
+  LOG_I("Heap: %lu free (min %lu), largest block %lu (min %lu), %.0f%% "
+        "fragmented",
+        (unsigned long)now.freeBytes, (unsigned long)ESP.getMinFreeHeap(),
+        (unsigned long)now.largest, (unsigned long)window.lowestLargest,
+        heapFragmentation(now) * 100);
+  LOG_I("Heap trend over %lu min: largest block %+.0f B/h, free %+.0f B/h",
+        (unsigned long)window.spanMs() / 60000, window.largestSlope(),
+        window.freeSlope());
+  LOG_I("Allocations: %lu, per loop p50=%lu p99=%lu max=%lu over %lu loops",
+        (unsigned long)allocations.load(), (unsigned long)loops.percentile(0.5),
+        (unsigned long)loops.percentile(0.99), (unsigned long)loops.max,
+        (unsigned long)loops.count);
+}
+
+void heapWriteMetrics(AsyncResponseStream *response) {
+  static const float quantiles[] = {0.5, 0.9, 0.99};
+  loops = perLoop;
+  window = trend;
+  HeapSample now = sampleHeap();
+  response->printf("# HELP lightsaber_heap_free_bytes Free heap\n"
+                   "# TYPE lightsaber_heap_free_bytes gauge\n"
+                   "lightsaber_heap_free_bytes %lu\n"
+                   "# HELP lightsaber_heap_largest_free_block_bytes Largest "
+                   "allocatable block\n"
+                   "# TYPE lightsaber_heap_largest_free_block_bytes gauge\n"
+                   "lightsaber_heap_largest_free_block_bytes %lu\n"
+                   "# HELP lightsaber_heap_largest_free_block_slope Trend of "
+                   "the largest block in bytes per hour\n"
+                   "# TYPE lightsaber_heap_largest_free_block_slope gauge\n"
+                   "lightsaber_heap_largest_free_block_slope %.1f\n"
+                   "# HELP lightsaber_allocations_total malloc, calloc and "
+                   "realloc calls\n"
+                   "# TYPE lightsaber_allocations_total counter\n"
+                   "lightsaber_allocations_total %lu\n",
+                   (unsigned long)now.freeBytes, (unsigned long)now.largest,
+                   window.largestSlope(), (unsigned long)allocations.load());
+  response->print("# HELP lightsaber_loop_allocations Allocations per loop()\n"
+                  "# TYPE lightsaber_loop_allocations summary\n");
+  for (float q : quantiles) {
+    response->printf("lightsaber_loop_allocations{quantile=\"%g\"} %lu\n", q,
+                     (unsigned long)loops.percentile(q));
+  }
+  response->printf("lightsaber_loop_allocations_sum %llu\n"
+                   "lightsaber_loop_allocations_count %lu\n",
+                   (unsigned long long)loops.sum, (unsigned long)loops.count);
+}
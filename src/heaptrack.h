@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+#include "heaptrend.h"
+
+class AsyncResponseStream;
+
+// Heap use over long sessions. Every malloc(), calloc() and realloc() is
+// counted through linker wraps (-Wl,--wrap in platformio.ini), and those
+// made by the loop task go into a per-loop() histogram: the hot path should
+// stay at zero. Every HEAP_SAMPLE_MS the free heap and its largest free
+// block go into a HeapTrend, and a largest block that shrinks faster than
+// HEAP_SHRINK_WARN bytes per hour over a full window is logged.
+
+// At the start of loop(), closes the previous iteration
+void heapLoop();
+
+void reportHeap();
+
+void heapWriteMetrics(AsyncResponseStream *response);
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Heap fragmentation trend: a ring of periodic samples of the free heap and
+// its largest free block, with least squares slopes over the ring. A largest
+// block that keeps shrinking while the free total holds is fragmentation,
+// both shrinking together is a leak. Plain C++ for the native tests.
+
+#define HEAP_TREND_SAMPLES 120
+
+struct HeapSample {
+  uint32_t ms;
+  uint32_t freeBytes;
+  uint32_t largest; // largest free block
+};
+
+// 0 when all free memory is one block, towards 1 as it splinters
+inline float heapFragmentation(const HeapSample &sample) {
+  return sample.freeBytes ? 1 - (float)sample.largest / sample.freeBytes : 0;
+}
+
+struct HeapTrend {
+  HeapSample samples[HEAP_TREND_SAMPLES];
+  uint32_t count; // valid samples, up to HEAP_TREND_SAMPLES
+  uint32_t next;
+  uint32_t lowestLargest; // since reset, not only over the ring
+
+  void reset() { memset(this, 0, sizeof(*this)); }
+
+  void add(const HeapSample &sample) {
+    samples[next] = sample;
+    next = (next + 1) % HEAP_TREND_SAMPLES;
+    if (count < HEAP_TREND_SAMPLES) {
+      count++;
+    }
+    if (!lowestLargest || sample.largest < lowestLargest) {
+      lowestLargest = sample.largest;
+    }
+  }
+
+  // i = 0 is the oldest sample in the ring
+  const HeapSample &at(uint32_t i) const {
+    uint32_t first = count < HEAP_TREND_SAMPLES ? 0 : next;
+    return samples[(first + i) % HEAP_TREND_SAMPLES];
+  }
+
+  const HeapSample &latest() const { return at(count - 1); }
+
+  // Bytes per hour, 0 until two samples
+  float largestSlope() const { return slope(&HeapSample::largest); }
+  float freeSlope() const { return slope(&HeapSample::freeBytes); }
+
+  // Time covered by the ring
+  uint32_t spanMs() const { return count < 2 ? 0 : latest().ms - at(0).ms; }
+
+private:
+  float slope(uint32_t HeapSample::*field) const {
+    if (count < 2) {
+      return 0;
+    }
+    // relative to the first sample, floats would lose the low bits
+    const HeapSample &first = at(0);
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      double x = (at(i).ms - first.ms) / 3600000.0;
+      double y = (double)(at(i).*field) - (double)(first.*field);
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+    }
+    double d = count * sxx - sx * sx;
+    return d > 0 ? (count * sxy - sx * sy) / d : 0;
+  }
+};
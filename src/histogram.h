@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Log-linear latency histogram: every power of two is split into
+// HISTOGRAM_SUB_BUCKETS linear buckets, so a percentile is off by at most
+// 1 / HISTOGRAM_SUB_BUCKETS of its value. Recording is a count-leading-zeros,
+// a shift and three adds. Plain C++ for the native tests.
+
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+inline uint32_t histogramBucket(uint32_t value) {
+  if (value < HISTOGRAM_SUB_BUCKETS) {
+    return value;
+  }
+  uint32_t msb = 31 - __builtin_clz(value);
+  uint32_t sub = (value >> (msb - HISTOGRAM_SUB_BITS)) &
+                 (HISTOGRAM_SUB_BUCKETS - 1);
+  return (msb - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+// Largest value that lands in the bucket
+inline uint32_t histogramBucketMax(uint32_t bucket) {
+  if (bucket < HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+  uint32_t msb = bucket / HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BITS - 1;
+  uint32_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+  uint64_t low = (uint64_t)(HISTOGRAM_SUB_BUCKETS + sub)
+                 << (msb - HISTOGRAM_SUB_BITS);
+  return low + (1ull << (msb - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+struct Histogram {
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
+
+  void reset() { memset(this, 0, sizeof(*this)); }
+
+  void record(uint32_t value) {
+    counts[histogramBucket(value)]++;
+    count++;
+    sum += value;
+    if (value > max) {
+      max = value;
+    }
+  }
+
+  // Upper bound of the bucket holding the q-th quantile, q in 0..1
+  uint32_t percentile(float q) const {
+    if (!count) {
+      return 0;
+    }
+    uint32_t rank = q * count;
+    if (rank >= count) {
+      rank = count - 1;
+    }
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      seen += counts[i];
+      if (seen > rank) {
+        uint32_t bound = histogramBucketMax(i);
+        return bound < max ? bound : max;
+      }
+    }
+    return max;
+  }
+};
@@ -0,0 +1,115 @@
+#include "jobs.h"
+
+#include <ESPAsyncWebServer.h>
+
+#include <atomic>
+
+#include "debug.h"
+
+static uint32_t schedulerClock() { return micros(); }
+
+Scheduler loopJobs(schedulerClock);
+static std::atomic<bool> resetPending{false};
+static std::atomic<uint32_t> wakeMask{0};
+static TaskHandle_t loopTask = NULL;
+
+void jobsRun() {
+  if (!loopTask) {
+    loopTask = xTaskGetCurrentTaskHandle();
+  }
+  if (resetPending.exchange(false, std::memory_order_relaxed)) {
+    loopJobs.resetStats();
+  }
+  uint32_t wake = wakeMask.exchange(0, std::memory_order_acquire);
+  for (int id = 0; wake; id++, wake >>= 1) {
+    if (wake & 1) {
+      loopJobs.wake(id);
+    }
+  }
+  uint32_t waitUs = loopJobs.run();
+  // below a tick, loop() comes straight back
+  uint32_t ticks = waitUs / (portTICK_PERIOD_MS * 1000);
+  if (ticks && !wakeMask.load(std::memory_order_relaxed)) {
+    ulTaskNotifyTake(pdTRUE, ticks);
+  }
+}
+
+void IRAM_ATTR jobsWakeFromISR(int id, BaseType_t *woken) {
+  wakeMask.fetch_or(1u << id, std::memory_order_release);
+  if (loopTask) {
+    vTaskNotifyGiveFromISR(loopTask, woken);
+  }
+}
+
+void jobsReset() { resetPending.store(true, std::memory_order_relaxed); }
+
+void reportJobs() {
+  static SchedulerJob job;
+  for (int id = 0; id < SCHEDULER_JOBS; id++) {
+    job = loopJobs.job(id);
+    if (!job.name || !job.runs) {
+      continue;
+    }
+    LOG_I("%-9s n=%lu late p50=%luus p99=%luus max=%luus, %lu overruns "
+          "(max %luus), %lu skipped",
+          job.name, (unsigned long)job.runs,
+          (unsigned long)job.lateness.percentile(0.5),
+          (unsigned long)job.lateness.percentile(0.99),
+          (unsigned long)job.lateness.max, (unsigned long)job.overruns,
+          (unsigned long)job.overrun.max, (unsigned long)job.skipped);
+  }
+}
+
+void jobsWriteMetrics(AsyncResponseStream *response) {
+  static const float quantiles[] = {0.5, 0.9, 0.99};
+  static SchedulerJob job;
+  response->print("# HELP lightsaber_job_lateness_seconds Job start after "
+                  "its release\n"
+                  "# TYPE lightsaber_job_lateness_seconds summary\n");
+  for (int id = 0; id < SCHEDULER_JOBS; id++) {
+    job = loopJobs.job(id);
+    if (!job.name) {
+      continue;
+    }
+    for (float q : quantiles) {
+      response->printf(
+          "lightsaber_job_lateness_seconds{job=\"%s\",quantile=\"%g\"} %.6f\n",
+          job.name, q, job.lateness.percentile(q) / 1e6);
+    }
+    response->printf("lightsaber_job_lateness_seconds_sum{job=\"%s\"} %.6f\n",
+                     job.name, job.lateness.sum / 1e6);
+    response->printf("lightsaber_job_lateness_seconds_count{job=\"%s\"} %lu\n",
+                     job.name, (unsigned long)job.lateness.count);
+  }
+  response->print("# HELP lightsaber_job_overrun_max_seconds Worst finish "
+                  "past the deadline\n"
+                  "# TYPE lightsaber_job_overrun_max_seconds gauge\n");
+  for (int id = 0; id < SCHEDULER_JOBS; id++) {
+    job = loopJobs.job(id);
+    if (job.name) {
+      response->printf(
+          "lightsaber_job_overrun_max_seconds{job=\"%s\"} %.6f\n", job.name,
+          job.overrun.max / 1e6);
+    }
+  }
+  response->print("# HELP lightsaber_job_overruns_total Runs that finished "
+                  "past the deadline\n"
+                  "# TYPE lightsaber_job_overruns_total counter\n");
+  for (int id = 0; id < SCHEDULER_JOBS; id++) {
+    job = loopJobs.job(id);
+    if (job.name) {
+      response->printf("lightsaber_job_overruns_total{job=\"%s\"} %lu\n",
+                       job.name, (unsigned long)job.overruns);
+    }
+  }
+  response->print("# HELP lightsaber_job_skipped_total Releases dropped "
+                  "after a stall\n"
+                  "# TYPE lightsaber_job_skipped_total counter\n");
+  for (int id = 0; id < SCHEDULER_JOBS; id++) {
+    job = loopJobs.job(id);
+    if (job.name) {
+      response->printf("lightsaber_job_skipped_total{job=\"%s\"} %lu\n",
+                       job.name, (unsigned long)job.skipped);
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+
+#include "scheduler.h"
+
+class AsyncResponseStream;
+
+// The periodic work of loop() as scheduler jobs on micros() (scheduler.h).
+// setup() registers them, loop() calls jobsRun(), which runs the released
+// jobs and then blocks until the next release instead of spinning, so a
+// stall shows up as lateness rather than a burst of catch-up runs, and an
+// idle loop task lets the chip sleep. Register and run from the loop task
+// only, interrupts wake a job with jobsWakeFromISR(); the reports copy the
+// job first and may be off by one sample.
+
+extern Scheduler loopJobs;
+
+void jobsRun();
+
+// Releases the job and unblocks jobsRun(), for the up to 32 first jobs
+void IRAM_ATTR jobsWakeFromISR(int id, BaseType_t *woken);
+
+// Lateness and overrun p50/p99/max per job to the log
+void reportJobs();
+
+// Clears the statistics on the next jobsRun()
+void jobsReset();
+
+// Prometheus text exposition of the job histograms
+void jobsWriteMetrics(AsyncResponseStream *response);
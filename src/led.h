@@ -1,29 +1,99 @@
 #pragma once
 #include <NeoPixelBusLg.h>
 
+#include <algorithm>
+
 #include "config.h"
 
 extern NeoPixelBusLg<NeoGrbFeature, NeoWs2812xMethod> strip;
 
+// Frames are drawn into backFrame and published with presentFrame(); the
+// render task picks up the latest published frame with pushFrame(). Drawing
+// and publishing happen under the frame lock, which is a no-op until the
+// render task creates the mutex.
+RgbColor frameBuffers[2][NUM_PIXELS];
+RgbColor *backFrame = frameBuffers[0];
+RgbColor *frontFrame = frameBuffers[1];
+bool frameReady = false;
+SemaphoreHandle_t frameMutex = NULL;
+
+void lockFrame() {
+  if (frameMutex) {
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+  }
+}
+
+void unlockFrame() {
+  if (frameMutex) {
+    xSemaphoreGive(frameMutex);
+  }
+}
+
 void setPixel(int pixel, uint8_t red, uint8_t green, uint8_t blue) {
-  strip.SetPixelColor(pixel, RgbColor(red, green, blue));
+  backFrame[pixel] = RgbColor(red, green, blue);
 }
 
-void setAll(uint8_t red, uint8_t green, uint8_t blue) {
+void fillFrame(const RgbColor &color) {
+  std::fill(backFrame, backFrame + NUM_PIXELS, color);
+}
+
+// Swaps the buffers and carries the new front over to the back, so callers
+// can keep drawing incrementally on top of what they just published. A frame
+// identical to the last published one is dropped here, so static modes don't
+// cost a Show() every frame.
+void presentFrame() {
+  if (memcmp(backFrame, frontFrame, sizeof(frameBuffers[0])) == 0) {
+    return;
+  }
+  std::swap(backFrame, frontFrame);
+  std::copy(frontFrame, frontFrame + NUM_PIXELS, backFrame);
+  frameReady = true;
+}
+
+// Sends the latest published frame to the strip, one Show() per frame.
+// Returns false if nothing new was published since the last push.
+bool pushFrame() {
+  lockFrame();
+  if (!frameReady) {
+    unlockFrame();
+    return false;
+  }
   for (int i = 0; i < NUM_PIXELS; i++) {
-    setPixel(i, red, green, blue);
+    strip.SetPixelColor(i, frontFrame[i]);
   }
+  frameReady = false;
+  unlockFrame();
   strip.Show();
+  return true;
+}
+
+// Sum of all channels of the published frame, for the battery load estimate
+uint32_t frameChannelSum() {
+  uint32_t sum = 0;
+  lockFrame();
+  for (int i = 0; i < NUM_PIXELS; i++) {
+    sum += frontFrame[i].R + frontFrame[i].G + frontFrame[i].B;
+  }
+  unlockFrame();
+  return sum;
+}
+
+void setAll(uint8_t red, uint8_t green, uint8_t blue) {
+  lockFrame();
+  fillFrame(RgbColor(red, green, blue));
+  presentFrame();
+  unlockFrame();
 }
 
 RgbColor paletteLookup(const RgbColor *p, uint8_t size, uint8_t idx) {
   return p[map(idx, 0, 255, 0, size - 1)];
 }
 
-RgbColor blend(RgbColor a, RgbColor b, float t) {
-  return RgbColor((uint8_t)(a.R + (b.R - a.R) * t),
-                  (uint8_t)(a.G + (b.G - a.G) * t),
-                  (uint8_t)(a.B + (b.B - a.B) * t));
+// t is a 0..256 weight of b
+RgbColor blend(RgbColor a, RgbColor b, uint16_t t) {
+  return RgbColor((a.R * (256 - t) + b.R * t) >> 8,
+                  (a.G * (256 - t) + b.G * t) >> 8,
+                  (a.B * (256 - t) + b.B * t) >> 8);
 }
 
 enum class ColorMode {
@@ -71,41 +141,69 @@ const RgbColor pastelC(255, 218, 185);
 uint8_t red = 255, green = 0, blue = 0;
 float k = 0.2;
 
-constexpr float MIN_BRIGHTNESS = 0.1f;
+// 10% of full scale, so faded modes never go completely dark
+constexpr uint8_t MIN_BRIGHTNESS = 26;
 const uint16_t BreathPeriod = 2000;
+// period of the old sin(millis() / 2000.0) blend wave, 2000 * 2 * PI
+constexpr uint32_t BLEND_PERIOD_MS = 12566;
+
+// one breathing cycle, 0.5 * (1 - cos(2 * PI * i / 256)) scaled to 0..255.
+// Offset the index by 64 to get (1 + sin(x)) / 2 instead.
+const uint8_t breathTable[256] = {
+    0, 0, 0, 0, 1, 1, 1, 2, 2, 3, 4, 5, 5, 6, 7, 9,
+    10, 11, 12, 14, 15, 17, 18, 20, 21, 23, 25, 27, 29, 31, 33, 35,
+    37, 40, 42, 44, 47, 49, 52, 54, 57, 59, 62, 65, 67, 70, 73, 76,
+    79, 82, 85, 88, 90, 93, 97, 100, 103, 106, 109, 112, 115, 118, 121, 124,
+    127, 131, 134, 137, 140, 143, 146, 149, 152, 155, 158, 162, 165, 167, 170, 173,
+    176, 179, 182, 185, 188, 190, 193, 196, 198, 201, 203, 206, 208, 211, 213, 215,
+    218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 238, 240, 241, 243, 244,
+    245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+    255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+    245, 244, 243, 241, 240, 238, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+    218, 215, 213, 211, 208, 206, 203, 201, 198, 196, 193, 190, 188, 185, 182, 179,
+    176, 173, 170, 167, 165, 162, 158, 155, 152, 149, 146, 143, 140, 137, 134, 131,
+    128, 124, 121, 118, 115, 112, 109, 106, 103, 100, 97, 93, 90, 88, 85, 82,
+    79, 76, 73, 70, 67, 65, 62, 59, 57, 54, 52, 49, 47, 44, 42, 40,
+    37, 35, 33, 31, 29, 27, 25, 23, 21, 20, 18, 17, 15, 14, 12, 11,
+    10, 9, 7, 6, 5, 5, 4, 3, 2, 2, 1, 1, 1, 0, 0, 0,
+};
 
-static RgbColor FadeColor(const RgbColor &baseColor, float brightness) {
-  HsbColor hsb = baseColor;
-  hsb.B = MIN_BRIGHTNESS + brightness * (1.0f - MIN_BRIGHTNESS);
-  return hsb;
+// Same result as setting the HSB brightness of baseColor, without the float
+// round trip: the brightest channel is scaled to the target level and the
+// others keep their ratio to it. brightness is 0..255.
+static RgbColor FadeColor(const RgbColor &baseColor, uint8_t brightness) {
+  uint8_t level =
+      MIN_BRIGHTNESS + (brightness * (255 - MIN_BRIGHTNESS) + 127) / 255;
+  uint8_t peak = baseColor.R > baseColor.G ? baseColor.R : baseColor.G;
+  peak = peak > baseColor.B ? peak : baseColor.B;
+  if (peak == 0) {
+    return RgbColor(level);
+  }
+  return RgbColor(baseColor.R * level / peak, baseColor.G * level / peak,
+                  baseColor.B * level / peak);
 }
 
 void UpdateBlink(uint32_t nowMillis, const RgbColor &blinkColor,
                  uint32_t periodMs = 1000) {
   uint32_t t = nowMillis % periodMs;
-  float half = periodMs * 0.5f;
-  float brightness = (t < half) ? (t / half) : ((periodMs - t) / half);
-  for (int i = 0; i < NUM_PIXELS; i++) {
-    auto fadeColor = FadeColor(blinkColor, brightness);
-    setPixel(i, fadeColor.R, fadeColor.G, fadeColor.B);
-  }
+  uint32_t half = periodMs / 2;
+  uint8_t brightness = (t < half) ? (t * 255 / half)
+                                  : ((periodMs - t) * 255 / (periodMs - half));
+  fillFrame(FadeColor(blinkColor, brightness));
 }
 
 void UpdateGlow(uint32_t nowMillis, const RgbColor &glowColor,
                 uint32_t periodMs = 1000) {
   uint32_t t = nowMillis % periodMs;
-  float phase = float(t) / float(periodMs);
-  float brightness = 0.5f * (1.0f + sinf(2.0f * PI * phase - PI / 2.0f));
-  for (int i = 0; i < NUM_PIXELS; i++) {
-    auto fadeColor = FadeColor(glowColor, brightness);
-    setPixel(i, fadeColor.R, fadeColor.G, fadeColor.B);
-  }
+  uint8_t brightness = breathTable[(t << 8) / periodMs];
+  fillFrame(FadeColor(glowColor, brightness));
 }
 
 void applyColorMode(ColorMode mode) {
+  lockFrame();
   switch (mode) {
   case ColorMode::SOLID:
-    setAll(red, green, blue);
+    fillFrame(RgbColor(red, green, blue));
     break;
   case ColorMode::BLINK: {
     auto now = millis();
@@ -144,12 +242,13 @@ void applyColorMode(ColorMode mode) {
     break;
   }
   case ColorMode::BLEND: {
-    float t = (sin(millis() / 2000.0) + 1) / 2;
-    RgbColor mid = blend(pastelA, pastelC, t);
+    uint32_t phase = (millis() % BLEND_PERIOD_MS) * 256 / BLEND_PERIOD_MS;
+    RgbColor mid = blend(pastelA, pastelC, breathTable[(phase + 64) & 0xFF]);
+    // first half fades A -> B, second half B -> mid; weights are i / (N / 2)
     for (int i = 0; i < NUM_PIXELS; i++) {
-      float fi = float(i) / NUM_PIXELS;
-      RgbColor c = (fi < 0.5) ? blend(pastelA, pastelB, fi * 2)
-                              : blend(pastelB, mid, (fi - 0.5) * 2);
+      uint32_t w = uint32_t(i) * 512 / NUM_PIXELS;
+      RgbColor c =
+          (w < 256) ? blend(pastelA, pastelB, w) : blend(pastelB, mid, w - 256);
       setPixel(i, c.R, c.G, c.B);
     }
     break;
@@ -175,12 +274,12 @@ void applyColorMode(ColorMode mode) {
       auto color = partyCols[(idx + i) % 3];
       setPixel(i, color.R, color.G, color.B);
     }
-    strip.Show();
     idx = (idx + 1) % 3;
     break;
   }
   }
-  strip.Show();
+  presentFrame();
+  unlockFrame();
 }
 
 void applyColor(Color color) {
@@ -205,4 +304,83 @@ void applyColor(Color color) {
     break;
   }
   setAll(red, green, blue);
-}
\ No newline at end of file
+}
+
+// Ignition/retraction, advanced from loop() one step at a time. The blade is
+// lit from both ends of the strip towards the middle.
+enum class BladeAnimation { NONE, IGNITE, RETRACT };
+enum class Easing { LINEAR, EASE_IN, EASE_OUT, EASE_IN_OUT };
+
+volatile BladeAnimation bladeAnimation = BladeAnimation::NONE;
+Easing animationEasing = Easing::LINEAR;
+uint32_t animationStart = 0, animationDuration = 0;
+int animationLit = -1;
+
+// p and the result are 0..256
+uint16_t ease(Easing easing, uint16_t p) {
+  switch (easing) {
+  case Easing::LINEAR:
+    break;
+  case Easing::EASE_IN:
+    return (p * p) >> 8;
+  case Easing::EASE_OUT:
+    return 256 - (((256 - p) * (256 - p)) >> 8);
+  case Easing::EASE_IN_OUT:
+    return (p < 128) ? ((2 * p * p) >> 8)
+                     : 256 - ((2 * (256 - p) * (256 - p)) >> 8);
+  }
+  return p;
+}
+
+void startBladeAnimation(BladeAnimation animation, uint32_t durationMs,
+                         Easing easing, uint32_t delayMs = 0) {
+  lockFrame();
+  bladeAnimation = animation;
+  animationEasing = easing;
+  animationStart = millis() + delayMs;
+  animationDuration = durationMs;
+  animationLit = -1;
+  if (animation == BladeAnimation::IGNITE) {
+    fillFrame(RgbColor(0, 0, 0));
+  } else if (animation == BladeAnimation::RETRACT) {
+    fillFrame(RgbColor(red, green, blue));
+  }
+  presentFrame();
+  unlockFrame();
+}
+
+// Returns true while an animation owns the strip
+bool updateBladeAnimation() {
+  lockFrame();
+  if (bladeAnimation == BladeAnimation::NONE) {
+    unlockFrame();
+    return false;
+  }
+  int32_t elapsed = millis() - animationStart;
+  if (elapsed < 0) {
+    unlockFrame();
+    return true;
+  }
+  uint16_t p = (animationDuration == 0 || uint32_t(elapsed) >= animationDuration)
+                   ? 256
+                   : uint32_t(elapsed) * 256 / animationDuration;
+  const int half = NUM_PIXELS / 2;
+  int lit = ease(animationEasing, p) * half / 256;
+  if (bladeAnimation == BladeAnimation::RETRACT) {
+    lit = half - lit;
+  }
+  if (lit != animationLit) {
+    for (int i = 0; i < half; i++) {
+      uint8_t on = i < lit;
+      setPixel(i, red * on, green * on, blue * on);
+      setPixel(NUM_PIXELS - 1 - i, red * on, green * on, blue * on);
+    }
+    presentFrame();
+    animationLit = lit;
+  }
+  if (p == 256) {
+    bladeAnimation = BladeAnimation::NONE;
+  }
+  unlockFrame();
+  return true;
+}
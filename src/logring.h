@@ -0,0 +1,250 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <type_traits>
+
+// Deferred-formatting log ring. Producers store the format pointer and the
+// raw argument values in a fixed-size record; strings are the only thing
+// copied. Formatting happens once, later, on the drain side. The ring is a
+// bounded lock-free MPMC queue (per-slot sequence numbers), producers never
+// block and drop the record when it is full. Plain C++ for the native tests.
+
+// macros rather than an enum so LOG_LEVEL works in #if
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+
+#define LOG_MAX_ARGS 8
+#define LOG_STRING_BYTES 96 // copied %s arguments per record
+
+struct LogArg {
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+  };
+  const char *str; // %s argument, copied on push
+};
+
+template <typename T> inline LogArg logArg(const T &value) {
+  LogArg arg = {};
+  if constexpr (std::is_array<T>::value) {
+    arg.str = value;
+  } else if constexpr (std::is_pointer<T>::value) {
+    using Pointee = std::remove_cv_t<std::remove_pointer_t<T>>;
+    if constexpr (std::is_same<Pointee, char>::value) {
+      arg.str = value ? value : "(null)";
+    } else {
+      arg.u = (uintptr_t)value;
+    }
+  } else if constexpr (std::is_floating_point<T>::value) {
+    arg.d = value;
+  } else if constexpr (std::is_enum<T>::value) {
+    arg.i = static_cast<int64_t>(value);
+  } else if constexpr (std::is_integral<T>::value &&
+                       std::is_signed<T>::value) {
+    arg.i = value;
+  } else if constexpr (std::is_integral<T>::value) {
+    arg.u = value;
+  } else {
+    arg.str = value.c_str(); // String, std::string
+  }
+  return arg;
+}
+
+struct LogRecord {
+  uint32_t millis;
+  const char *format; // must be a literal, it is read after the call returns
+  uint8_t level;
+  uint8_t argc;
+  uint8_t stringMask; // args whose value is an offset into strings
+  LogArg args[LOG_MAX_ARGS];
+  char strings[LOG_STRING_BYTES];
+};
+
+template <uint32_t Size> class LogRing {
+  static_assert((Size & (Size - 1)) == 0, "power of two");
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+  };
+
+  Slot slots[Size];
+  std::atomic<uint32_t> enqueuePos{0};
+  uint32_t dequeuePos = 0; // single consumer
+
+public:
+  std::atomic<uint32_t> dropped{0};
+
+  LogRing() {
+    for (uint32_t i = 0; i < Size; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bool push(uint8_t level, uint32_t millis, const char *format,
+            const LogArg *args, uint8_t argc) {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+      slot = &slots[pos & (Size - 1)];
+      uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(sequence - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    LogRecord &record = slot->record;
+    record.millis = millis;
+    record.format = format;
+    record.level = level;
+    record.argc = argc < LOG_MAX_ARGS ? argc : LOG_MAX_ARGS;
+    record.stringMask = 0;
+    record.strings[LOG_STRING_BYTES - 1] = '\0';
+    size_t used = 0;
+    for (uint8_t i = 0; i < record.argc; i++) {
+      record.args[i] = args[i];
+      if (!args[i].str) {
+        continue;
+      }
+      // truncated to what is left, the empty last byte once the area is full
+      size_t room = LOG_STRING_BYTES - used;
+      if (room == 0) {
+        record.args[i].u = LOG_STRING_BYTES - 1;
+      } else {
+        size_t len = strnlen(args[i].str, room - 1);
+        memcpy(record.strings + used, args[i].str, len);
+        record.strings[used + len] = '\0';
+        record.args[i].u = used;
+        used += len + 1;
+      }
+      record.stringMask |= 1 << i;
+    }
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side, the record stays valid until the next pop()
+  bool pop(LogRecord &out) {
+    Slot &slot = slots[dequeuePos & (Size - 1)];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - (dequeuePos + 1)) < 0) {
+      return false;
+    }
+    out = slot.record;
+    slot.sequence.store(dequeuePos + Size, std::memory_order_release);
+    dequeuePos++;
+    return true;
+  }
+};
+
+// printf over a record: the format is split at each conversion and every
+// argument is handed to snprintf with the type its conversion asks for.
+// Returns the length written, truncated to size - 1.
+inline size_t logFormat(const LogRecord &record, char *out, size_t size) {
+  size_t len = 0;
+  uint8_t next = 0;
+  auto append = [&](int n) {
+    if (n > 0) {
+      len += n;
+      if (len >= size) {
+        len = size - 1;
+      }
+    }
+  };
+  for (const char *p = record.format; *p && len + 1 < size;) {
+    if (*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[len++] = '%';
+      p += 2;
+      continue;
+    }
+    // %[flags][width][.precision][length]conversion
+    const char *start = p++;
+    while (*p && strchr("-+ #0", *p)) {
+      p++;
+    }
+    while (*p && strchr("0123456789.", *p)) {
+      p++;
+    }
+    char length[3] = {0};
+    while (*p && strchr("hlzjt", *p)) {
+      if (strlen(length) < 2) {
+        length[strlen(length)] = *p;
+      }
+      p++;
+    }
+    char conversion = *p;
+    if (!conversion) {
+      break;
+    }
+    p++;
+    char spec[24];
+    size_t specLen = p - start;
+    if (specLen >= sizeof(spec)) {
+      continue;
+    }
+    memcpy(spec, start, specLen);
+    spec[specLen] = '\0';
+    char *dst = out + len;
+    size_t room = size - len;
+    if (next >= record.argc) {
+      append(snprintf(dst, room, "%s", "<?>"));
+      continue;
+    }
+    const LogArg &arg = record.args[next];
+    bool isString = record.stringMask & (1 << next);
+    next++;
+    if (conversion == 's') {
+      append(snprintf(dst, room, spec,
+                      isString ? record.strings + arg.u : "<?>"));
+    } else if (strchr("fFeEgGaA", conversion)) {
+      append(snprintf(dst, room, spec, arg.d));
+    } else if (conversion == 'p') {
+      append(snprintf(dst, room, spec, (void *)(uintptr_t)arg.u));
+    } else if (conversion == 'c') {
+      append(snprintf(dst, room, spec, (int)arg.i));
+    } else if (strchr("di", conversion)) {
+      if (!strcmp(length, "ll") || !strcmp(length, "j")) {
+        append(snprintf(dst, room, spec, (long long)arg.i));
+      } else if (!strcmp(length, "l")) {
+        append(snprintf(dst, room, spec, (long)arg.i));
+      } else if (!strcmp(length, "z") || !strcmp(length, "t")) {
+        append(snprintf(dst, room, spec, (ptrdiff_t)arg.i));
+      } else {
+        append(snprintf(dst, room, spec, (int)arg.i));
+      }
+    } else if (strchr("uxXo", conversion)) {
+      if (!strcmp(length, "ll") || !strcmp(length, "j")) {
+        append(snprintf(dst, room, spec, (unsigned long long)arg.u));
+      } else if (!strcmp(length, "l")) {
+        append(snprintf(dst, room, spec, (unsigned long)arg.u));
+      } else if (!strcmp(length, "z") || !strcmp(length, "t")) {
+        append(snprintf(dst, room, spec, (size_t)arg.u));
+      } else {
+        append(snprintf(dst, room, spec, (unsigned)arg.u));
+      }
+    } else {
+      append(snprintf(dst, room, "%s", spec));
+    }
+  }
+  out[len] = '\0';
+  return len;
+}
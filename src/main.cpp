@@ -2,71 +2,61 @@
 #include <Arduino.h>
 #include <AsyncTCP.h>
 #include <Audio.h>
-#include <Button2.h>
 #include <ESPAsyncWebServer.h>
 #include <ElegantOTA.h>
 #include <FS.h>
 #include <NeoPixelBusLg.h>
 #include <NetWizard.h>
-#include <Preferences.h>
 #include <SD.h>
 #include <SPI.h>
 #include <WebSerial.h>
 #include <WiFiMulti.h>
 
+#include "assets.h"
 #include "audioqueue.h"
+#include "boot.h"
+#include "buttons.h"
 #include "config.h"
 #include "debug.h"
+#include "detect.h"
+#include "heaptrack.h"
+#include "jobs.h"
 #include "led.h"
+#include "motion.h"
+#include "ota.h"
+#include "power.h"
+#include "profiler.h"
+#include "recorder.h"
+#include "render.h"
+#include "saber.h"
+#include "sdcache.h"
+#include "settings.h"
+#include "sounds.h"
+#include "telemetry.h"
 #include "voltage.h"
 
-// timers
-uint32_t blink_timer = 0, mpuTimer = 0;
-
 void dumpHeap(const char *tag) {
   multi_heap_info_t info;
   heap_caps_get_info(&info, MALLOC_CAP_DEFAULT);
-  d_printf("[%s] total_free: %u, largest_free: %u, free_blocks: %u\n", tag,
-           info.total_free_bytes, info.largest_free_block, info.free_blocks);
+  LOG_D("[%s] total_free: %u, largest_free: %u, free_blocks: %u", tag,
+        info.total_free_bytes, info.largest_free_block, info.free_blocks);
 }
 
 // main objects
 NeoPixelBusLg<NeoGrbFeature, NeoWs2812xMethod> strip(NUM_PIXELS, LED_PIN);
 Adafruit_MPU6050 mpu;
 
-Button2 btn1;
-Button2 btn2;
-
 AsyncWebServer server(80);
 NetWizard NW(&server);
 
-Preferences preferences;
-
-// MPU calculated params
+// MPU calculated params, peaks over the samples since the last loop
 float ACC = 0, GYR = 0;
-const float STRIKE_LIGHT = 15.0;
-const float STRIKE_STRONG = 20.0;
-const float SWING_LIGHT = 2.0;
-const float SWING_STRONG = 2.5;
-
-// if updating, don't process much
-bool updating = false;
-
-// saved preferences
-uint32_t currentColorMode = 0;
-uint32_t currentColor = 0;
-uint32_t currentVolume = 10;
-uint32_t currentStation = 0;
-uint32_t currentSDFile = 0;
-bool internetRadioMode = false;
+MotionReader motionReader = {};
 
 void onOTAStart() {
   audioStopSong();
   updating = true;
-  for (int i = 0; i < NUM_PIXELS; i++) {
-    strip.SetPixelColor(i, RgbColor(0, 0, 255));
-  }
-  strip.Show();
+  setAll(0, 0, 255);
 }
 
 void onOTAEnd(bool success) {
@@ -75,527 +65,414 @@ void onOTAEnd(bool success) {
   }
 }
 
-String stations[] = {"http://mp3.ffh.de/radioffh/hqlivestream.mp3",
-                     "http://stream.srg-ssr.ch/m/rsp/mp3_128",
-                     "http://stream.radioparadise.com/mp3-128",
-                     "http://nr9.newradio.it:9371/stream",
-                     "http://media-ice.musicradio.com/ChillMP3"};
-
-constexpr auto STATION_COUNT = sizeof(stations) / sizeof(stations[0]);
-
-String SDFiles[] = {"/witcher.mp3", "/rammstein.mp3", "/imlerith.mp3"};
-
-constexpr auto SD_FILE_COUNT = sizeof(SDFiles) / sizeof(SDFiles[0]);
-
-// button states
-volatile bool volUpActive = false;
-volatile bool volDownActive = false;
-uint8_t pressed_counter = 0;
-uint32_t bothClickTime = 0;
-bool doubleClickCandidate = false;
-uint32_t lastComboActionTime = 0;
-
-void onVolUpStart(Button2 &btn) { volUpActive = true; }
-void onVolDownStart(Button2 &btn) { volDownActive = true; }
-
-void onButtonPressed(Button2 &btn) {
-  pressed_counter += 1;
-  d_println("Button pressed, counter: " + String(pressed_counter));
-  if (pressed_counter == 2) {
-    d_println("Both buttons pressed");
-    bothClickTime = millis();
-    doubleClickCandidate = true;
-  }
-}
-
-const uint32_t COMBO_SUPPRESS_MS = 500;
-const uint32_t SINGLE_COMBO_WINDOW = 1000;
-const uint32_t RADIO_LONGPRESS_MS = 2000;
-const uint32_t WIFI_RESET_MS = 5000;
-
 void announceIPAddress() {
-  audioStopSong();
-  audioConnecttospeech(
-      ("My IP address is " + WiFi.localIP().toString()).c_str(), "en");
-  while (audioIsPlaying()) {
-    delay(100);
-  }
+  char tokens[24];
+  IPAddress ip = WiFi.localIP();
+  snprintf(tokens, sizeof(tokens), "I%u.%u.%u.%u", ip[0], ip[1], ip[2],
+           ip[3]);
+  audioAnnounce(tokens);
 }
 
-// audio states when blade is on
-// vibe plays either SD or internet radio
-enum class AudioState { STATIC, VIBE, EFFECT };
-AudioState currentAudioState = AudioState::STATIC,
-           oldAudioState = AudioState::STATIC;
-uint32_t file_pos = 0;
-String effectType = "";
-enum class AudioMode { SWORD, INTERLEAVE, SOUNDS };
-int currentAudioMode = static_cast<int>(AudioMode::SWORD);
+// set once the reset announcement is queued, loop() resets after it
+bool wifiResetPending = false;
 
-constexpr auto AUDIOMODE_COUNT =
-    static_cast<std::underlying_type_t<Color>>(AudioMode::SOUNDS) + 1;
-
-void resumeCurrentSong() {
-  currentAudioState = AudioState::VIBE;
-  if (static_cast<AudioMode>(currentAudioMode) == AudioMode::SWORD) {
-    currentAudioMode = static_cast<int>(AudioMode::INTERLEAVE);
-  }
-  audioStopSong();
-  if (internetRadioMode) {
-    audioConnecttohost(stations[currentStation].c_str());
-  } else {
-    audioConnecttoSD(SDFiles[currentSDFile].c_str(), file_pos);
-  }
-}
-
-void toggleInternetRadio() {
-  internetRadioMode = !internetRadioMode;
-  preferences.putBool("internet_radio", internetRadioMode);
-  resumeCurrentSong();
+void resetWiFiBinding() {
+  audioAnnounce("W");
+  wifiResetPending = true;
 }
 
-void resetWiFiBinding() {
-  audioStopSong();
-  audioConnecttospeech("Resetting Wi-Fi binding", "en");
-  while (audioIsPlaying()) {
-    delay(100);
+void finishWiFiReset() {
+  if (audioPending() || audioIsPlaying()) {
+    return;
   }
+  settingsFlush();
   NW.reset();
   ESP.restart();
 }
 
-void switchAudioMode() {
-  currentAudioMode = (currentAudioMode + 1) % AUDIOMODE_COUNT;
-}
-
-void onButtonReleased(Button2 &btn) {
-  if (pressed_counter >= 1)
-    pressed_counter -= 1;
-  d_println("Button released, counter: " + String(pressed_counter));
-  if (pressed_counter == 0 && doubleClickCandidate) {
-    auto diff = millis() - bothClickTime;
-    d_println("Both buttons released, time: " + String(diff));
-    if (diff > WIFI_RESET_MS) {
-      resetWiFiBinding();
-    } else if (diff > RADIO_LONGPRESS_MS) {
-      toggleInternetRadio();
-    } else if (diff < RADIO_LONGPRESS_MS && diff > SINGLE_COMBO_WINDOW) {
-      switchAudioMode();
-    } else if (diff < SINGLE_COMBO_WINDOW) {
-      announceIPAddress();
-    }
-    lastComboActionTime = millis();
-    doubleClickCandidate = false;
-  }
-  if (btn == btn1) {
-    volUpActive = false;
-  }
-  if (btn == btn2) {
-    volDownActive = false;
-  }
-}
+// loop job ids, see startJobs()
+int motionJobId = -1;
+int buttonsJobId = -1;
+int audioJobId = -1;
+int batteryJobId = -1;
 
-void increaseVolumeStep() {
-  static uint32_t lastStep = 0;
-  if (millis() - lastStep > 100) {
-    lastStep = millis();
-    if (currentVolume == 21) {
-      return;
-    }
-    currentVolume = min(currentVolume + 1, 21ul);
-    audioSetVolume(currentVolume);
-    preferences.putUInt("volume", currentVolume);
-  }
+void reportSettingsStats() {
+  SettingsStats stats = settingsStats();
+  LOG_I("Settings: %u changes, %u NVS writes in %u commits, %u errors",
+        stats.changes, stats.writes, stats.commits, stats.errors);
 }
 
-void decreaseVolumeStep() {
-  static uint32_t lastStep = 0;
-  if (millis() - lastStep > 100) {
-    lastStep = millis();
-    if (currentVolume == 0) {
-      return;
-    }
-    currentVolume = max(currentVolume - 1, 0ul);
-    audioSetVolume(currentVolume);
-    preferences.putUInt("volume", currentVolume);
-  }
-}
-
-bool sword_on = false;
-
 void reportDebugInfo() {
   auto voltage = read_voltage();
-  d_printf("Battery voltage: %.2fV\n", voltage);
-  d_printf("Heap size: %u bytes\n",
-           heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
-  d_printf("Uptime: %lu seconds\n", millis() / 1000);
-  d_printf("Free heap: %lu bytes\n", ESP.getFreeHeap());
-  d_printf("CPU frequency: %lu MHz\n", ESP.getCpuFreqMHz());
-  audioStopSong();
-  audioConnecttospeech(
-      ("Battery voltage is " + String(voltage) + " volts").c_str(), "en");
-}
-
-void showBatteryPercentage() {
-  static uint32_t charge_timer = 0;
-  if (millis() - charge_timer > 1000) {
-    charge_timer = millis();
-    auto percentage = get_battery_percentage();
-    auto capacity = map(percentage, 100, 0, (NUM_PIXELS / 2 - 1), 1);
-    setAll(0, 0, 0);
-    for (char i = 0; i <= capacity; i++) {
-      setPixel(i, red, green, blue);
-      setPixel((NUM_PIXELS - 1 - i), red, green, blue);
-      strip.Show();
-      delay(25);
-      btn1.loop();
-      btn2.loop();
-    }
-    delay(100);
-  }
-}
-
-void light_up() {
-  setAll(0, 0, 0);
-  for (int i = 0; i <= (NUM_PIXELS / 2 - 1); i++) {
-    setPixel(i, red, green, blue);
-    setPixel((NUM_PIXELS - 1 - i), red, green, blue);
-    strip.Show();
-    delay(10);
+  LOG_I("Battery voltage: %.2fV", voltage);
+  LOG_I("Heap size: %u bytes", heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+  LOG_I("Uptime: %lu seconds", millis() / 1000);
+  LOG_I("Free heap: %lu bytes", ESP.getFreeHeap());
+  LOG_I("CPU frequency: %lu MHz", ESP.getCpuFreqMHz());
+  reportRenderStats();
+  reportSettingsStats();
+  char tokens[16];
+  snprintf(tokens, sizeof(tokens), "B%.2fV%u%%", voltage,
+           get_battery_percentage());
+  audioAnnounce(tokens);
+}
+
+void onSmoothSwing(uint32_t seq, uint32_t ret) { smoothSwingActive = ret; }
+
+// saber.h on the audio task, NVS and the loop jobs
+class FirmwarePlatform : public SaberPlatform {
+public:
+  void stopSong() override { audioStopSong(); }
+  void playFile(const char *path, uint32_t pos, bool loop) override {
+    audioConnecttoSD(path, pos, loop);
+  }
+  void playStation(const char *url) override { audioConnecttohost(url); }
+  bool hasEffect(const char *name) override {
+    return soundBankFind(soundBank, name) != nullptr;
+  }
+  void playEffect(const char *name, bool endsStream) override {
+    audioPlayEffect(name, MIXER_EFFECT_GAIN, endsStream);
+  }
+  void stopEffects() override { audioStopEffects(); }
+  void smoothSwing(bool on) override { audioSmoothSwing(on, onSmoothSwing); }
+  void setVolume(uint32_t volume) override { audioSetVolume(volume); }
+  bool audioPending() override { return ::audioPending(); }
+  bool audioPlaying() override { return audioIsPlaying(); }
+  bool audioLooping() override { return audioIsLooping(); }
+  bool networkReady() override { return ::networkReady(); }
+  void save(Setting key, uint32_t value) override { settingsSet(key, value); }
+  uint8_t batteryPercent() override { return get_battery_percentage(); }
+  void ignited() override {
+    motionSkip(motionReader);
+    loopJobs.wake(motionJobId);
+    bootMark(BootPhase::IGNITE);
+  }
+  void motionEvent(MotionEvent event, float value) override {
+    telemetryEvent(event, value);
+  }
+  void reportDebugInfo() override { ::reportDebugInfo(); }
+  void announceIP() override { announceIPAddress(); }
+  void resetWiFi() override { resetWiFiBinding(); }
+};
+
+FirmwarePlatform firmware;
+
+// Full clock and no light sleep unless the saber sits idle with the blade off
+void updatePower() {
+  bool wasIdle = powerIdle();
+  bool busy = sword_on || updating || audioIsPlaying() || audioPending() ||
+              bladeAnimation != BladeAnimation::NONE;
+  powerSetBusy(busy);
+  if (busy && wasIdle) {
+    // the render task waits up to POWER_IDLE_MS while idle
+    renderWake();
+  }
+  motionSetIdle(!sword_on);
+}
+
+// Gestures from buttons.h, the power state follows whatever they started
+void onButtonAction(const ButtonAction &action) {
+  saberButtonAction(action);
+  updatePower();
+}
+
+// Runs on the storage task after READY, see bootStorage(). Songs and the hum
+// play once the card is mounted, from SD until the hot assets are in flash.
+void mountStorage() {
+  if (!sdInit()) {
+    LOG_W("Card init failed");
+    return;
   }
-}
-
-void light_down() {
-  setAll(red, green, blue);
-  for (int i = (NUM_PIXELS / 2 - 1); i >= 0; i--) {
-    setPixel(i, 0, 0, 0);
-    setPixel((NUM_PIXELS - 1 - i), 0, 0, 0);
-    strip.Show();
-    delay(10);
+  if (!audioPrepareAnnouncements()) {
+    LOG_W("Announcement carrier write failed");
   }
-}
-
-void onB1Click(Button2 &btn) {
-  if (doubleClickCandidate ||
-      millis() - lastComboActionTime < COMBO_SUPPRESS_MS)
-    return;
-  file_pos = 0;
-  sword_on = !sword_on;
-  if (sword_on) {
-    audioStopSong();
-    audioConnecttoSD("/poweron.mp3");
-    delay(200);
-    light_up();
-    delay(200);
-  } else {
-    audioStopSong();
-    audioConnecttoSD("/poweroff.mp3");
-    delay(200);
-    light_down();
-    delay(200);
+  if (!assetsSync()) {
+    LOG_W("Asset sync failed, playing everything from SD");
   }
 }
 
-void onB1DoubleClick(Button2 &btn) {
-  currentColorMode = (currentColorMode + 1) % COLORMODE_COUNT;
-  preferences.putUInt("color_mode", currentColorMode);
-}
-
-void onB1TripleClick(Button2 &btn) { reportDebugInfo(); }
-
-void onB2Click(Button2 &btn) {
-  if (doubleClickCandidate ||
-      millis() - lastComboActionTime < COMBO_SUPPRESS_MS)
-    return;
-  currentColor = (currentColor + 1) % COLOR_COUNT;
-  preferences.putUInt("color", currentColor);
-  applyColor(static_cast<Color>(currentColor));
-}
-
-void onB2DoubleClick(Button2 &btn) {
-  currentSDFile = (currentSDFile + 1) % SD_FILE_COUNT;
-  internetRadioMode = false;
-  preferences.putUInt("sd_file", currentSDFile);
-  preferences.putBool("internet_radio", internetRadioMode);
-  file_pos = 0;
-  resumeCurrentSong();
-}
-
-void onB2TripleClick(Button2 &btn) {
-  currentStation = (currentStation + 1) % STATION_COUNT;
-  internetRadioMode = true;
-  preferences.putUInt("station", currentStation);
-  preferences.putBool("internet_radio", internetRadioMode);
-  resumeCurrentSong();
-}
-
-void setup() {
-  pinMode(SD_CS, OUTPUT);
-  pinMode(KNOCK_PIN, INPUT);
-  digitalWrite(SD_CS, HIGH);
-  SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
-  SPI.setFrequency(1000000);
-  dumpHeap("setup");
-  calibrate_voltage();
-  Serial.begin(115200);
-  esp_reset_reason_t reason = esp_reset_reason();
-  d_printf("Reset reason: %d\n", reason);
-  preferences.begin("lightsaber", false);
-  currentColorMode = preferences.getUInt("color_mode", 0);
-  currentColor = preferences.getUInt("color", 0);
-  currentVolume = preferences.getUInt("volume", 10);
-  currentStation = preferences.getUInt("station", 0);
-  currentSDFile = preferences.getUInt("sd_file", 0);
-  internetRadioMode = preferences.getBool("internet_radio", false);
-  if (!SD.begin(SD_CS)) {
-    Serial.println("Card init failed");
-  }
-  strip.Begin();
-  dumpHeap("strip.begin");
-  NW.setStrategy(NetWizardStrategy::BLOCKING);
-  NW.autoConnect("Lightsaber_AP", "");
-  dumpHeap("wifi init");
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
-  audioInit();
-  dumpHeap("audio init");
-  btn1.setPressedHandler(onButtonPressed);
-  btn1.setLongClickTime(1000);
-  btn1.setLongClickDetectedHandler(onVolUpStart);
-  btn1.setClickHandler(onB1Click);
-  btn1.setDoubleClickHandler(onB1DoubleClick);
-  btn1.setTripleClickHandler(onB1TripleClick);
-  btn1.setReleasedHandler(onButtonReleased);
-
-  btn2.setPressedHandler(onButtonPressed);
-  btn2.setLongClickTime(1000);
-  btn2.setLongClickDetectedHandler(onVolDownStart);
-  btn2.setClickHandler(onB2Click);
-  btn2.setDoubleClickHandler(onB2DoubleClick);
-  btn2.setTripleClickHandler(onB2TripleClick);
-  btn2.setReleasedHandler(onButtonReleased);
-  btn1.begin(BTN1_PIN);
-  btn2.begin(BTN2_PIN);
-  strip.SetLuminance(150);
-  applyColor(static_cast<Color>(currentColor));
-  dumpHeap("strip set");
+// Runs on the network task once Wi-Fi is up, see bootNetwork()
+void startWebServices() {
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
     request->send(200, "text/plain", "Hi! This is LightSaber by MrNaif.");
   });
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *request) {
+    AsyncResponseStream *response =
+        request->beginResponseStream("text/plain; version=0.0.4");
+    profileWriteMetrics(response);
+    jobsWriteMetrics(response);
+    heapWriteMetrics(response);
+    bootWriteMetrics(response);
+    request->send(response);
+  });
   ElegantOTA.begin(&server, "admin", "admin");
   ElegantOTA.onStart(onOTAStart);
   ElegantOTA.onEnd(onOTAEnd);
+  otaInit(server, onOTAStart, onOTAEnd);
   WebSerial.setAuthentication("admin", "admin");
   WebSerial.begin(&server);
-  dumpHeap("route config");
   WebSerial.onMessage([&](uint8_t *data, size_t len) {
-    Serial.printf("Received %u bytes from WebSerial: ", len);
-    Serial.write(data, len);
-    Serial.println();
-    WebSerial.println("Received Data...");
-    String d = "";
-    for (size_t i = 0; i < len; i++) {
-      d += char(data[i]);
+    char d[64];
+    len = min(len, sizeof(d) - 1);
+    memcpy(d, data, len);
+    d[len] = '\0';
+    LOG_D("Received %u bytes from WebSerial: %s", len, d);
+    if (strcmp(d, "render") == 0) {
+      reportRenderStats();
+    } else if (strcmp(d, "settings") == 0) {
+      reportSettingsStats();
+    } else if (strcmp(d, "profile") == 0) {
+      reportProfile();
+    } else if (strcmp(d, "profile reset") == 0) {
+      profileReset();
+    } else if (strcmp(d, "jobs") == 0) {
+      reportJobs();
+    } else if (strcmp(d, "jobs reset") == 0) {
+      jobsReset();
+    } else if (strcmp(d, "heap") == 0) {
+      reportHeap();
+    } else if (strcmp(d, "boot") == 0) {
+      reportBoot();
+    } else if (strncmp(d, "sdbench", 7) == 0 && (len == 7 || d[7] == ' ')) {
+      if (!sdBenchmark(len > 8 ? d + 8 : SDFiles[currentSDFile])) {
+        LOG_W("sdbench: not started, no card or one is still running");
+      }
+    } else if (strcmp(d, "trace start") == 0) {
+      if (recorderStart()) {
+        LOG_I("Trace started");
+      } else {
+        LOG_W("Trace start failed");
+      }
+    } else if (strcmp(d, "trace stop") == 0) {
+      recorderStop();
+    } else if (strcmp(d, "trace") == 0) {
+      RecorderStatus status = recorderStatus();
+      LOG_I("Trace %s: %s, %u samples, %u dropped", status.file,
+            status.recording ? "recording" : "stopped", status.samples,
+            status.dropped);
     }
-    WebSerial.println(d);
   });
-  if (mpu.begin()) {
-    d_println("MPU6050 initialized successfully");
-  } else {
-    d_println("MPU6050 initialization failed");
+  if (!telemetryInit(server)) {
+    LOG_E("Telemetry task start failed");
   }
-  mpu.setAccelerometerRange(MPU6050_RANGE_16_G);
-  mpu.setGyroRange(MPU6050_RANGE_1000_DEG);
   server.begin();
+  logAttachWebSerial();
+  dumpHeap("web services");
 }
 
 void get_freq() {
-  if (micros() - mpuTimer > 10000) {
-    sensors_event_t a, g, temp;
-    mpu.getEvent(&a, &g, &temp);
-    float ax = a.acceleration.x;
-    float ay = a.acceleration.y;
-    float az = a.acceleration.z;
-    float gx = g.gyro.x;
-    float gy = g.gyro.y;
-    float gz = g.gyro.z;
-
-    GYR = sqrt(gx * gx + gy * gy + gz * gz);
-    ACC = sqrt(ax * ax + ay * ay + az * az);
-
+  MotionSample samples[32];
+  size_t count = motionRead(motionReader, samples, 32);
+  // peaks, so a clash shorter than a loop iteration still registers
+  ACC = 0;
+  GYR = 0;
+  for (size_t i = 0; i < count; i++) {
+    ACC = max(ACC, accelMagnitude(samples[i]));
+    GYR = max(GYR, gyroMagnitude(samples[i]));
 #if GYRO_DEBUG
-    d_printf("GyroX: %f, GyroY: %f, GyroZ: %f, AccelX: %f, AccelY: %f, "
-             "AccelZ: %f\n",
-             gx, gy, gz, ax, ay, az);
-    d_printf("ACC: %f, GYR: %f\n", ACC, GYR);
+    LOG_D("GyroX: %d, GyroY: %d, GyroZ: %d, AccelX: %d, AccelY: %d, "
+          "AccelZ: %d",
+          samples[i].gyro[0], samples[i].gyro[1], samples[i].gyro[2],
+          samples[i].accel[0], samples[i].accel[1], samples[i].accel[2]);
 #endif
-    mpuTimer = micros();
   }
+#if GYRO_DEBUG
+  if (count > 0) {
+    LOG_D("ACC: %f, GYR: %f", ACC, GYR);
+  }
+#endif
 }
 
-void randomBlink() {
-  if (BLINK_ALLOW && (millis() - blink_timer > BLINK_DELAY)) {
-    blink_timer = millis();
-    applyColorMode(static_cast<ColorMode>(currentColorMode));
+// loop() work, run by loopJobs at the JOB_*_MS periods
+
+void serviceJob() {
+  uint32_t t = profileClock();
+  if (networkReady()) {
+    ElegantOTA.loop();
   }
+  otaLoop();
+  t = profileLap(ProfileStage::OTA, t);
+  if (networkReady()) {
+    WebSerial.loop();
+  }
+  profileLap(ProfileStage::WEBSERIAL, t);
+  if (wifiResetPending) {
+    finishWiFiReset();
+  }
+  updatePower();
 }
 
-void strike_flash() {
-  setAll(255, 255, 255);
-  delay(FLASH_DELAY);
-  setAll(red, blue, green);
+// motion, buttons and audio drop to JOB_IDLE_MS while nothing happens
+uint32_t jobPeriod(bool active, uint32_t ms) {
+  return (active ? ms : JOB_IDLE_MS) * 1000;
 }
 
-constexpr unsigned long STRIKE_COOLDOWN = 300;
-constexpr unsigned long SWING_COOLDOWN = 1000;
+void audioJob() {
+  uint32_t t = profileClock();
+  audioLoop();
+  bool active = sword_on || audioIsPlaying() || audioPending();
+  loopJobs.setPeriod(audioJobId, jobPeriod(active, JOB_AUDIO_MS));
+  profileLap(ProfileStage::AUDIO, t);
+}
 
-const unsigned long strikeDurations[12] = {1128, 744,  1056, 792,  1200, 1128,
-                                           1128, 1008, 648,  1128, 984,  984};
+// while updating, only the OTA, audio and settings jobs do anything; the
+// buttons still drain their queue, onButtonAction() drops the actions
+void buttonsJob() {
+  uint32_t t = profileClock();
+  loopJobs.setPeriod(buttonsJobId, jobPeriod(buttonsPoll(), JOB_BUTTONS_MS));
+  profileLap(ProfileStage::BUTTONS, t);
+}
 
-const unsigned long swingDurations[12] = {576, 576, 576, 576, 576, 576,
-                                          504, 504, 672, 600, 552, 672};
+void volumeJob() { volumeStep(); }
 
-unsigned long lastStrikeTime = 0;
-unsigned long lastSwingTime = 0;
-unsigned long effectStart = 0;
-unsigned long effectLength = 0;
+void settingsJob() {
+  uint32_t t = profileClock();
+  if (updating) {
+    // OTA ends in a restart, don't lose pending settings
+    settingsFlush();
+  } else {
+    settingsLoop();
+  }
+  profileLap(ProfileStage::SETTINGS, t);
+}
 
-void playEffect(const char *type, int count, unsigned long duration) {
-  if (static_cast<AudioMode>(currentAudioMode) == AudioMode::SOUNDS) {
+void batteryJob() {
+  // the whole bar once per POWER_IDLE_MS while idle
+  batteryBarQuiet = powerIdle();
+  loopJobs.setPeriod(batteryJobId,
+                     (batteryBarQuiet ? POWER_IDLE_MS : JOB_BATTERY_MS) * 1000);
+  if (!batteryBarAllowed()) {
     return;
   }
-  auto temp_pos = audioStopSong();
-  if (currentAudioState != AudioState::EFFECT) {
-    file_pos = temp_pos;
-  }
-  char fn[32];
-  snprintf(fn, sizeof(fn), "/%s%d.mp3", type, count + 1);
-  audioConnecttoSD(fn);
-  effectStart = millis();
-  effectLength = duration;
-  effectType = type;
-  if (currentAudioState != AudioState::EFFECT) {
-    oldAudioState = currentAudioState;
-    currentAudioState = AudioState::EFFECT;
+  uint32_t t = profileClock();
+  showBatteryPercentage();
+  if (batteryBarQuiet) {
+    renderWake();
   }
+  profileLap(ProfileStage::BATTERY, t);
 }
 
-bool tryTrigger(float value, float lightTh, float strongTh,
-                unsigned long &lastTime, unsigned long cooldown,
-                const char *type, int countMax,
-                const unsigned long *durations) {
-  unsigned long now = millis();
-  if (now - lastTime < cooldown)
-    return false;
-  if (value < lightTh)
-    return false;
-  int idx = random(countMax);
-  unsigned long dur = (value > strongTh) ? durations[idx] : durations[idx];
-  playEffect(type, idx, dur);
-  if (strcmp(type, "clash") == 0) {
-    strike_flash();
+void motionJob() {
+  loopJobs.setPeriod(motionJobId, jobPeriod(sword_on, JOB_MOTION_MS));
+  if (updating || !sword_on) {
+    return;
   }
-  lastTime = now;
-  return true;
+  uint32_t t = profileClock();
+  get_freq();
+  t = profileLap(ProfileStage::MOTION, t);
+  triggerEffects(ACC, GYR);
+  t = profileLap(ProfileStage::TRIGGER, t);
+  updateStatic();
+  profileLap(ProfileStage::STATIC, t);
 }
 
-void updateStatic() {
-  if (currentAudioState == AudioState::VIBE &&
-      static_cast<AudioMode>(currentAudioMode) == AudioMode::SWORD) {
-    audioStopSong();
-    currentAudioState = AudioState::STATIC;
-  }
-  if (currentAudioState == AudioState::STATIC) {
-    if (!audioIsPlaying()) {
-      audioConnecttoSD("/hum.mp3");
-    }
-  } else if (currentAudioState == AudioState::EFFECT) {
-    if (!audioIsPlaying() || millis() - effectStart >= effectLength) {
-      audioStopSong();
-      currentAudioState = oldAudioState;
-      if (currentAudioState == AudioState::VIBE) {
-        resumeCurrentSong();
-      }
-    }
-  } else if (currentAudioState == AudioState::VIBE && !audioIsPlaying()) {
-    resumeCurrentSong();
-  }
+void startJobs() {
+  // priority only orders jobs with the same deadline
+  motionJobId = loopJobs.every("motion", motionJob, JOB_MOTION_MS * 1000, 3);
+  buttonsJobId =
+      loopJobs.every("buttons", buttonsJob, JOB_BUTTONS_MS * 1000, 2);
+  audioJobId = loopJobs.every("audio", audioJob, JOB_AUDIO_MS * 1000, 2);
+  loopJobs.every("service", serviceJob, JOB_SERVICE_MS * 1000, 1);
+  batteryJobId =
+      loopJobs.every("battery", batteryJob, JOB_BATTERY_MS * 1000, 1);
+  loopJobs.every("volume", volumeJob, JOB_VOLUME_MS * 1000, 0);
+  loopJobs.every("settings", settingsJob, JOB_SETTINGS_MS * 1000, 0);
 }
 
-void loop() {
-  static unsigned long last_print_time = millis();
-  ElegantOTA.loop();
-  if ((unsigned long)(millis() - last_print_time) > 2000) {
-    dumpHeap("loop");
-    d_printf("Free: %lu, MinFree: %lu\n", ESP.getFreeHeap(),
-             ESP.getMinFreeHeap());
-    last_print_time = millis();
+void setup() {
+  pinMode(SD_CS, OUTPUT);
+  pinMode(KNOCK_PIN, INPUT);
+  digitalWrite(SD_CS, HIGH);
+  SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI);
+  dumpHeap("setup");
+  Serial.begin(115200);
+  logInit();
+  esp_reset_reason_t reason = esp_reset_reason();
+  LOG_I("Reset reason: %d", reason);
+  if (!settingsBegin()) {
+    LOG_E("Settings storage unavailable, using defaults");
+  }
+  currentColorMode = settingsGet(Setting::COLOR_MODE);
+  currentColor = settingsGet(Setting::COLOR);
+  currentVolume = settingsGet(Setting::VOLUME);
+  currentStation = settingsGet(Setting::STATION);
+  currentSDFile = settingsGet(Setting::SD_FILE);
+  internetRadioMode = settingsGet(Setting::INTERNET_RADIO);
+  saberBegin(firmware);
+  bootMark(BootPhase::SETTINGS);
+  strip.Begin();
+  // frameMutex first, the battery task reads the published frame
+  renderInit();
+  calibrate_voltage();
+  batteryInit();
+  strip.SetLuminance(150);
+  applyColor(static_cast<Color>(currentColor));
+  bootMark(BootPhase::BLADE);
+  dumpHeap("strip set");
+  startJobs();
+  if (!buttonsInit(onButtonAction, buttonsJobId)) {
+    LOG_E("Button queue creation failed");
   }
-  WebSerial.loop();
-  if (updating) {
-    return;
+  bootMark(BootPhase::CONTROLS);
+  if (mpu.begin()) {
+    LOG_I("MPU6050 initialized successfully");
+  } else {
+    LOG_E("MPU6050 initialization failed");
   }
-  btn1.loop();
-  btn2.loop();
-  if (volUpActive) {
-    increaseVolumeStep();
+  mpu.setAccelerometerRange(MPU6050_RANGE_16_G);
+  mpu.setGyroRange(MPU6050_RANGE_1000_DEG);
+  if (!motionInit()) {
+    LOG_E("Motion task start failed");
   }
-  if (volDownActive) {
-    decreaseVolumeStep();
+  if (!recorderInit()) {
+    LOG_E("Recorder task start failed");
   }
-  if (!sword_on) {
-    showBatteryPercentage();
-    return;
+  bootMark(BootPhase::MOTION);
+  audioInit();
+  bootMark(BootPhase::AUDIO);
+  dumpHeap("audio init");
+  if (!bootNetwork(NW, startWebServices)) {
+    LOG_E("Network task start failed");
   }
-  get_freq();
-  randomBlink();
-  bool canTrigger =
-      currentAudioState != AudioState::EFFECT ||
-      (currentAudioState == AudioState::EFFECT && effectType == "swing");
-  if (canTrigger &&
-      !tryTrigger(ACC, STRIKE_LIGHT, STRIKE_STRONG, lastStrikeTime,
-                  STRIKE_COOLDOWN, "clash", 12, strikeDurations)) {
-    tryTrigger(GYR, SWING_LIGHT, SWING_STRONG, lastSwingTime, SWING_COOLDOWN,
-               "swing", 12, swingDurations);
+  if (!powerInit()) {
+    LOG_W("Power management unavailable, staying at full clock");
   }
-  updateStatic();
+  bootMark(BootPhase::READY);
+  if (!bootStorage(mountStorage)) {
+    LOG_E("Storage task start failed");
+  }
+}
+
+void loop() {
+  heapLoop();
+  profileLoopStart();
+  jobsRun();
 }
 
 void audio_info(const char *info) {
-  d_print("info        ");
-  d_println(info);
+  LOG_I("info        %s", info);
 }
 void audio_id3data(const char *info) {
-  d_print("id3data     ");
-  d_println(info);
+  LOG_I("id3data     %s", info);
 }
 void audio_eof_mp3(const char *info) {
-  d_print("eof_mp3     ");
-  d_println(info);
+  LOG_I("eof_mp3     %s", info);
 }
 void audio_showstation(const char *info) {
-  d_print("station     ");
-  d_println(info);
+  LOG_I("station     %s", info);
 }
 void audio_showstreamtitle(const char *info) {
-  d_print("streamtitle ");
-  d_println(info);
+  LOG_I("streamtitle %s", info);
 }
 void audio_bitrate(const char *info) {
-  d_print("bitrate     ");
-  d_println(info);
+  LOG_I("bitrate     %s", info);
 }
 void audio_commercial(const char *info) {
-  d_print("commercial  ");
-  d_println(info);
+  LOG_I("commercial  %s", info);
 }
 void audio_icyurl(const char *info) {
-  d_print("icyurl      ");
-  d_println(info);
+  LOG_I("icyurl      %s", info);
 }
 void audio_lasthost(const char *info) {
-  d_print("lasthost    ");
-  d_println(info);
+  LOG_I("lasthost    %s", info);
 }
@@ -0,0 +1,238 @@
+#include "mixer.h"
+
+#include <esp_partition.h>
+
+#include "announce.h"
+#include "motion.h"
+
+#define SWING_READ_BATCH 16
+
+MixerVoice voices[MIXER_VOICES];
+const uint8_t *soundBank = NULL;
+static uint32_t bankRate = 0;
+static bool streamEnded = false;
+static SmoothSwing smoothSwing = {};
+static MotionReader swingReader = {};
+static uint32_t swingGyro = 0; // latest peak, kept across sample-less blocks
+static char announcement[ANNOUNCE_MAX_TOKENS + 1] = "";
+static uint8_t announcePos = 0;
+
+bool mixerInit() {
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, "spiffs");
+  if (!partition) {
+    return false;
+  }
+  const void *mapped = NULL;
+  esp_partition_mmap_handle_t handle;
+  if (esp_partition_mmap(partition, 0, partition->size,
+                         ESP_PARTITION_MMAP_DATA, &mapped,
+                         &handle) != ESP_OK) {
+    return false;
+  }
+  auto header = soundBankHeader((const uint8_t *)mapped);
+  if (!header) {
+    esp_partition_munmap(handle);
+    return false;
+  }
+  soundBank = (const uint8_t *)mapped;
+  bankRate = header->sampleRate;
+  smoothSwing.begin(soundBank, SMOOTHSWING_LOW, SMOOTHSWING_HIGH);
+  return true;
+}
+
+static void finish(MixerVoice &voice) {
+  voice.active = false;
+  if (voice.endsStream) {
+    streamEnded = true;
+  }
+}
+
+static void startVoice(MixerVoice *voice, const SoundBankEntry *entry,
+                       uint16_t gain, bool endsStream) {
+  voice->decoder.begin(soundBank, *entry);
+  voice->prev = 0;
+  voice->next = voice->decoder.next();
+  voice->phase = 0;
+  voice->gain = gain;
+  voice->endsStream = endsStream;
+  voice->started = millis();
+  voice->announce = false;
+  voice->active = true;
+}
+
+bool mixerPlay(const char *name, uint16_t gain, bool endsStream) {
+  auto entry = soundBankFind(soundBank, name);
+  if (!entry) {
+    return false;
+  }
+  // take a free voice, or steal the oldest one, announcements last
+  MixerVoice *voice = nullptr;
+  for (auto &v : voices) {
+    if (!v.active) {
+      voice = &v;
+      break;
+    }
+    if (!v.announce && (!voice || v.started < voice->started)) {
+      voice = &v;
+    }
+  }
+  if (!voice) {
+    voice = &voices[0];
+  }
+  if (voice->active) {
+    finish(*voice);
+  }
+  startVoice(voice, entry, gain, endsStream);
+  return true;
+}
+
+// next token of the announcement that has a clip in the bank
+static const SoundBankEntry *nextAnnounceClip() {
+  while (announcement[announcePos]) {
+    const char *name = announceClip(announcement[announcePos++]);
+    auto entry = name ? soundBankFind(soundBank, name) : nullptr;
+    if (entry) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+bool mixerAnnounce(const char *tokens, uint16_t gain) {
+  strlcpy(announcement, tokens, sizeof(announcement));
+  announcePos = 0;
+  auto entry = nextAnnounceClip();
+  if (!entry) {
+    return false;
+  }
+  // a new announcement replaces the one playing
+  MixerVoice *voice = &voices[0];
+  for (auto &v : voices) {
+    if (v.active && v.announce) {
+      voice = &v;
+      break;
+    }
+    if (!v.active || (voice->active && v.started < voice->started)) {
+      voice = &v;
+    }
+  }
+  if (voice->active) {
+    finish(*voice);
+  }
+  startVoice(voice, entry, gain, true);
+  voice->announce = true;
+  return true;
+}
+
+bool mixerCanAnnounce(const char *tokens) {
+  bool any = false;
+  for (; *tokens; tokens++) {
+    const char *name = announceClip(*tokens);
+    if (name && !soundBankFind(soundBank, name)) {
+      return false;
+    }
+    any |= name != nullptr;
+  }
+  return any;
+}
+
+void mixerStopAll() {
+  for (auto &voice : voices) {
+    voice.active = false;
+  }
+}
+
+uint8_t mixerActiveVoices() {
+  uint8_t count = 0;
+  for (auto &voice : voices) {
+    count += voice.active;
+  }
+  return count;
+}
+
+bool mixerSmoothSwing(bool on) {
+  if (!on) {
+    smoothSwing.stop();
+    return false;
+  }
+  if (!smoothSwing.running) {
+    motionSkip(swingReader);
+    swingGyro = 0;
+  }
+  return smoothSwing.start();
+}
+
+static void mixSmoothSwing(int16_t *samples, uint16_t frames,
+                           uint8_t channels, uint32_t streamRate,
+                           bool duckStream) {
+  MotionSample batch[SWING_READ_BATCH];
+  size_t count;
+  bool fresh = false;
+  uint32_t peak = 0;
+  while ((count = motionRead(swingReader, batch, SWING_READ_BATCH)) > 0) {
+    peak = max(peak, gyroPeakLsb(batch, count));
+    fresh = true;
+  }
+  if (fresh) {
+    swingGyro = peak;
+  }
+  smoothSwing.update(swingGyro, frames, streamRate);
+  smoothSwing.mix(samples, frames, channels, streamRate, duckStream);
+}
+
+bool mixerStreamEnded() {
+  bool ended = streamEnded;
+  streamEnded = false;
+  return ended;
+}
+
+void mixerMix(int16_t *samples, uint16_t frames, uint8_t channels,
+              uint32_t streamRate, uint16_t streamGain, bool duckStream) {
+  if (smoothSwing.running) {
+    mixSmoothSwing(samples, frames, channels, streamRate, duckStream);
+  }
+  for (auto &voice : voices) {
+    if (voice.active && voice.endsStream) {
+      streamGain = 0;
+    }
+  }
+  if (streamGain != 256) {
+    for (uint32_t i = 0; i < (uint32_t)frames * channels; i++) {
+      samples[i] = (samples[i] * streamGain) >> 8;
+    }
+  }
+  // linear interpolation from the bank rate, Q16 step per output frame
+  uint32_t step = streamRate ? (bankRate << 16) / streamRate : 1 << 16;
+  for (auto &voice : voices) {
+    if (!voice.active) {
+      continue;
+    }
+    int16_t *out = samples;
+    for (uint16_t f = 0; f < frames; f++) {
+      int32_t delta = voice.next - voice.prev;
+      int32_t sample = voice.prev + ((delta * (int32_t)voice.phase) >> 16);
+      sample = (sample * voice.gain) >> 8;
+      for (uint8_t c = 0; c < channels; c++) {
+        int32_t mixed = out[c] + sample;
+        out[c] = constrain(mixed, INT16_MIN, INT16_MAX);
+      }
+      out += channels;
+      voice.phase += step;
+      while (voice.phase >= 1 << 16) {
+        voice.phase -= 1 << 16;
+        voice.prev = voice.next;
+        voice.next = voice.decoder.next();
+      }
+      if (voice.decoder.remaining == 0) {
+        auto entry = voice.announce ? nextAnnounceClip() : nullptr;
+        if (entry) {
+          voice.decoder.begin(soundBank, *entry);
+          continue;
+        }
+        finish(voice);
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+
+#include "config.h"
+#include "smoothswing.h"
+#include "soundbank.h"
+
+// PCM mixer running inside the audio task. The decoder stream (hum or music)
+// passes through audio_process_i2s(), and up to MIXER_VOICES effect voices
+// are summed on top of it with per-voice gain and saturation.
+// Effect voices play clips from the sound bank memory-mapped from flash.
+// SmoothSwing (smoothswing.h) mixes its two loops under the effect voices.
+
+struct MixerVoice {
+  bool active;
+  bool endsStream; // mute the stream and stop it when this voice is done
+  bool announce;   // chains the announcement's clips back to back
+  uint16_t gain;
+  uint32_t started;
+  AdpcmDecoder decoder;
+  int16_t prev, next; // samples around the current position
+  uint32_t phase;     // Q16 position between prev and next
+};
+
+extern const uint8_t *soundBank;
+
+// All functions must be called from the audio task.
+
+// Maps the sound bank partition, returns false if it isn't flashed
+bool mixerInit();
+
+bool mixerPlay(const char *name, uint16_t gain, bool endsStream = false);
+
+void mixerStopAll();
+
+// Speaks an announcement: every token is one sound bank clip, played back to
+// back on one voice that mutes and then ends the stream (see announceClip()).
+// Returns false if none of the clips are in the bank. A voice it takes over
+// is finished like in mixerPlay(), so mixerStreamEnded() may be set after.
+bool mixerAnnounce(const char *tokens, uint16_t gain);
+
+// true if the bank has a clip for every token of the announcement
+bool mixerCanAnnounce(const char *tokens);
+
+uint8_t mixerActiveVoices();
+
+// true once after a voice started with endsStream has finished
+bool mixerStreamEnded();
+
+// Fades the SmoothSwing loops in, or out when off. Returns false if the bank
+// has no SMOOTHSWING_LOW/SMOOTHSWING_HIGH pair or when turning off.
+bool mixerSmoothSwing(bool on);
+
+// Adds active voices onto an interleaved 16-bit stream buffer in place.
+// duckStream lets SmoothSwing pull the stream down under swings, for the hum.
+void mixerMix(int16_t *samples, uint16_t frames, uint8_t channels,
+              uint32_t streamRate, uint16_t streamGain, bool duckStream);
@@ -0,0 +1,207 @@
+#include "motion.h"
+
+#include <Adafruit_MPU6050.h>
+#include <Wire.h>
+#include <driver/gpio.h>
+#include <soc/gpio_struct.h>
+
+// registers not covered by Adafruit_MPU6050
+#define MPU_REG_FIFO_EN 0x23
+#define MPU_REG_INT_PIN_CFG 0x37
+#define MPU_REG_INT_ENABLE 0x38
+#define MPU_REG_INT_STATUS 0x3A
+#define MPU_REG_USER_CTRL 0x6A
+#define MPU_REG_FIFO_COUNTH 0x72
+#define MPU_REG_FIFO_R_W 0x74
+
+#define MPU_FIFO_ACCEL_GYRO 0x78 // XG, YG, ZG and ACCEL
+#define MPU_USER_FIFO_EN 0x40
+#define MPU_USER_FIFO_RESET 0x04
+#define MPU_INT_DATA_RDY 0x01
+#define MPU_INT_FIFO_OFLOW 0x10
+#define MPU_INT_MOTION 0x40
+#define MPU_INT_LATCH 0x20 // INT_PIN_CFG: high until INT_STATUS is read
+#define MPU_FIFO_SAMPLE_BYTES 12
+#define MPU_BURST_SAMPLES 8 // keeps each read inside the Wire buffer
+
+extern Adafruit_MPU6050 mpu;
+
+MotionSample motionRing[MOTION_RING_SIZE];
+std::atomic<uint32_t> motionHead{0};
+static TaskHandle_t motionTaskHandle = NULL;
+static std::atomic<bool> idleWanted{false};
+static bool idle = false;
+static uint32_t periodUs = 1000000 / MOTION_RATE_HZ;
+
+static void writeRegister(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(MPU6050_I2CADDR_DEFAULT);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+}
+
+static bool readRegisters(uint8_t reg, uint8_t *buf, size_t len) {
+  Wire.beginTransmission(MPU6050_I2CADDR_DEFAULT);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) {
+    return false;
+  }
+  if (Wire.requestFrom((uint8_t)MPU6050_I2CADDR_DEFAULT, (uint8_t)len) !=
+      len) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = Wire.read();
+  }
+  return true;
+}
+
+static void resetFifo() {
+  writeRegister(MPU_REG_USER_CTRL, MPU_USER_FIFO_RESET);
+  writeRegister(MPU_REG_USER_CTRL, MPU_USER_FIFO_EN);
+}
+
+// A level interrupt on the latched pin, which light sleep can wake on. Off
+// until the task has read INT_STATUS.
+static void IRAM_ATTR onInterrupt() {
+  GPIO.pin[KNOCK_PIN].int_type = GPIO_INTR_DISABLE;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(motionTaskHandle, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+static void drainFifo() {
+  uint8_t status;
+  uint8_t count[2];
+  if (!readRegisters(MPU_REG_INT_STATUS, &status, 1)) {
+    return;
+  }
+  if (status & MPU_INT_FIFO_OFLOW) {
+    resetFifo();
+    return;
+  }
+  if (!readRegisters(MPU_REG_FIFO_COUNTH, count, 2)) {
+    return;
+  }
+  uint16_t available = ((count[0] << 8) | count[1]) / MPU_FIFO_SAMPLE_BYTES;
+  // the newest sample was taken about now, older ones one period apart
+  uint32_t now = micros();
+  const uint32_t period = periodUs;
+  while (available > 0) {
+    uint8_t burst = min(available, (uint16_t)MPU_BURST_SAMPLES);
+    uint8_t buf[MPU_BURST_SAMPLES * MPU_FIFO_SAMPLE_BYTES];
+    if (!readRegisters(MPU_REG_FIFO_R_W, buf,
+                       burst * MPU_FIFO_SAMPLE_BYTES)) {
+      resetFifo();
+      return;
+    }
+    available -= burst;
+    for (uint8_t i = 0; i < burst; i++) {
+      const uint8_t *p = &buf[i * MPU_FIFO_SAMPLE_BYTES];
+      uint32_t head = motionHead.load(std::memory_order_relaxed);
+      MotionSample &sample = motionRing[head % MOTION_RING_SIZE];
+      sample.micros = now - (available + burst - 1 - i) * period;
+      for (int axis = 0; axis < 3; axis++) {
+        sample.accel[axis] = (p[axis * 2] << 8) | p[axis * 2 + 1];
+        sample.gyro[axis] = (p[6 + axis * 2] << 8) | p[6 + axis * 2 + 1];
+      }
+      motionHead.store(head + 1, std::memory_order_release);
+    }
+  }
+}
+
+// Idle: MOTION_IDLE_RATE_HZ, and only motion interrupts the CPU
+static void applyIdle() {
+  bool want = idleWanted.load(std::memory_order_relaxed);
+  if (want == idle) {
+    return;
+  }
+  // samples taken at the old rate keep their timestamps
+  drainFifo();
+  idle = want;
+  uint32_t rate = idle ? MOTION_IDLE_RATE_HZ : MOTION_RATE_HZ;
+  mpu.setSampleRateDivisor(1000 / rate - 1);
+  periodUs = 1000000 / rate;
+  writeRegister(MPU_REG_INT_ENABLE,
+                (idle ? MPU_INT_MOTION : MPU_INT_DATA_RDY) |
+                    MPU_INT_FIFO_OFLOW);
+}
+
+static void motionTask(void *parameter) {
+  while (true) {
+    // the timeout, five periods, keeps sampling alive without interrupts
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(periodUs * 5 / 1000));
+    applyIdle();
+    drainFifo();
+    // interrupts again right away if the pin latched in the meantime
+    gpio_wakeup_enable((gpio_num_t)KNOCK_PIN, GPIO_INTR_HIGH_LEVEL);
+  }
+}
+
+bool motionInit() {
+  Wire.setClock(400000);
+  // 1 kHz gyro output with the DLPF on, divided down to MOTION_RATE_HZ
+  mpu.setFilterBandwidth(MPU6050_BAND_184_HZ);
+  mpu.setSampleRateDivisor(1000 / MOTION_RATE_HZ - 1);
+  writeRegister(MPU_REG_FIFO_EN, MPU_FIFO_ACCEL_GYRO);
+  resetFifo();
+  writeRegister(MPU_REG_INT_PIN_CFG, MPU_INT_LATCH); // active high
+  writeRegister(MPU_REG_INT_ENABLE, MPU_INT_DATA_RDY | MPU_INT_FIFO_OFLOW);
+  // the motion interrupt looks at the high passed acceleration only
+  mpu.setHighPassFilter(MPU6050_HIGHPASS_0_63_HZ);
+  mpu.setMotionDetectionThreshold(MOTION_WAKE_THRESHOLD);
+  mpu.setMotionDetectionDuration(1);
+
+  if (xTaskCreatePinnedToCore(motionTask,      /* Function to implement the
+                                                  task */
+                              "motion",        /* Name of the task */
+                              3072,            /* Stack size in words */
+                              NULL,            /* Task input parameter */
+                              MOTIONTASK_PRIO, /* Priority of the task */
+                              &motionTaskHandle, /* Task handle. */
+                              MOTIONTASK_CORE /* Core where the task should
+                                                 run */
+                              ) != pdPASS) {
+    return false;
+  }
+  attachInterrupt(digitalPinToInterrupt(KNOCK_PIN), onInterrupt, ONHIGH);
+  gpio_wakeup_enable((gpio_num_t)KNOCK_PIN, GPIO_INTR_HIGH_LEVEL);
+  return true;
+}
+
+size_t motionRead(MotionReader &reader, MotionSample *out,
+                  size_t maxSamples) {
+  uint32_t head = motionHead.load(std::memory_order_acquire);
+  if (head - reader.tail > MOTION_RING_SIZE) {
+    reader.dropped += head - reader.tail - MOTION_RING_SIZE;
+    reader.tail = head - MOTION_RING_SIZE;
+  }
+  size_t count = min((size_t)(head - reader.tail), maxSamples);
+  for (size_t i = 0; i < count; i++) {
+    out[i] = motionRing[(reader.tail + i) % MOTION_RING_SIZE];
+  }
+  // anything the writer lapped while we were copying is torn, drop it
+  uint32_t oldest = motionHead.load(std::memory_order_acquire) -
+                    MOTION_RING_SIZE;
+  size_t torn = 0;
+  if ((int32_t)(oldest - reader.tail) > 0) {
+    torn = min((size_t)(oldest - reader.tail), count);
+    memmove(out, out + torn, (count - torn) * sizeof(MotionSample));
+    reader.dropped += torn;
+  }
+  reader.tail += count;
+  return count - torn;
+}
+
+void motionSkip(MotionReader &reader) {
+  reader.tail = motionHead.load(std::memory_order_acquire);
+}
+
+void motionSetIdle(bool on) {
+  if (idleWanted.exchange(on, std::memory_order_relaxed) != on &&
+      motionTaskHandle) {
+    xTaskNotifyGive(motionTaskHandle);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "motionsample.h"
+
+// MPU6050 sampling on a dedicated task. The sensor's data-ready interrupt on
+// KNOCK_PIN wakes the task, which drains the on-chip FIFO in bursts and
+// appends timestamped raw samples to a lock-free broadcast ring. Every
+// consumer keeps its own MotionReader cursor into the ring. While idle, the
+// sensor samples at MOTION_IDLE_RATE_HZ and only interrupts on movement, so
+// the chip can light-sleep between the task's periodic drains.
+
+#define MOTION_RING_SIZE 256 // power of two
+
+struct MotionReader {
+  uint32_t tail;
+  uint32_t dropped; // samples overwritten before this reader got to them
+};
+
+extern MotionSample motionRing[MOTION_RING_SIZE];
+extern std::atomic<uint32_t> motionHead;
+
+// Call after mpu.begin() and the range setup
+bool motionInit();
+
+// Copies up to max unread samples, oldest first, and returns the count
+size_t motionRead(MotionReader &reader, MotionSample *out,
+                  size_t maxSamples);
+
+// Forgets everything the reader hasn't read yet
+void motionSkip(MotionReader &reader);
+
+// Idle while the blade is off, applied by the motion task
+void motionSetIdle(bool idle);
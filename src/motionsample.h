@@ -0,0 +1,34 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+
+// Raw MPU6050 sample as the motion task stores it and the trace recorder
+// writes it. Plain C++ so the host replay tool can share it.
+
+// ranges configured in setup(): +-16 g and +-1000 deg/s
+#define MOTION_ACCEL_LSB_PER_G 2048.0f
+#define MOTION_GYRO_LSB_PER_DPS 32.8f
+
+#define MOTION_GRAVITY 9.80665f // SENSORS_GRAVITY_STANDARD
+#define MOTION_DEG_TO_RAD 0.017453292519943295f
+
+struct MotionSample {
+  uint32_t micros;
+  int16_t accel[3];
+  int16_t gyro[3];
+};
+
+static_assert(sizeof(MotionSample) == 16, "trace files store it verbatim");
+
+// magnitudes in m/s^2 and rad/s, the units Adafruit_MPU6050 reports
+inline float accelMagnitude(const MotionSample &sample) {
+  float x = sample.accel[0], y = sample.accel[1], z = sample.accel[2];
+  return sqrtf(x * x + y * y + z * z) *
+         (MOTION_GRAVITY / MOTION_ACCEL_LSB_PER_G);
+}
+
+inline float gyroMagnitude(const MotionSample &sample) {
+  float x = sample.gyro[0], y = sample.gyro[1], z = sample.gyro[2];
+  return sqrtf(x * x + y * y + z * z) *
+         (MOTION_DEG_TO_RAD / MOTION_GYRO_LSB_PER_DPS);
+}
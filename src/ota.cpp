@@ -0,0 +1,133 @@
+#include "ota.h"
+
+#include <ESPAsyncWebServer.h>
+#include <Update.h>
+#include <esp_ota_ops.h>
+
+#include "config.h"
+#include "debug.h"
+#include "otaupload.h"
+
+// Writes the image through Update into the inactive slot, reads delta bases
+// from the slot we are running from
+class FlashTarget : public OtaTarget {
+  const esp_partition_t *running = NULL;
+
+public:
+  bool begin(const OtaHeader &header) override {
+    running = esp_ota_get_running_partition();
+    if (header.flags & OTA_DELTA) {
+      if (!running || header.baseSize > running->size) {
+        return false;
+      }
+      uint8_t chunk[256];
+      uint32_t crc = 0;
+      for (uint32_t offset = 0; offset < header.baseSize;
+           offset += sizeof(chunk)) {
+        size_t n = min((uint32_t)sizeof(chunk), header.baseSize - offset);
+        if (esp_partition_read(running, offset, chunk, n) != ESP_OK) {
+          return false;
+        }
+        crc = crc32Update(crc, chunk, n);
+      }
+      if (crc != header.baseCrc) {
+        LOG_W("OTA: delta is for another build than the one running");
+        return false;
+      }
+    }
+    return Update.begin(header.imageSize, U_FLASH);
+  }
+
+  bool write(const uint8_t *data, size_t len) override {
+    return Update.write((uint8_t *)data, len) == len;
+  }
+
+  bool readBase(uint32_t offset, uint8_t *out, size_t len) override {
+    return esp_partition_read(running, offset, out, len) == ESP_OK;
+  }
+};
+
+static FlashTarget flash;
+static OtaUpload<AsyncWebServerRequest> upload(flash);
+static void (*startCallback)() = NULL;
+static void (*endCallback)(bool) = NULL;
+static int8_t pendingVerify = -1; // not checked yet
+static unsigned long restartAt = 0;
+
+static void uploadStarted() {
+  LOG_I("OTA: package upload started");
+  if (startCallback) {
+    startCallback();
+  }
+}
+
+static OtaStatus uploadEnded(OtaStatus status, uint32_t written) {
+  if (status == OtaStatus::OK && !Update.end(true)) {
+    status = OtaStatus::WRITE_FAILED;
+  }
+  if (status != OtaStatus::OK && Update.isRunning()) {
+    Update.abort();
+  }
+  if (status == OtaStatus::OK) {
+    LOG_I("OTA: %lu bytes written, restarting", (unsigned long)written);
+    restartAt = max(millis(), 1UL);
+  } else {
+    LOG_E("OTA failed: %s", otaStatusName(status));
+  }
+  if (endCallback) {
+    endCallback(status == OtaStatus::OK);
+  }
+  return status;
+}
+
+// Arduino marks a freshly booted image valid in initArduino() unless this
+// says otherwise, otaLoop() does it instead once the image has run a while.
+// Needs the bootloader built with CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+// (custom_sdkconfig in platformio.ini), flashed over USB once.
+extern "C" bool verifyRollbackLater() { return true; }
+
+bool otaInit(AsyncWebServer &server, void (*onStart)(),
+             void (*onEnd)(bool success)) {
+  startCallback = onStart;
+  endCallback = onEnd;
+  upload.setHooks(uploadStarted, uploadEnded);
+  server.on(
+      "/ota", HTTP_POST,
+      [](AsyncWebServerRequest *request) { upload.respond(request); },
+      [](AsyncWebServerRequest *request, const String &, size_t index,
+         uint8_t *data, size_t len, bool final) {
+        upload.upload(request, index, data, len, final);
+      },
+      [](AsyncWebServerRequest *request, uint8_t *data, size_t len,
+         size_t index, size_t total) {
+        upload.body(request, data, len, index, total);
+      });
+  return true;
+}
+
+// Checked from loop(), the web server may never come up without Wi-Fi
+static void checkProbation() {
+  esp_ota_img_states_t state;
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  pendingVerify = esp_ota_get_state_partition(running, &state) == ESP_OK &&
+                  state == ESP_OTA_IMG_PENDING_VERIFY;
+  if (pendingVerify) {
+    LOG_I("OTA: new image on %s, on probation", running->label);
+  }
+}
+
+void otaLoop() {
+  if (pendingVerify < 0) {
+    checkProbation();
+  }
+  if (pendingVerify > 0 && millis() > OTA_CONFIRM_MS) {
+    pendingVerify = 0;
+    if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+      LOG_I("OTA: image confirmed");
+    }
+  }
+  // give the response time to go out
+  if (restartAt && (unsigned long)(millis() - restartAt) > OTA_RESTART_MS) {
+    ESP.restart();
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+
+class AsyncWebServer;
+
+// Compressed and delta firmware updates. POST /ota (admin/admin) takes a
+// package built by tools/ota, as the raw request body or as a multipart
+// file upload, and streams it through the decoder in otastream.h straight
+// into the inactive app slot, so neither the package nor the image is ever
+// buffered whole. The image CRC is checked before the slot is made bootable.
+//
+// A new image boots on probation: unless it runs for OTA_CONFIRM_MS without
+// resetting, the bootloader goes back to the previous slot.
+
+// Registers POST /ota on the server, call before server.begin()
+bool otaInit(AsyncWebServer &server, void (*onStart)(),
+             void (*onEnd)(bool success));
+
+// From loop(), with or without otaInit(): confirms a new image once it has
+// proven itself and restarts after a finished update
+void otaLoop();
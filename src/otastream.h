@@ -0,0 +1,318 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crc32.h"
+
+// Streaming decoder for OTA packages built by tools/ota. A package is an
+// OtaHeader followed by the firmware image, optionally as a binary delta
+// against the running image and optionally LZSS compressed:
+//
+//   compressed:  heatshrink-style bit stream, 1 + 8 bits is a literal byte,
+//                0 + windowBits + lookaheadBits is a back reference of
+//                (count + 1) bytes at distance (index + 1)
+//   delta:       ops, 0x00 <len> <len bytes> copies literally, 0x01 <diff>
+//                <len> copies from the base image starting diff (zigzag)
+//                bytes after where the previous copy ended; varint numbers
+//
+// The decoder takes the body in chunks of any size, exactly as the network
+// delivers it, and writes the image out in order through an OtaTarget.
+// Plain C++ for the native tests.
+
+#define OTA_MAGIC "LOTA"
+#define OTA_VERSION 1
+#define OTA_COMPRESSED 0x01
+#define OTA_DELTA 0x02
+#define OTA_WINDOW_BITS_MAX 12 // 4 KB of decoder RAM
+#define OTA_OUT_BUFFER 512
+
+struct OtaHeader {
+  char magic[4];
+  uint8_t version;
+  uint8_t flags;
+  uint8_t windowBits;
+  uint8_t lookaheadBits;
+  uint32_t imageSize;
+  uint32_t imageCrc; // CRC-32 of the decoded image
+  uint32_t baseSize; // delta only: the image the delta applies to
+  uint32_t baseCrc;
+};
+
+static_assert(sizeof(OtaHeader) == 24, "package layout");
+
+// Where the image goes, and where a delta reads its base from
+class OtaTarget {
+public:
+  virtual ~OtaTarget() {}
+  // Header is valid, prepare for header.imageSize bytes
+  virtual bool begin(const OtaHeader &header) = 0;
+  virtual bool write(const uint8_t *data, size_t len) = 0;
+  virtual bool readBase(uint32_t offset, uint8_t *out, size_t len) = 0;
+};
+
+enum class OtaStatus : uint8_t {
+  OK,
+  BAD_HEADER, // not a package, or parameters this decoder can't handle
+  REJECTED,   // the target refused the header, e.g. wrong delta base
+  CORRUPT,    // stream doesn't decode to imageSize bytes
+  BAD_CRC,
+  WRITE_FAILED,
+  NO_MEMORY, // no room for the decoder, never returned by it
+};
+
+class OtaDecoder {
+  OtaHeader header;
+  size_t headerBytes;
+  OtaStatus status;
+  OtaTarget *target;
+  uint32_t produced;
+  uint32_t crc;
+
+  // LZSS
+  uint8_t window[1 << OTA_WINDOW_BITS_MAX];
+  uint32_t windowPos;
+  uint32_t bits;
+  uint8_t bitCount;
+
+  // delta ops
+  enum : uint8_t { OP, LITERAL_LEN, LITERAL, COPY_DIFF, COPY_LEN };
+  uint8_t deltaState;
+  uint8_t varintShift;
+  uint32_t varint;
+  uint32_t literalLeft;
+  uint32_t copyDiff;
+  uint32_t baseNext; // where the next copy starts before its diff
+
+  uint8_t out[OTA_OUT_BUFFER];
+  size_t outLen;
+
+  void fail(OtaStatus why) {
+    if (status == OtaStatus::OK) {
+      status = why;
+    }
+  }
+
+  bool flush() {
+    if (outLen && status == OtaStatus::OK) {
+      crc = crc32Update(crc, out, outLen);
+      if (!target->write(out, outLen)) {
+        fail(OtaStatus::WRITE_FAILED);
+      }
+    }
+    outLen = 0;
+    return status == OtaStatus::OK;
+  }
+
+  void emitImage(uint8_t byte) {
+    if (produced >= header.imageSize) {
+      fail(OtaStatus::CORRUPT);
+      return;
+    }
+    produced++;
+    out[outLen++] = byte;
+    if (outLen == sizeof(out)) {
+      flush();
+    }
+  }
+
+  // true once a varint is complete, in varint
+  bool takeVarint(uint8_t byte) {
+    if (varintShift > 28) {
+      fail(OtaStatus::CORRUPT);
+      return false;
+    }
+    varint |= (uint32_t)(byte & 0x7F) << varintShift;
+    varintShift += 7;
+    if (byte & 0x80) {
+      return false;
+    }
+    varintShift = 0;
+    return true;
+  }
+
+  void copyFromBase(uint32_t offset, uint32_t len) {
+    if (offset > header.baseSize || len > header.baseSize - offset) {
+      fail(OtaStatus::CORRUPT);
+      return;
+    }
+    uint8_t chunk[64];
+    while (len && status == OtaStatus::OK) {
+      size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+      if (!target->readBase(offset, chunk, n)) {
+        fail(OtaStatus::WRITE_FAILED);
+        return;
+      }
+      for (size_t i = 0; i < n; i++) {
+        emitImage(chunk[i]);
+      }
+      offset += n;
+      len -= n;
+    }
+  }
+
+  void emitDelta(uint8_t byte) {
+    switch (deltaState) {
+    case OP:
+      varint = 0;
+      if (byte == 0x00) {
+        deltaState = LITERAL_LEN;
+      } else if (byte == 0x01) {
+        deltaState = COPY_DIFF;
+      } else {
+        fail(OtaStatus::CORRUPT);
+      }
+      break;
+    case LITERAL_LEN:
+      if (takeVarint(byte)) {
+        literalLeft = varint;
+        deltaState = literalLeft ? LITERAL : OP;
+      }
+      break;
+    case LITERAL:
+      emitImage(byte);
+      if (--literalLeft == 0) {
+        deltaState = OP;
+      }
+      break;
+    case COPY_DIFF:
+      if (takeVarint(byte)) {
+        copyDiff = varint;
+        varint = 0;
+        deltaState = COPY_LEN;
+      }
+      break;
+    case COPY_LEN:
+      if (takeVarint(byte)) {
+        int32_t diff = (int32_t)(copyDiff >> 1) ^ -(int32_t)(copyDiff & 1);
+        uint32_t offset = baseNext + diff;
+        copyFromBase(offset, varint);
+        baseNext = offset + varint;
+        deltaState = OP;
+      }
+      break;
+    }
+  }
+
+  void emitStream(uint8_t byte) {
+    if (header.flags & OTA_DELTA) {
+      emitDelta(byte);
+    } else {
+      emitImage(byte);
+    }
+  }
+
+  uint32_t takeBits(uint8_t n) {
+    bitCount -= n;
+    return (bits >> bitCount) & ((1u << n) - 1);
+  }
+
+  void decompress(uint8_t byte) {
+    bits = bits << 8 | byte;
+    bitCount += 8;
+    const uint32_t mask = (1u << header.windowBits) - 1;
+    while (status == OtaStatus::OK && bitCount > 0) {
+      bool literal = (bits >> (bitCount - 1)) & 1;
+      if (literal) {
+        if (bitCount < 9) {
+          return;
+        }
+        takeBits(1);
+        uint8_t value = takeBits(8);
+        window[windowPos++ & mask] = value;
+        emitStream(value);
+      } else {
+        if (bitCount < 1 + header.windowBits + header.lookaheadBits) {
+          return;
+        }
+        takeBits(1);
+        uint32_t distance = takeBits(header.windowBits) + 1;
+        uint32_t count = takeBits(header.lookaheadBits) + 1;
+        for (uint32_t i = 0; i < count; i++) {
+          uint8_t value = window[(windowPos - distance) & mask];
+          window[windowPos++ & mask] = value;
+          emitStream(value);
+        }
+      }
+    }
+  }
+
+  bool parseHeader() {
+    if (memcmp(header.magic, OTA_MAGIC, 4) != 0 ||
+        header.version != OTA_VERSION ||
+        (header.flags & ~(OTA_COMPRESSED | OTA_DELTA))) {
+      return false;
+    }
+    if (header.flags & OTA_COMPRESSED) {
+      return header.windowBits >= 4 &&
+             header.windowBits <= OTA_WINDOW_BITS_MAX &&
+             header.lookaheadBits >= 1 &&
+             header.lookaheadBits < header.windowBits;
+    }
+    return true;
+  }
+
+public:
+  void begin(OtaTarget &outTarget) {
+    target = &outTarget;
+    headerBytes = 0;
+    status = OtaStatus::OK;
+    produced = 0;
+    crc = 0;
+    memset(window, 0, sizeof(window));
+    windowPos = 0;
+    bits = 0;
+    bitCount = 0;
+    deltaState = OP;
+    varintShift = 0;
+    varint = 0;
+    baseNext = 0;
+    outLen = 0;
+  }
+
+  // false once the package is known bad, see result()
+  bool feed(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    if (headerBytes < sizeof(header) && status == OtaStatus::OK) {
+      size_t n = sizeof(header) - headerBytes;
+      n = n < len ? n : len;
+      memcpy((uint8_t *)&header + headerBytes, data, n);
+      headerBytes += n;
+      i = n;
+      if (headerBytes == sizeof(header)) {
+        if (!parseHeader()) {
+          fail(OtaStatus::BAD_HEADER);
+        } else if (!target->begin(header)) {
+          fail(OtaStatus::REJECTED);
+        }
+      }
+    }
+    for (; i < len && status == OtaStatus::OK; i++) {
+      if (header.flags & OTA_COMPRESSED) {
+        decompress(data[i]);
+      } else {
+        emitStream(data[i]);
+      }
+    }
+    return status == OtaStatus::OK;
+  }
+
+  // Call after the last chunk, OK if the whole image was written intact
+  OtaStatus finish() {
+    if (headerBytes < sizeof(header)) {
+      fail(OtaStatus::BAD_HEADER);
+    }
+    flush();
+    if (status == OtaStatus::OK && produced != header.imageSize) {
+      fail(OtaStatus::CORRUPT);
+    }
+    if (status == OtaStatus::OK && crc != header.imageCrc) {
+      fail(OtaStatus::BAD_CRC);
+    }
+    return status;
+  }
+
+  OtaStatus result() const { return status; }
+  uint32_t bytesWritten() const { return produced; }
+  const OtaHeader &packageHeader() const { return header; }
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <new>
+
+#include "otastream.h"
+
+// The request side of POST /ota: which request owns the update, feeding its
+// body to the decoder as the web server hands it over (raw body or multipart
+// file upload) and the response it gets once the body is through. Templated
+// on the server's request type, finishing the slot is left to the end hook.
+// Plain C++ for the native tests.
+
+inline const char *otaStatusName(OtaStatus status) {
+  switch (status) {
+  case OtaStatus::OK:
+    return "ok";
+  case OtaStatus::BAD_HEADER:
+    return "not an OTA package";
+  case OtaStatus::REJECTED:
+    return "package rejected, wrong delta base?";
+  case OtaStatus::CORRUPT:
+    return "package corrupt or truncated";
+  case OtaStatus::BAD_CRC:
+    return "image CRC mismatch";
+  case OtaStatus::WRITE_FAILED:
+    return "flash write failed";
+  case OtaStatus::NO_MEMORY:
+    return "out of memory";
+  }
+  return "?";
+}
+
+// The package's fault is a 400, ours is a 5xx
+inline int otaHttpCode(OtaStatus status) {
+  switch (status) {
+  case OtaStatus::OK:
+    return 200;
+  case OtaStatus::WRITE_FAILED:
+    return 507;
+  case OtaStatus::NO_MEMORY:
+    return 500;
+  default:
+    return 400;
+  }
+}
+
+template <typename Request> class OtaUpload {
+public:
+  // Called with the decoder's verdict and the bytes written, returns the
+  // final status once the slot is closed
+  typedef OtaStatus (*EndHook)(OtaStatus status, uint32_t written);
+
+  OtaUpload(OtaTarget &target) : target(target) {}
+
+  void setHooks(void (*onStart)(), EndHook onEnd) {
+    startHook = onStart;
+    endHook = onEnd;
+  }
+
+  // Upload handler: one chunk of a multipart file
+  void upload(Request *request, size_t index, const uint8_t *data, size_t len,
+              bool final) {
+    chunk(request, data, len, index, final);
+  }
+
+  // Body handler: one chunk of a raw request body
+  void body(Request *request, const uint8_t *data, size_t len, size_t index,
+            size_t total) {
+    chunk(request, data, len, index, index + len == total);
+  }
+
+  // Request handler, once the whole body is in
+  void respond(Request *request) {
+    if (!request->authenticate("admin", "admin")) {
+      return request->requestAuthentication();
+    }
+    if (request != uploader) {
+      request->send(409, "text/plain", "another update is in progress");
+      return;
+    }
+    uploader = nullptr;
+    request->send(otaHttpCode(lastStatus), "text/plain",
+                  otaStatusName(lastStatus));
+  }
+
+  bool busy() const { return uploader != nullptr; }
+
+private:
+  OtaTarget &target;
+  OtaDecoder *decoder = nullptr; // only allocated during an update
+  Request *uploader = nullptr;
+  OtaStatus lastStatus = OtaStatus::OK;
+  void (*startHook)() = nullptr;
+  EndHook endHook = nullptr;
+
+  void end(OtaStatus status) {
+    lastStatus = endHook ? endHook(status, decoder->bytesWritten()) : status;
+    delete decoder;
+    decoder = nullptr;
+  }
+
+  void chunk(Request *request, const uint8_t *data, size_t len, size_t index,
+             bool final) {
+    if (index == 0) {
+      if (uploader || !request->authenticate("admin", "admin")) {
+        return;
+      }
+      // owns the update even without a decoder, so the response says why
+      uploader = request;
+      request->onDisconnect([this, request]() {
+        if (uploader == request) {
+          uploader = nullptr;
+          if (decoder) {
+            end(OtaStatus::CORRUPT);
+          }
+        }
+      });
+      decoder = new (std::nothrow) OtaDecoder;
+      if (!decoder) {
+        lastStatus = OtaStatus::NO_MEMORY;
+        return;
+      }
+      if (startHook) {
+        startHook();
+      }
+      decoder->begin(target);
+    }
+    if (request != uploader || !decoder) {
+      return;
+    }
+    // keep draining a failed upload, the status goes out with the response
+    decoder->feed(data, len);
+    if (final) {
+      end(decoder->finish());
+    }
+  }
+};
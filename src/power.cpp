@@ -0,0 +1,73 @@
+#include "power.h"
+
+#include <esp_pm.h>
+#include <esp_sleep.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "debug.h"
+
+#if POWER_SAVE
+static esp_pm_lock_handle_t cpuLock = NULL;
+static esp_pm_lock_handle_t sleepLock = NULL;
+static bool held = false;
+static bool lightSleep = false;
+static std::atomic<bool> idle{false};
+
+bool powerInit() {
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = POWER_MAX_MHZ;
+  pm.min_freq_mhz = POWER_MIN_MHZ;
+  pm.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err != ESP_OK) {
+    // without CONFIG_FREERTOS_USE_TICKLESS_IDLE, DFS only
+    LOG_W("Power: light sleep unavailable (%d), scaling frequency only", err);
+    pm.light_sleep_enable = false;
+    err = esp_pm_configure(&pm);
+  }
+  if (err != ESP_OK) {
+    LOG_E("Power: management unavailable (%d)", err);
+    return false;
+  }
+  lightSleep = pm.light_sleep_enable;
+  esp_sleep_enable_gpio_wakeup();
+  if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "busy", &cpuLock) !=
+          ESP_OK ||
+      esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "busy", &sleepLock) !=
+          ESP_OK) {
+    LOG_E("Power: lock creation failed");
+    return false;
+  }
+  powerSetBusy(true);
+  LOG_I("Power: %d-%d MHz, light sleep %s", POWER_MIN_MHZ, POWER_MAX_MHZ,
+        lightSleep ? "on" : "off");
+  return true;
+}
+
+void powerSetBusy(bool busy) {
+  if (busy == held || !cpuLock || !sleepLock) {
+    return;
+  }
+  held = busy;
+  idle.store(!busy, std::memory_order_relaxed);
+  if (busy) {
+    esp_pm_lock_acquire(cpuLock);
+    esp_pm_lock_acquire(sleepLock);
+  } else {
+    esp_pm_lock_release(sleepLock);
+    esp_pm_lock_release(cpuLock);
+  }
+  LOG_D("Power: %s", busy ? "busy" : "idle");
+}
+
+bool powerLightSleep() { return lightSleep; }
+
+bool powerIdle() { return idle.load(std::memory_order_relaxed); }
+#else
+bool powerInit() { return true; }
+void powerSetBusy(bool busy) {}
+bool powerLightSleep() { return false; }
+bool powerIdle() { return false; }
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+
+// Power management while the blade is off. The CPU scales between
+// POWER_MIN_MHZ and POWER_MAX_MHZ and, with tickless idle (custom_sdkconfig
+// in platformio.ini), light-sleeps whenever every task is blocked; a button
+// level (see buttons.h) or the IMU motion interrupt (see motion.h) wakes it.
+// While busy (blade on, audio, an animation or an update) both stay locked
+// out. While idle the periodic tasks stretch to POWER_IDLE_MS, see
+// powerIdle(). POWER_SAVE 0 compiles it out.
+
+// Configures DFS and the GPIO wakeup, starts busy
+bool powerInit();
+
+// Cheap when unchanged, from the loop task
+void powerSetBusy(bool busy);
+
+// Whether light sleep could be enabled
+bool powerLightSleep();
+
+// True while the locks are released, from any task
+bool powerIdle();
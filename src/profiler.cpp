@@ -0,0 +1,90 @@
+#include "profiler.h"
+
+#include <ESPAsyncWebServer.h>
+
+#include "debug.h"
+
+Histogram profileHistograms[(int)ProfileStage::COUNT];
+std::atomic<uint32_t> profileResetMask{0};
+
+static const char *const stageNames[(int)ProfileStage::COUNT] = {
+    "loop",    "ota",     "audio",       "webserial",
+    "buttons", "settings", "battery",    "motion",
+    "trigger", "static",  "audio_queue", "audio_roundtrip"};
+
+uint32_t profileLoopStart() {
+  static uint32_t lastStart = 0;
+  uint32_t now = profileClock();
+  if (lastStart) {
+    profileLap(ProfileStage::LOOP, lastStart);
+  }
+  lastStart = now;
+  return now;
+}
+
+void profileReset() {
+  profileResetMask.store((1u << (int)ProfileStage::COUNT) - 1,
+                         std::memory_order_relaxed);
+}
+
+// Copy first, the writer keeps going while a report reads it
+static void snapshot(ProfileStage stage, Histogram &out) {
+  if (profileResetMask.load(std::memory_order_relaxed) & (1u << (int)stage)) {
+    out.reset();
+  } else {
+    out = profileHistograms[(int)stage];
+  }
+}
+
+static float loopRateHz(const Histogram &loop) {
+  return loop.sum ? loop.count * 1e9 / loop.sum : 0;
+}
+
+void reportProfile() {
+  static Histogram h;
+  snapshot(ProfileStage::LOOP, h);
+  LOG_I("Loop: %lu loops, %.1f Hz", (unsigned long)h.count, loopRateHz(h));
+  for (int i = 0; i < (int)ProfileStage::COUNT; i++) {
+    snapshot((ProfileStage)i, h);
+    if (!h.count) {
+      continue;
+    }
+    LOG_I("%-15s n=%lu p50=%luus p99=%luus max=%luus", stageNames[i],
+          (unsigned long)h.count, (unsigned long)h.percentile(0.5) / 1000,
+          (unsigned long)h.percentile(0.99) / 1000,
+          (unsigned long)h.max / 1000);
+  }
+}
+
+void profileWriteMetrics(AsyncResponseStream *response) {
+  static const float quantiles[] = {0.5, 0.9, 0.99};
+  static Histogram h;
+  response->print("# HELP lightsaber_stage_seconds Time per loop() stage, "
+                  "loop period and audio command latency\n"
+                  "# TYPE lightsaber_stage_seconds summary\n");
+  for (int i = 0; i < (int)ProfileStage::COUNT; i++) {
+    snapshot((ProfileStage)i, h);
+    for (float q : quantiles) {
+      response->printf(
+          "lightsaber_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+          stageNames[i], q, h.percentile(q) / 1e9);
+    }
+    response->printf("lightsaber_stage_seconds_sum{stage=\"%s\"} %.9f\n",
+                     stageNames[i], h.sum / 1e9);
+    response->printf("lightsaber_stage_seconds_count{stage=\"%s\"} %lu\n",
+                     stageNames[i], (unsigned long)h.count);
+  }
+  response->print("# HELP lightsaber_stage_max_seconds Slowest sample per "
+                  "stage\n"
+                  "# TYPE lightsaber_stage_max_seconds gauge\n");
+  for (int i = 0; i < (int)ProfileStage::COUNT; i++) {
+    snapshot((ProfileStage)i, h);
+    response->printf("lightsaber_stage_max_seconds{stage=\"%s\"} %.9f\n",
+                     stageNames[i], h.max / 1e9);
+  }
+  snapshot(ProfileStage::LOOP, h);
+  response->printf("# HELP lightsaber_loop_rate_hz Mean loop() rate\n"
+                   "# TYPE lightsaber_loop_rate_hz gauge\n"
+                   "lightsaber_loop_rate_hz %.2f\n",
+                   loopRateHz(h));
+}
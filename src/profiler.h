@@ -0,0 +1,86 @@
+#pragma once
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "histogram.h"
+
+class AsyncResponseStream;
+
+// Loop profiler. Every stage of the loop jobs starts from an esp_timer
+// timestamp and is closed with profileLap(), which records the elapsed time
+// in that stage's histogram and returns the next stage's start. The loop period
+// and the audio command latencies go into histograms of their own. Values
+// are nanoseconds with microsecond resolution. The CPU cycle counter is not
+// used, its rate follows the clock that power management scales down and it
+// stops in light sleep. Stages are written by one task each, reports may read
+// a histogram that is being updated and be off by one sample.
+
+enum class ProfileStage : uint8_t {
+  LOOP, // loop() start to start
+  OTA,
+  AUDIO,
+  WEBSERIAL,
+  BUTTONS,
+  SETTINGS,
+  BATTERY,
+  MOTION,
+  TRIGGER,
+  STATIC,
+  AUDIO_QUEUE,     // command posted -> run by the audio task
+  AUDIO_ROUNDTRIP, // command posted -> completion callback
+  COUNT
+};
+
+extern Histogram profileHistograms[(int)ProfileStage::COUNT];
+extern std::atomic<uint32_t> profileResetMask; // one bit per stage
+
+inline void profileRecord(ProfileStage stage, uint32_t ns) {
+#if PROFILE_ENABLED
+  uint32_t bit = 1u << (int)stage;
+  Histogram &histogram = profileHistograms[(int)stage];
+  if (profileResetMask.load(std::memory_order_relaxed) & bit) {
+    profileResetMask.fetch_and(~bit, std::memory_order_relaxed);
+    histogram.reset();
+  }
+  histogram.record(ns);
+#endif
+}
+
+// Saturates after 4.29 s
+inline uint32_t profileMicrosToNs(uint32_t us) {
+  return us >= UINT32_MAX / 1000 ? UINT32_MAX : us * 1000;
+}
+
+inline uint32_t profileClock() {
+#if PROFILE_ENABLED
+  return (uint32_t)esp_timer_get_time();
+#else
+  return 0;
+#endif
+}
+
+// Closes a stage that started at the given profileClock()
+inline uint32_t profileLap(ProfileStage stage, uint32_t start) {
+#if PROFILE_ENABLED
+  uint32_t now = (uint32_t)esp_timer_get_time();
+  profileRecord(stage, profileMicrosToNs(now - start));
+  return now;
+#else
+  return 0;
+#endif
+}
+
+// Call first thing in loop(), returns the first stage's start
+uint32_t profileLoopStart();
+
+// Clears every histogram on its writer's next record
+void profileReset();
+
+// p50/p99/max per stage and the loop rate to the log
+void reportProfile();
+
+// Prometheus text exposition of every histogram
+void profileWriteMetrics(AsyncResponseStream *response);
@@ -0,0 +1,134 @@
+#include "recorder.h"
+
+#include <FS.h>
+#include <SD.h>
+
+#include "config.h"
+#include "debug.h"
+#include "motion.h"
+
+#define RECORDER_BATCH 32 // samples, 512 bytes
+
+static TaskHandle_t recorderTaskHandle = NULL;
+static File traceFile;
+static TraceHeader traceHeader;
+static MotionReader traceReader = {};
+static MotionSample batch[RECORDER_BATCH];
+static size_t batched = 0;
+static char traceName[16] = "";
+static volatile bool recording = false;
+static volatile bool stopRequested = false;
+static volatile uint32_t traceSamples = 0;
+
+static bool writeBatch() {
+  size_t bytes = batched * sizeof(MotionSample);
+  if (traceFile.write((const uint8_t *)batch, bytes) != bytes) {
+    return false;
+  }
+  traceSamples += batched;
+  batched = 0;
+  return true;
+}
+
+static void closeTrace() {
+  traceHeader.samples = traceSamples;
+  traceHeader.dropped = traceReader.dropped;
+  traceFile.seek(0);
+  traceFile.write((const uint8_t *)&traceHeader, sizeof(traceHeader));
+  traceFile.close();
+  recording = false;
+  stopRequested = false;
+}
+
+static void recorderTask(void *parameter) {
+  while (true) {
+    if (!recording) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    vTaskDelay(pdMS_TO_TICKS(RECORDER_PERIOD_MS));
+    bool stop = stopRequested;
+    bool ok = true;
+    while (ok) {
+      size_t count = motionRead(traceReader, batch + batched,
+                                RECORDER_BATCH - batched);
+      batched += count;
+      if (batched < RECORDER_BATCH) {
+        break;
+      }
+      ok = writeBatch();
+    }
+    if (ok && stop && batched > 0) {
+      ok = writeBatch();
+    }
+    if (!ok) {
+      LOG_E("Trace %s: write failed", traceName);
+    }
+    if (!ok || stop) {
+      closeTrace();
+    }
+  }
+}
+
+bool recorderInit() {
+  return xTaskCreatePinnedToCore(recorderTask,      /* Function to implement
+                                                       the task */
+                                 "recorder",        /* Name of the task */
+                                 3072,              /* Stack size in words */
+                                 NULL,              /* Task input parameter */
+                                 RECORDERTASK_PRIO, /* Priority of the task */
+                                 &recorderTaskHandle, /* Task handle. */
+                                 RECORDERTASK_CORE /* Core where the task
+                                                      should run */
+                                 ) == pdPASS;
+}
+
+bool recorderStart() {
+  if (recording || recorderTaskHandle == NULL) {
+    return false;
+  }
+  for (int i = 0; i < 1000; i++) {
+    snprintf(traceName, sizeof(traceName), "/trace%03d.imu", i);
+    if (!SD.exists(traceName)) {
+      break;
+    }
+  }
+  traceFile = SD.open(traceName, FILE_WRITE);
+  if (!traceFile) {
+    return false;
+  }
+  traceHeader = {};
+  memcpy(traceHeader.magic, TRACE_MAGIC, sizeof(traceHeader.magic));
+  traceHeader.version = TRACE_VERSION;
+  traceHeader.rateHz = MOTION_RATE_HZ;
+  traceHeader.accelLsbPerG = MOTION_ACCEL_LSB_PER_G;
+  traceHeader.gyroLsbPerDps = MOTION_GYRO_LSB_PER_DPS;
+  if (traceFile.write((const uint8_t *)&traceHeader, sizeof(traceHeader)) !=
+      sizeof(traceHeader)) {
+    traceFile.close();
+    return false;
+  }
+  motionSkip(traceReader);
+  traceReader.dropped = 0;
+  batched = 0;
+  traceSamples = 0;
+  stopRequested = false;
+  recording = true;
+  xTaskNotifyGive(recorderTaskHandle);
+  return true;
+}
+
+void recorderStop() {
+  if (recording) {
+    stopRequested = true;
+  }
+}
+
+RecorderStatus recorderStatus() {
+  RecorderStatus status = {};
+  status.recording = recording;
+  status.samples = traceSamples;
+  status.dropped = traceReader.dropped;
+  memcpy(status.file, traceName, sizeof(status.file));
+  return status;
+}
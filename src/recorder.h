@@ -0,0 +1,27 @@
+#pragma once
+#include <Arduino.h>
+
+#include "trace.h"
+
+// IMU trace recorder. A low priority task follows the motion ring with its
+// own MotionReader and appends raw samples to /traceNNN.imu on SD, batched
+// into 512 byte writes so the card only ever sees whole sectors. The traces
+// feed tools/replay for tuning the thresholds in detect.h offline.
+
+struct RecorderStatus {
+  bool recording;
+  uint32_t samples;
+  uint32_t dropped;
+  char file[16];
+};
+
+// Call after SD.begin() and motionInit()
+bool recorderInit();
+
+// Opens the next free trace file, false if already recording or SD failed
+bool recorderStart();
+
+// Flushes the last batch and closes the file from the recorder task
+void recorderStop();
+
+RecorderStatus recorderStatus();
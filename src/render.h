@@ -0,0 +1,100 @@
+#pragma once
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "config.h"
+#include "debug.h"
+#include "led.h"
+#include "power.h"
+#include "saber.h"
+#include "telemetry.h"
+
+// Render task: composes the current effect into the back buffer, publishes it
+// and pushes one Show() per frame, paced to RENDER_FPS. While the saber idles
+// nothing animates, so it waits up to POWER_IDLE_MS for renderWake().
+
+struct RenderStats {
+  uint32_t frames;
+  uint32_t dropped;
+  uint32_t frameTimeTotal;
+  uint32_t frameTimeMax;
+  uint32_t showTimeTotal;
+  uint32_t showTimeMax;
+  uint32_t shows;
+};
+
+// Written by the render task only, reportRenderStats() asks it to reset
+RenderStats renderStats = {};
+std::atomic<bool> renderStatsReset{false};
+TaskHandle_t renderTaskHandle = NULL;
+
+void renderTask(void *parameter) {
+  const TickType_t period = pdMS_TO_TICKS(1000 / RENDER_FPS);
+  TickType_t lastWake = xTaskGetTickCount();
+  while (true) {
+    if (renderStatsReset.exchange(false, std::memory_order_relaxed)) {
+      renderStats = {};
+    }
+    uint32_t start = micros();
+    composeFrame();
+    uint32_t showStart = micros();
+    uint32_t showTime = 0;
+    if (pushFrame()) {
+      showTime = micros() - showStart;
+      renderStats.shows++;
+      renderStats.showTimeTotal += showTime;
+      renderStats.showTimeMax = max(renderStats.showTimeMax, showTime);
+    }
+    uint32_t frameTime = micros() - start;
+    renderStats.frames++;
+    renderStats.frameTimeTotal += frameTime;
+    renderStats.frameTimeMax = max(renderStats.frameTimeMax, frameTime);
+    if (powerIdle()) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_IDLE_MS));
+      lastWake = xTaskGetTickCount();
+      telemetryRenderFrame(frameTime, showTime, false);
+      continue;
+    }
+    // xTaskDelayUntil() returns pdFALSE when the deadline already passed
+    bool late = xTaskDelayUntil(&lastWake, period) == pdFALSE;
+    if (late) {
+      renderStats.dropped++;
+    }
+    telemetryRenderFrame(frameTime, showTime, late);
+  }
+}
+
+void renderInit() {
+  frameMutex = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(renderTask,      /* Function to implement the task
+                                            */
+                          "render",        /* Name of the task */
+                          4096,            /* Stack size in words */
+                          NULL,            /* Task input parameter */
+                          RENDERTASK_PRIO, /* Priority of the task */
+                          &renderTaskHandle, /* Task handle. */
+                          RENDERTASK_CORE  /* Core where the task should run
+                                            */
+  );
+}
+
+// Next frame now rather than after the idle wait
+void renderWake() {
+  if (renderTaskHandle) {
+    xTaskNotifyGive(renderTaskHandle);
+  }
+}
+
+// Prints and resets the frame counters; the copy may be a frame off
+void reportRenderStats() {
+  RenderStats stats = renderStats;
+  renderStatsReset.store(true, std::memory_order_relaxed);
+  uint32_t frames = max(stats.frames, 1ul);
+  uint32_t shows = max(stats.shows, 1ul);
+  LOG_I("Render: %lu frames, %lu dropped, %lu shows, frame avg/max: "
+        "%lu/%lu us, show avg/max: %lu/%lu us",
+        stats.frames, stats.dropped, stats.shows,
+        stats.frameTimeTotal / frames, stats.frameTimeMax,
+        stats.showTimeTotal / shows, stats.showTimeMax);
+}
@@ -0,0 +1,437 @@
+#pragma once
+#include <Arduino.h>
+
+#include <type_traits>
+
+#include "buttongesture.h"
+#include "config.h"
+#include "detect.h"
+#include "led.h"
+#include "settings.h"
+#include "sounds.h"
+
+// What the saber does with its buttons and its motion: ignition and
+// retraction, clash and swing effects, the hum and the music, volume steps,
+// the strike flash and the battery bar. The firmware (main.cpp) and the host
+// simulator (tools/sim) both run this, everything outside the blade goes
+// through the SaberPlatform they pass to saberBegin(). Like led.h, include
+// it once per program. Plain C++ for the native tests.
+
+// The audio task, settings and the rest of the firmware, as the saber sees
+// them
+class SaberPlatform {
+public:
+  virtual ~SaberPlatform() {}
+  // audio commands, see audioqueue.h
+  virtual void stopSong() = 0;
+  virtual void playFile(const char *path, uint32_t pos, bool loop) = 0;
+  virtual void playStation(const char *url) = 0;
+  virtual bool hasEffect(const char *name) = 0; // in the sound bank
+  virtual void playEffect(const char *name, bool endsStream) = 0;
+  virtual void stopEffects() = 0;
+  // sets smoothSwingActive once the audio task has answered
+  virtual void smoothSwing(bool on) = 0;
+  virtual void setVolume(uint32_t volume) = 0;
+  virtual bool audioPending() = 0;
+  virtual bool audioPlaying() = 0;
+  virtual bool audioLooping() = 0;
+  virtual bool networkReady() = 0;
+  virtual void save(Setting key, uint32_t value) = 0;
+  virtual uint8_t batteryPercent() = 0;
+  // the blade is on, motion samples from now on count
+  virtual void ignited() = 0;
+  virtual void motionEvent(MotionEvent event, float value) = 0;
+  virtual void reportDebugInfo() = 0;
+  virtual void announceIP() = 0;
+  virtual void resetWiFi() = 0;
+};
+
+SaberPlatform *saberPlatform = nullptr;
+
+// if updating, don't process much
+bool updating = false;
+
+// saved preferences
+uint32_t currentColorMode = 0;
+uint32_t currentColor = 0;
+uint32_t currentVolume = 10;
+uint32_t currentStation = 0;
+uint32_t currentSDFile = 0;
+bool internetRadioMode = false;
+
+const char *const stations[] = {
+    "http://mp3.ffh.de/radioffh/hqlivestream.mp3",
+    "http://stream.srg-ssr.ch/m/rsp/mp3_128",
+    "http://stream.radioparadise.com/mp3-128",
+    "http://nr9.newradio.it:9371/stream",
+    "http://media-ice.musicradio.com/ChillMP3"};
+
+constexpr auto STATION_COUNT = sizeof(stations) / sizeof(stations[0]);
+
+const char *const SDFiles[] = {"/witcher.mp3", "/rammstein.mp3",
+                               "/imlerith.mp3"};
+
+constexpr auto SD_FILE_COUNT = sizeof(SDFiles) / sizeof(SDFiles[0]);
+
+bool sword_on = false;
+MotionDetector detector;
+
+// held for a volume step, button 1 up and button 2 down
+bool volUpActive = false;
+bool volDownActive = false;
+
+// audio states when blade is on
+// vibe plays either SD or internet radio, effects are mixed on top of either
+enum class AudioState { STATIC, VIBE };
+AudioState currentAudioState = AudioState::STATIC;
+uint32_t file_pos = 0;
+enum class AudioMode { SWORD, INTERLEAVE, SOUNDS };
+int currentAudioMode = static_cast<int>(AudioMode::SWORD);
+
+constexpr auto AUDIOMODE_COUNT =
+    static_cast<std::underlying_type_t<Color>>(AudioMode::SOUNDS) + 1;
+
+// set from the SMOOTHSWING completion, swing clips only play without it
+bool smoothSwingActive = false;
+
+volatile bool flashing = false;
+volatile uint32_t flashUntil = 0;
+
+// Battery bar while the blade is off: one pixel from each end per
+// JOB_BATTERY_MS, held for 100 ms once full and redrawn every second.
+// batteryBarQuiet draws it whole in one go instead, so the job can run
+// rarely while the saber idles.
+long batteryBarPixel = -1; // next pixel, -1 starts a new bar
+bool batteryBarQuiet = false;
+
+// Sets the platform and starts with the blade off, the saved preferences
+// are left as they are
+void saberBegin(SaberPlatform &platform) {
+  saberPlatform = &platform;
+  updating = false;
+  sword_on = false;
+  detector = MotionDetector();
+  volUpActive = false;
+  volDownActive = false;
+  currentAudioState = AudioState::STATIC;
+  file_pos = 0;
+  currentAudioMode = static_cast<int>(AudioMode::SWORD);
+  smoothSwingActive = false;
+  flashing = false;
+  batteryBarPixel = -1;
+  batteryBarQuiet = false;
+}
+
+void resumeCurrentSong() {
+  currentAudioState = AudioState::VIBE;
+  if (static_cast<AudioMode>(currentAudioMode) == AudioMode::SWORD) {
+    currentAudioMode = static_cast<int>(AudioMode::INTERLEAVE);
+  }
+  saberPlatform->stopSong();
+  if (internetRadioMode) {
+    // updateStatic() starts the station once the network is up
+    if (!saberPlatform->networkReady()) {
+      return;
+    }
+    saberPlatform->playStation(stations[currentStation]);
+  } else {
+    saberPlatform->playFile(SDFiles[currentSDFile], file_pos, false);
+  }
+}
+
+void toggleInternetRadio() {
+  internetRadioMode = !internetRadioMode;
+  saberPlatform->save(Setting::INTERNET_RADIO, internetRadioMode);
+  resumeCurrentSong();
+}
+
+void updateSmoothSwing() {
+  bool on = sword_on &&
+            static_cast<AudioMode>(currentAudioMode) != AudioMode::SOUNDS;
+  saberPlatform->smoothSwing(on);
+}
+
+void switchAudioMode() {
+  currentAudioMode = (currentAudioMode + 1) % AUDIOMODE_COUNT;
+  updateSmoothSwing();
+}
+
+void onCombo(ComboAction combo) {
+  switch (combo) {
+  case ComboAction::ANNOUNCE_IP:
+    saberPlatform->announceIP();
+    break;
+  case ComboAction::SWITCH_AUDIO_MODE:
+    switchAudioMode();
+    break;
+  case ComboAction::TOGGLE_RADIO:
+    toggleInternetRadio();
+    break;
+  case ComboAction::RESET_WIFI:
+    saberPlatform->resetWiFi();
+    break;
+  case ComboAction::NONE:
+    break;
+  }
+}
+
+// One step per JOB_VOLUME_MS while a button is held
+void increaseVolumeStep() {
+  if (currentVolume >= 21) {
+    return;
+  }
+  currentVolume++;
+  saberPlatform->setVolume(currentVolume);
+  saberPlatform->save(Setting::VOLUME, currentVolume);
+}
+
+void decreaseVolumeStep() {
+  if (currentVolume == 0) {
+    return;
+  }
+  currentVolume--;
+  saberPlatform->setVolume(currentVolume);
+  saberPlatform->save(Setting::VOLUME, currentVolume);
+}
+
+void volumeStep() {
+  if (updating) {
+    return;
+  }
+  if (volUpActive) {
+    increaseVolumeStep();
+  }
+  if (volDownActive) {
+    decreaseVolumeStep();
+  }
+}
+
+// false, and the bar starts over, while the blade is in use
+bool batteryBarAllowed() {
+  if (updating || sword_on || bladeAnimation != BladeAnimation::NONE) {
+    batteryBarPixel = -1;
+    return false;
+  }
+  return true;
+}
+
+// last pixel from each end
+long batteryBarCapacity() {
+  return map(saberPlatform->batteryPercent(), 100, 0, (NUM_PIXELS / 2 - 1), 1);
+}
+
+void showBatteryPercentage() {
+  static long capacity = 0;
+  static uint32_t barStart = 0;
+  static uint32_t filledAt = 0;
+  uint32_t now = millis();
+  if (batteryBarQuiet) {
+    // an unchanged bar is dropped by presentFrame()
+    capacity = batteryBarCapacity();
+    lockFrame();
+    fillFrame(RgbColor(0, 0, 0));
+    for (long i = 0; i <= capacity; i++) {
+      setPixel(i, red, green, blue);
+      setPixel((NUM_PIXELS - 1 - i), red, green, blue);
+    }
+    presentFrame();
+    unlockFrame();
+    batteryBarPixel = -1;
+    return;
+  }
+  if (batteryBarPixel < 0) {
+    capacity = batteryBarCapacity();
+    setAll(0, 0, 0);
+    barStart = now;
+    batteryBarPixel = 0;
+  }
+  if (batteryBarPixel <= capacity) {
+    lockFrame();
+    setPixel(batteryBarPixel, red, green, blue);
+    setPixel((NUM_PIXELS - 1 - batteryBarPixel), red, green, blue);
+    presentFrame();
+    unlockFrame();
+    if (++batteryBarPixel > capacity) {
+      filledAt = now;
+    }
+  } else if (now - filledAt >= 100 && now - barStart >= 1000) {
+    batteryBarPixel = -1;
+  }
+}
+
+void light_up() {
+  startBladeAnimation(BladeAnimation::IGNITE, IGNITION_DURATION,
+                      IGNITION_EASING, IGNITION_DELAY);
+}
+
+void light_down() {
+  startBladeAnimation(BladeAnimation::RETRACT, RETRACTION_DURATION,
+                      RETRACTION_EASING, RETRACTION_DELAY);
+}
+
+void onB1Click() {
+  file_pos = 0;
+  sword_on = !sword_on;
+  if (sword_on) {
+    saberPlatform->ignited();
+    saberPlatform->stopEffects();
+    if (currentAudioState == AudioState::STATIC) {
+      saberPlatform->stopSong();
+      saberPlatform->playFile("/hum.mp3", 0, true);
+    } else {
+      resumeCurrentSong();
+    }
+    saberPlatform->playEffect("poweron", false);
+    updateSmoothSwing();
+    light_up();
+  } else {
+    // the current stream keeps the mixer running until poweroff is over
+    saberPlatform->playEffect("poweroff", true);
+    updateSmoothSwing();
+    light_down();
+  }
+}
+
+void onB1DoubleClick() {
+  currentColorMode = (currentColorMode + 1) % COLORMODE_COUNT;
+  saberPlatform->save(Setting::COLOR_MODE, currentColorMode);
+}
+
+void onB1TripleClick() { saberPlatform->reportDebugInfo(); }
+
+void onB2Click() {
+  currentColor = (currentColor + 1) % COLOR_COUNT;
+  saberPlatform->save(Setting::COLOR, currentColor);
+  applyColor(static_cast<Color>(currentColor));
+}
+
+void onB2DoubleClick() {
+  currentSDFile = (currentSDFile + 1) % SD_FILE_COUNT;
+  internetRadioMode = false;
+  saberPlatform->save(Setting::SD_FILE, currentSDFile);
+  saberPlatform->save(Setting::INTERNET_RADIO, internetRadioMode);
+  file_pos = 0;
+  resumeCurrentSong();
+}
+
+void onB2TripleClick() {
+  currentStation = (currentStation + 1) % STATION_COUNT;
+  internetRadioMode = true;
+  saberPlatform->save(Setting::STATION, currentStation);
+  saberPlatform->save(Setting::INTERNET_RADIO, internetRadioMode);
+  resumeCurrentSong();
+}
+
+// Gestures from buttongesture.h; combo clicks are already filtered out there
+void saberButtonAction(const ButtonAction &action) {
+  if (updating) {
+    return;
+  }
+  bool first = action.button == 0;
+  switch (action.event) {
+  case ButtonEvent::RELEASED:
+    (first ? volUpActive : volDownActive) = false;
+    onCombo(action.combo);
+    break;
+  case ButtonEvent::LONG_PRESS:
+    (first ? volUpActive : volDownActive) = true;
+    break;
+  case ButtonEvent::CLICK:
+    first ? onB1Click() : onB2Click();
+    break;
+  case ButtonEvent::DOUBLE_CLICK:
+    first ? onB1DoubleClick() : onB2DoubleClick();
+    break;
+  case ButtonEvent::TRIPLE_CLICK:
+    first ? onB1TripleClick() : onB2TripleClick();
+    break;
+  default:
+    break;
+  }
+}
+
+// White strike flash drawn by the render task for the next durationMs
+void flashBlade(uint32_t durationMs) {
+  flashUntil = millis() + durationMs;
+  flashing = true;
+}
+
+bool playEffect(const char *type, int count) {
+  if (static_cast<AudioMode>(currentAudioMode) == AudioMode::SOUNDS) {
+    return false;
+  }
+  char fn[32];
+  snprintf(fn, sizeof(fn), "%s%d", type, count + 1);
+  if (saberPlatform->hasEffect(fn)) {
+    saberPlatform->playEffect(fn, false);
+    return true;
+  }
+  // not in the bank: the MP3 on SD takes over the decoder from the hum,
+  // updateStatic() brings the hum back
+  if (currentAudioState != AudioState::STATIC) {
+    return false;
+  }
+  char path[40];
+  snprintf(path, sizeof(path), "/%s.mp3", fn);
+  saberPlatform->playFile(path, 0, false);
+  return true;
+}
+
+// acc and gyr are the peaks over the samples since the last call
+void triggerEffects(float acc, float gyr) {
+  unsigned long now = millis();
+  MotionEvent event = detectMotion(detector, acc, gyr, now);
+  if (event == MotionEvent::NONE) {
+    return;
+  }
+  saberPlatform->motionEvent(event, event == MotionEvent::CLASH ? acc : gyr);
+  int idx = random(12);
+  if (event == MotionEvent::CLASH) {
+    if (playEffect("clash", idx)) {
+      effectStarted(detector, event, now, strikeDurations[idx]);
+    }
+    flashBlade(FLASH_DELAY);
+  } else if (!smoothSwingActive && playEffect("swing", idx)) {
+    effectStarted(detector, event, now, swingDurations[idx]);
+  }
+}
+
+void updateStatic() {
+  // decide from the published player state only once it is up to date
+  if (saberPlatform->audioPending()) {
+    return;
+  }
+  if (currentAudioState == AudioState::VIBE &&
+      static_cast<AudioMode>(currentAudioMode) == AudioMode::SWORD) {
+    saberPlatform->stopSong();
+    currentAudioState = AudioState::STATIC;
+  }
+  if (currentAudioState == AudioState::STATIC) {
+    // the hum loops in the decoder, only wait for e.g. poweron to finish
+    if (!saberPlatform->audioLooping() && !saberPlatform->audioPlaying()) {
+      saberPlatform->playFile("/hum.mp3", 0, true);
+    }
+  } else if (currentAudioState == AudioState::VIBE &&
+             !saberPlatform->audioPlaying() &&
+             (!internetRadioMode || saberPlatform->networkReady())) {
+    resumeCurrentSong();
+  }
+}
+
+// The render task's frame: strike flash, blade animation or color mode
+void composeFrame() {
+  if (flashing) {
+    if ((int32_t)(millis() - flashUntil) < 0) {
+      setAll(255, 255, 255);
+      return;
+    }
+    flashing = false;
+    setAll(red, green, blue);
+  }
+  if (updateBladeAnimation()) {
+    return;
+  }
+  if (BLINK_ALLOW && sword_on && !updating) {
+    applyColorMode(static_cast<ColorMode>(currentColorMode));
+  }
+}
@@ -0,0 +1,189 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+#include "histogram.h"
+
+// Cooperative deadline scheduler for the work loop() does. A job is released
+// every period (or once, after a delay) and should finish within its
+// deadline after the release. run() starts the released jobs one after the
+// other, earliest absolute deadline first, priority breaking ties, and each
+// at most once per call. A periodic job that fell more than a period behind
+// runs once for all the releases it missed instead of back to back, and
+// stays in phase. Per job, the start lateness and the finish past the
+// deadline go into histograms, in microseconds. The clock is a parameter so
+// the native tests can drive it. Plain C++ for the native tests.
+
+#define SCHEDULER_JOBS 10
+
+typedef void (*SchedulerFn)();
+typedef uint32_t (*SchedulerClock)(); // microseconds, may wrap
+
+struct SchedulerJob {
+  const char *name;
+  SchedulerFn fn;
+  uint32_t periodUs; // 0 for a one-shot
+  uint32_t deadlineUs;
+  uint32_t releaseUs; // next release
+  uint8_t priority;   // higher wins on equal deadlines
+  bool active;
+  uint32_t runs;
+  uint32_t skipped;  // releases dropped after a stall
+  uint32_t overruns; // finished past the deadline
+  uint32_t mark;     // run() call that last ran it
+  Histogram lateness; // release -> start
+  Histogram overrun;  // deadline -> finish, only when late
+};
+
+class Scheduler {
+public:
+  explicit Scheduler(SchedulerClock clock) : clock(clock) {}
+
+  // First release right away; deadline 0 means the period. -1 when full.
+  int every(const char *name, SchedulerFn fn, uint32_t periodUs,
+            uint8_t priority, uint32_t deadlineUs = 0) {
+    return add(name, fn, periodUs, clock(), priority,
+               deadlineUs ? deadlineUs : periodUs);
+  }
+
+  // One-shot, the slot is freed after it runs
+  int after(const char *name, SchedulerFn fn, uint32_t delayUs,
+            uint8_t priority, uint32_t deadlineUs) {
+    return add(name, fn, 0, clock() + delayUs, priority, deadlineUs);
+  }
+
+  // From the next release on, for jobs that slow down while idle; deadline
+  // 0 means the period
+  void setPeriod(int id, uint32_t periodUs, uint32_t deadlineUs = 0) {
+    if (id >= 0 && id < SCHEDULER_JOBS && jobs[id].periodUs) {
+      jobs[id].periodUs = periodUs;
+      jobs[id].deadlineUs = deadlineUs ? deadlineUs : periodUs;
+    }
+  }
+
+  // Releases a job now rather than at its next release
+  void wake(int id) {
+    uint32_t now = clock();
+    if (id >= 0 && id < SCHEDULER_JOBS && jobs[id].active &&
+        (int32_t)(jobs[id].releaseUs - now) > 0) {
+      jobs[id].releaseUs = now;
+    }
+  }
+
+  void cancel(int id) {
+    if (id >= 0 && id < SCHEDULER_JOBS) {
+      jobs[id].active = false;
+    }
+  }
+
+  // Runs what is released, returns microseconds until the next release
+  // (0 when one is already due, UINT32_MAX without jobs)
+  uint32_t run() {
+    calls++;
+    int id;
+    while ((id = nextDue(clock())) >= 0) {
+      runJob(jobs[id]);
+    }
+    return untilNext(clock());
+  }
+
+  uint32_t untilNext(uint32_t now) const {
+    uint32_t wait = UINT32_MAX;
+    for (const SchedulerJob &job : jobs) {
+      if (!job.active) {
+        continue;
+      }
+      int32_t left = job.releaseUs - now;
+      if (left <= 0) {
+        return 0;
+      }
+      if ((uint32_t)left < wait) {
+        wait = left;
+      }
+    }
+    return wait;
+  }
+
+  // Slot id, including inactive ones for the reports
+  const SchedulerJob &job(int id) const { return jobs[id]; }
+
+  void resetStats() {
+    for (SchedulerJob &job : jobs) {
+      job.runs = job.skipped = job.overruns = 0;
+      job.lateness.reset();
+      job.overrun.reset();
+    }
+  }
+
+private:
+  SchedulerClock clock;
+  SchedulerJob jobs[SCHEDULER_JOBS] = {};
+  uint32_t calls = 0;
+
+  int add(const char *name, SchedulerFn fn, uint32_t periodUs,
+          uint32_t releaseUs, uint8_t priority, uint32_t deadlineUs) {
+    for (int id = 0; id < SCHEDULER_JOBS; id++) {
+      SchedulerJob &job = jobs[id];
+      // a one-shot's slot is reused, its stats go with it
+      if (!job.active && (!job.name || !job.periodUs)) {
+        memset(&job, 0, sizeof(job));
+        job.name = name;
+        job.fn = fn;
+        job.periodUs = periodUs;
+        job.deadlineUs = deadlineUs;
+        job.releaseUs = releaseUs;
+        job.priority = priority;
+        job.active = true;
+        job.mark = calls;
+        return id;
+      }
+    }
+    return -1;
+  }
+
+  int nextDue(uint32_t now) const {
+    int best = -1;
+    int32_t bestDeadline = 0;
+    for (int id = 0; id < SCHEDULER_JOBS; id++) {
+      const SchedulerJob &job = jobs[id];
+      if (!job.active || job.mark == calls ||
+          (int32_t)(job.releaseUs - now) > 0) {
+        continue;
+      }
+      // relative to now, so the order survives the clock wrapping
+      int32_t deadline = job.releaseUs + job.deadlineUs - now;
+      if (best < 0 || deadline < bestDeadline ||
+          (deadline == bestDeadline && job.priority > jobs[best].priority)) {
+        best = id;
+        bestDeadline = deadline;
+      }
+    }
+    return best;
+  }
+
+  void runJob(SchedulerJob &job) {
+    uint32_t start = clock();
+    job.mark = calls;
+    job.lateness.record(start - job.releaseUs);
+    job.fn();
+    uint32_t finish = clock();
+    job.runs++;
+    int32_t late = finish - (job.releaseUs + job.deadlineUs);
+    if (late > 0) {
+      job.overruns++;
+      job.overrun.record(late);
+    }
+    if (!job.periodUs) {
+      job.active = false;
+      return;
+    }
+    // this run covers every release up to its start
+    job.releaseUs += job.periodUs;
+    int32_t behind = start - job.releaseUs;
+    if (behind >= 0) {
+      uint32_t missed = behind / job.periodUs + 1;
+      job.skipped += missed;
+      job.releaseUs += missed * job.periodUs;
+    }
+  }
+};
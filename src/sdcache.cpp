@@ -0,0 +1,326 @@
+#include "sdcache.h"
+
+#include <SD.h>
+#include <SPI.h>
+
+#include <atomic>
+#include <memory>
+
+#include "blockcache.h"
+#include "config.h"
+#include "debug.h"
+
+static BlockCache<SDCACHE_BLOCK_SIZE, SDCACHE_BLOCKS, SDCACHE_READ_AHEAD>
+    blocks;
+static HandleCache<File, SDCACHE_OPEN_FILES> handles;
+static SemaphoreHandle_t cacheMutex = NULL;
+static uint32_t clockHz = SD_SAFE_HZ;
+// set once sdInit() is done tuning, the card is left alone until then
+static std::atomic<bool> mounted{false};
+
+// audio task and loop() both open files
+struct CacheLock {
+  CacheLock() { xSemaphoreTake(cacheMutex, portMAX_DELAY); }
+  ~CacheLock() { xSemaphoreGive(cacheMutex); }
+};
+
+// Closes the parked handle of path before it is changed behind our back
+static void dropHandle(const char *path) {
+  File parked;
+  {
+    CacheLock lock;
+    handles.take(path, parked);
+  }
+  parked.close();
+}
+
+class CachedFile : public fs::FileImpl, public BlockSource {
+  File file;
+  uint32_t pos = 0;
+  bool cached; // read-only regular file, otherwise everything goes to SD
+
+public:
+  CachedFile(File sdFile, bool readOnly)
+      : file(sdFile), cached(readOnly && sdFile && !sdFile.isDirectory()) {
+    if (cached) {
+      CacheLock lock;
+      blocks.attach(*this);
+    }
+  }
+
+  ~CachedFile() override { close(); }
+
+  size_t readAt(uint32_t offset, uint8_t *out, size_t len) override {
+    return file.seek(offset) ? file.read(out, len) : 0;
+  }
+
+  size_t read(uint8_t *buf, size_t size) override {
+    if (!cached) {
+      return file.read(buf, size);
+    }
+    CacheLock lock;
+    size_t n = blocks.read(*this, pos, buf, size);
+    pos += n;
+    return n;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    return cached ? 0 : file.write(buf, size);
+  }
+
+  void flush() override { file.flush(); }
+
+  // like fseek(), except that it can't go past the end
+  bool seek(uint32_t offset, SeekMode mode) override {
+    if (!cached) {
+      return file.seek(offset, mode);
+    }
+    uint32_t base = mode == SeekCur ? pos : mode == SeekEnd ? file.size() : 0;
+    if (base + offset > file.size()) {
+      return false;
+    }
+    pos = base + offset;
+    return true;
+  }
+
+  size_t position() const override { return cached ? pos : file.position(); }
+  size_t size() const override { return file.size(); }
+
+  bool setBufferSize(size_t size) override {
+    return cached || file.setBufferSize(size);
+  }
+
+  // a read-only file is parked open for the next open() of its path
+  void close() override {
+    if (!file) {
+      return;
+    }
+    if (cached) {
+      File evicted;
+      {
+        CacheLock lock;
+        blocks.detach(*this);
+        evicted = handles.park(file.path(), file);
+      }
+      evicted.close();
+    } else {
+      file.close();
+    }
+    file = File();
+  }
+
+  time_t getLastWrite() override { return file.getLastWrite(); }
+  const char *path() const override { return file.path(); }
+  const char *name() const override { return file.name(); }
+  boolean isDirectory() override { return file.isDirectory(); }
+
+  fs::FileImplPtr openNextFile(const char *mode) override {
+    return std::make_shared<CachedFile>(file.openNextFile(mode), false);
+  }
+
+  boolean seekDir(long position) override { return file.seekDir(position); }
+  String getNextFileName() override { return file.getNextFileName(); }
+  String getNextFileName(bool *isDir) override {
+    return file.getNextFileName(isDir);
+  }
+  void rewindDirectory() override { file.rewindDirectory(); }
+  operator bool() override { return file; }
+};
+
+class CachedFS : public fs::FSImpl {
+public:
+  fs::FileImplPtr open(const char *path, const char *mode,
+                       const bool create) override {
+    if (!sdReady()) {
+      return fs::FileImplPtr();
+    }
+    bool readOnly = strcmp(mode, FILE_READ) == 0;
+    File file;
+    if (readOnly) {
+      CacheLock lock;
+      handles.take(path, file);
+    } else {
+      dropHandle(path);
+    }
+    if (!file) {
+      file = SD.open(path, mode, create);
+    }
+    if (!file) {
+      return fs::FileImplPtr();
+    }
+    return std::make_shared<CachedFile>(file, readOnly);
+  }
+
+  bool exists(const char *path) override {
+    if (!sdReady()) {
+      return false;
+    }
+    {
+      CacheLock lock;
+      if (handles.contains(path)) {
+        return true;
+      }
+    }
+    return SD.exists(path);
+  }
+
+  bool rename(const char *from, const char *to) override {
+    if (!sdReady()) {
+      return false;
+    }
+    dropHandle(from);
+    dropHandle(to);
+    return SD.rename(from, to);
+  }
+
+  bool remove(const char *path) override {
+    if (!sdReady()) {
+      return false;
+    }
+    dropHandle(path);
+    return SD.remove(path);
+  }
+
+  bool mkdir(const char *path) override {
+    return sdReady() && SD.mkdir(path);
+  }
+  bool rmdir(const char *path) override {
+    return sdReady() && SD.rmdir(path);
+  }
+};
+
+fs::FS sdCache(std::make_shared<CachedFS>());
+
+// FNV-1a over sectors spread across the card, CRC errors fail the read
+static bool probeCard(uint32_t &hash) {
+  uint8_t sector[512];
+  uint64_t count = SD.numSectors();
+  if (count < SD_TUNE_SECTORS) {
+    return false;
+  }
+  hash = 2166136261u;
+  for (uint32_t i = 0; i < SD_TUNE_SECTORS; i++) {
+    if (!SD.readRAW(sector, i * (count / SD_TUNE_SECTORS))) {
+      return false;
+    }
+    for (uint8_t byte : sector) {
+      hash = (hash ^ byte) * 16777619u;
+    }
+  }
+  return true;
+}
+
+// what the ESP32 SPI clock divider can make of 80 MHz
+static const uint32_t clocks[] = {40000000, 26666667, 20000000, 16000000,
+                                  13333333, 10000000, 8000000};
+
+bool sdInit() {
+  cacheMutex = xSemaphoreCreateMutex();
+  clockHz = SD_SAFE_HZ;
+  if (!SD.begin(SD_CS, SPI, SD_SAFE_HZ)) {
+    return false;
+  }
+  uint32_t reference;
+  if (!probeCard(reference)) {
+    LOG_W("SD probe failed, staying at %u kHz", clockHz / 1000);
+    mounted.store(true, std::memory_order_release);
+    return true;
+  }
+  for (uint32_t hz : clocks) {
+    if (hz > SD_MAX_HZ || hz <= SD_SAFE_HZ) {
+      continue;
+    }
+    SD.end();
+    bool stable = SD.begin(SD_CS, SPI, hz);
+    for (int pass = 0; stable && pass < SD_TUNE_PASSES; pass++) {
+      uint32_t hash;
+      stable = probeCard(hash) && hash == reference;
+    }
+    if (stable) {
+      clockHz = hz;
+      break;
+    }
+  }
+  if (clockHz == SD_SAFE_HZ) {
+    SD.end();
+    if (!SD.begin(SD_CS, SPI, SD_SAFE_HZ)) {
+      return false;
+    }
+  }
+  LOG_I("SD card at %u kHz", clockHz / 1000);
+  mounted.store(true, std::memory_order_release);
+  return true;
+}
+
+bool sdReady() { return mounted.load(std::memory_order_acquire); }
+
+uint32_t sdClockHz() { return clockHz; }
+
+static uint32_t timeOpen(fs::FS &fs, const char *path) {
+  uint32_t start = micros();
+  File file = fs.open(path);
+  uint32_t us = micros() - start;
+  file.close();
+  return us;
+}
+
+// KB/s reading up to SD_BENCH_BYTES in player sized chunks
+static uint32_t throughput(fs::FS &fs, const char *path) {
+  static uint8_t chunk[SD_BENCH_CHUNK];
+  File file = fs.open(path);
+  if (!file) {
+    return 0;
+  }
+  uint32_t total = 0;
+  uint32_t start = micros();
+  size_t n;
+  while (total < SD_BENCH_BYTES && (n = file.read(chunk, sizeof(chunk))) > 0) {
+    total += n;
+  }
+  uint32_t us = micros() - start;
+  us = max(us, (uint32_t)1);
+  file.close();
+  return (uint64_t)total * 1000000 / us / 1024;
+}
+
+static char benchPath[48];
+static std::atomic<bool> benchRunning{false};
+
+static void runBenchmark(const char *path) {
+  if (!SD.exists(path)) {
+    LOG_W("sdbench: %s not found", path);
+    return;
+  }
+  uint32_t coldOpen = timeOpen(SD, path);
+  timeOpen(sdCache, path); // parks the handle
+  uint32_t cachedOpen = timeOpen(sdCache, path);
+  uint32_t plainRate = throughput(SD, path);
+  blocks.resetStats();
+  uint32_t cachedRate = throughput(sdCache, path);
+  BlockCacheStats stats = blocks.stats();
+  LOG_I("sdbench %s at %u kHz: open %u us, parked %u us", path,
+        clockHz / 1000, coldOpen, cachedOpen);
+  LOG_I("sdbench read: %u KB/s, cached %u KB/s (%u hits, %u misses, %u "
+        "card reads)",
+        plainRate, cachedRate, stats.hits, stats.misses, stats.sourceReads);
+}
+
+static void benchTask(void *parameter) {
+  runBenchmark(benchPath);
+  benchRunning = false;
+  vTaskDelete(NULL);
+}
+
+bool sdBenchmark(const char *path) {
+  if (!sdReady() || benchRunning.exchange(true)) {
+    return false;
+  }
+  strlcpy(benchPath, path, sizeof(benchPath));
+  if (xTaskCreatePinnedToCore(benchTask, "sdbench", 3072, NULL,
+                              SDBENCHTASK_PRIO, NULL,
+                              SDBENCHTASK_CORE) != pdPASS) {
+    benchRunning = false;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+// SD card access for the audio player. sdInit() mounts the card at the
+// fastest SPI clock that reads back clean, and sdCache is an fs::FS over
+// SD whose read-only files go through a block cache with sequential
+// read-ahead (blockcache.h). Files the player closes stay open, so
+// restarting the hum or resuming a song skips the FAT directory walk.
+// Writes, renames and removals go straight to SD, after dropping any
+// parked handle of the file. Until sdInit() is done, sdCache has no files.
+
+extern fs::FS sdCache;
+
+// Instead of SD.begin(), false if there is no card. Takes a while with the
+// clock tuning, the storage task runs it (see bootStorage())
+bool sdInit();
+
+// True once sdInit() mounted the card, from any task
+bool sdReady();
+
+// The SPI clock sdInit() settled on
+uint32_t sdClockHz();
+
+// Logs open latency and sustained read throughput of path, through SD and
+// through sdCache. Runs for a second or so in a task of its own, false if the
+// card isn't mounted, a benchmark is already running or the task can't start
+bool sdBenchmark(const char *path);
@@ -0,0 +1,109 @@
+#include "settings.h"
+
+#include <nvs.h>
+
+#include "config.h"
+
+struct SettingInfo {
+  const char *name; // NVS key, as Preferences stored it before
+  bool flag;        // stored as u8 like Preferences::putBool()
+  uint32_t fallback;
+};
+
+static const SettingInfo settingInfo[] = {
+    {"color_mode", false, 0},
+    {"color", false, 0},
+    {"volume", false, 10},
+    {"station", false, 0},
+    {"sd_file", false, 0},
+    {"internet_radio", true, 0},
+};
+
+static_assert(sizeof(settingInfo) / sizeof(settingInfo[0]) ==
+                  static_cast<size_t>(Setting::COUNT),
+              "one entry per Setting");
+
+static nvs_handle_t handle = 0;
+static uint32_t values[static_cast<size_t>(Setting::COUNT)];
+static uint32_t stored[static_cast<size_t>(Setting::COUNT)];
+static uint32_t lastChange = 0;
+static bool dirty = false;
+static SettingsStats stats = {};
+
+bool settingsBegin() {
+  for (size_t i = 0; i < static_cast<size_t>(Setting::COUNT); i++) {
+    values[i] = settingInfo[i].fallback;
+  }
+  if (nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    handle = 0;
+    memcpy(stored, values, sizeof(stored));
+    return false;
+  }
+  for (size_t i = 0; i < static_cast<size_t>(Setting::COUNT); i++) {
+    if (settingInfo[i].flag) {
+      uint8_t flag;
+      if (nvs_get_u8(handle, settingInfo[i].name, &flag) == ESP_OK) {
+        values[i] = flag;
+      }
+    } else {
+      nvs_get_u32(handle, settingInfo[i].name, &values[i]);
+    }
+  }
+  memcpy(stored, values, sizeof(stored));
+  return true;
+}
+
+uint32_t settingsGet(Setting key) { return values[static_cast<size_t>(key)]; }
+
+void settingsSet(Setting key, uint32_t value) {
+  size_t i = static_cast<size_t>(key);
+  if (values[i] == value) {
+    return;
+  }
+  values[i] = value;
+  stats.changes++;
+  lastChange = millis();
+  dirty = true;
+}
+
+void settingsLoop() {
+  if (dirty && millis() - lastChange >= SETTINGS_QUIET_MS) {
+    settingsFlush();
+  }
+}
+
+void settingsFlush() {
+  if (!dirty || !handle) {
+    return;
+  }
+  bool written = false, failed = false;
+  for (size_t i = 0; i < static_cast<size_t>(Setting::COUNT); i++) {
+    // a value changed and changed back needs no write
+    if (values[i] == stored[i]) {
+      continue;
+    }
+    esp_err_t err = settingInfo[i].flag
+                        ? nvs_set_u8(handle, settingInfo[i].name, values[i])
+                        : nvs_set_u32(handle, settingInfo[i].name, values[i]);
+    if (err != ESP_OK) {
+      stats.errors++;
+      failed = true;
+      continue;
+    }
+    stored[i] = values[i];
+    stats.writes++;
+    written = true;
+  }
+  if (written) {
+    if (nvs_commit(handle) == ESP_OK) {
+      stats.commits++;
+    } else {
+      stats.errors++;
+    }
+  }
+  // retry failed keys after another quiet period
+  dirty = failed;
+  lastChange = millis();
+}
+
+SettingsStats settingsStats() { return stats; }
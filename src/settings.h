@@ -0,0 +1,37 @@
+#pragma once
+#include <Arduino.h>
+
+// Write-behind store for the saved preferences. Setters only update RAM and
+// mark the key dirty. settingsLoop() writes every dirty key and commits once
+// after SETTINGS_QUIET_MS without changes, settingsFlush() does it right away
+// before a restart or an OTA update. Call everything from the loop task.
+
+enum class Setting : uint8_t {
+  COLOR_MODE,
+  COLOR,
+  VOLUME,
+  STATION,
+  SD_FILE,
+  INTERNET_RADIO,
+  COUNT
+};
+
+struct SettingsStats {
+  uint32_t changes; // settingsSet() calls that changed a value
+  uint32_t writes;  // keys written to NVS
+  uint32_t commits;
+  uint32_t errors;
+};
+
+// Opens the NVS namespace and loads every key, missing ones get defaults
+bool settingsBegin();
+
+uint32_t settingsGet(Setting key);
+
+void settingsSet(Setting key, uint32_t value);
+
+void settingsLoop();
+
+void settingsFlush();
+
+SettingsStats settingsStats();
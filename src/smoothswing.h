@@ -0,0 +1,213 @@
+#pragma once
+#include <stdint.h>
+
+#include "config.h"
+#include "motionsample.h"
+#include "soundbank.h"
+
+// SmoothSwing: instead of firing a swing clip, two looping swing tones from
+// the sound bank play continuously at zero gain. Angular speed fades them in
+// over the hum (and ducks the hum), and the accumulated rotation crossfades
+// between the low and the high tone with equal power. Runs once per audio
+// block in the audio task, integer only. Plain C++ for the native benchmark.
+
+// sin(i * 90 deg / 64), Q15
+static const int16_t swingQuarterSine[65] = {
+    0,     804,   1608,  2410,  3212,  4011,  4808,  5602,  6393,  7179,
+    7962,  8739,  9512,  10278, 11039, 11793, 12539, 13279, 14010, 14732,
+    15446, 16151, 16846, 17530, 18204, 18868, 19519, 20159, 20787, 21403,
+    22005, 22594, 23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956, 30273, 30571,
+    30852, 31113, 31356, 31580, 31785, 31971, 32137, 32285, 32412, 32521,
+    32609, 32678, 32728, 32757, 32767};
+
+// x in 0..65535 for 0..90 deg, linearly interpolated
+inline int32_t swingSine(uint16_t x) {
+  uint32_t i = x >> 10, frac = x & 1023;
+  int32_t a = swingQuarterSine[i], b = swingQuarterSine[i + 1];
+  return a + (((b - a) * (int32_t)frac) >> 10);
+}
+
+inline uint32_t isqrt32(uint32_t n) {
+  uint32_t root = 0, bit = 1u << 30;
+  while (bit > n) {
+    bit >>= 2;
+  }
+  while (bit) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+
+// Peak gyro magnitude over a batch of samples, raw LSB
+inline uint32_t gyroPeakLsb(const MotionSample *samples, uint32_t count) {
+  uint32_t peak = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    int32_t x = samples[i].gyro[0], y = samples[i].gyro[1],
+            z = samples[i].gyro[2];
+    uint32_t squared =
+        (uint32_t)(x * x) + (uint32_t)(y * y) + (uint32_t)(z * z);
+    if (squared > peak) {
+      peak = squared;
+    }
+  }
+  return isqrt32(peak);
+}
+
+struct SwingLoop {
+  const SoundBankEntry *entry;
+  AdpcmDecoder decoder;
+  int16_t prev, next; // samples around the current position
+  uint32_t phase;     // Q16 position between prev and next
+  int32_t gain;       // Q16 of the Q8 gain, ramped per sample
+
+  void begin(const uint8_t *bank) {
+    decoder.begin(bank, *entry);
+    prev = 0;
+    next = decoder.next();
+    phase = 0;
+    gain = 0;
+  }
+
+  int16_t advance(const uint8_t *bank, uint32_t step) {
+    int32_t sample = prev + (((next - prev) * (int32_t)phase) >> 16);
+    phase += step;
+    while (phase >= 1 << 16) {
+      phase -= 1 << 16;
+      prev = next;
+      if (decoder.remaining == 0) {
+        decoder.begin(bank, *entry);
+      }
+      next = decoder.next();
+    }
+    return sample;
+  }
+};
+
+// thresholds in Q4 raw gyro LSB
+#define SWING_SPEED_Q4(dps)                                                    \
+  ((uint32_t)((dps) * MOTION_GYRO_LSB_PER_DPS * 16))
+
+struct SmoothSwing {
+  const uint8_t *bank;
+  uint32_t bankRate;
+  SwingLoop low, high;
+  bool on;      // false fades out, then the loops stop
+  bool running; // loops are being mixed
+  uint32_t speed;  // smoothed angular speed, Q4 raw gyro LSB
+  uint16_t angle;  // rotation through one SMOOTHSWING_PERIOD_DEG period
+  uint16_t level;  // swing strength 0..256
+  int32_t humGain; // Q16 of the Q8 stream gain
+
+  bool begin(const uint8_t *soundBank, const char *lowName,
+             const char *highName) {
+    auto header = soundBankHeader(soundBank);
+    bank = soundBank;
+    low.entry = soundBankFind(soundBank, lowName);
+    high.entry = soundBankFind(soundBank, highName);
+    running = false;
+    on = false;
+    if (!header || !low.entry || !high.entry || !low.entry->frames ||
+        !high.entry->frames) {
+      return false;
+    }
+    bankRate = header->sampleRate;
+    return true;
+  }
+
+  bool start() {
+    if (!low.entry || !high.entry) {
+      return false;
+    }
+    if (!running) {
+      low.begin(bank);
+      high.begin(bank);
+      speed = 0;
+      angle = 0;
+      level = 0;
+      humGain = 256 << 16;
+      running = true;
+    }
+    on = true;
+    return true;
+  }
+
+  void stop() { on = false; }
+
+  // Feeds the peak gyro magnitude seen since the previous block
+  void update(uint32_t gyroLsb, uint16_t frames, uint32_t streamRate) {
+    if (!running || !frames || !streamRate) {
+      return;
+    }
+    // one-pole low pass with a SMOOTHSWING_SMOOTH_MS time constant
+    uint32_t tau = SMOOTHSWING_SMOOTH_MS * streamRate / 1000;
+    int32_t alpha = ((uint32_t)frames << 8) / (frames + tau);
+    int32_t target = on ? gyroLsb << 4 : 0;
+    speed += ((target - (int32_t)speed) * alpha) >> 8;
+
+    const uint32_t threshold = SWING_SPEED_Q4(SMOOTHSWING_THRESHOLD_DPS);
+    const uint32_t full = SWING_SPEED_Q4(SMOOTHSWING_SENSITIVITY_DPS);
+    if (speed <= threshold) {
+      level = 0;
+    } else if (speed >= full) {
+      level = 256;
+    } else {
+      level = ((speed - threshold) << 8) / (full - threshold);
+    }
+
+    // rotation this block as a fraction of the crossfade period, Q16
+    // (MOTION_GYRO_LSB_PER_DPS as 328 / 10)
+    uint64_t turn = (uint64_t)speed * frames * 10 * 65536;
+    angle += turn / ((uint64_t)16 * 328 * SMOOTHSWING_PERIOD_DEG * streamRate);
+  }
+
+  // Ducks the stream under the swing and adds both loops, in place
+  void mix(int16_t *samples, uint16_t frames, uint8_t channels,
+           uint32_t streamRate, bool duckStream) {
+    if (!running || !frames) {
+      return;
+    }
+    // low -> high -> low over one period, equal power
+    uint16_t fade = angle < 32768 ? angle << 1 : (65535 - angle) << 1;
+    int32_t highShare = swingSine(fade);
+    int32_t lowShare = swingSine(65535 - fade);
+    int32_t swingGain = (level * SMOOTHSWING_GAIN) >> 8;
+    int32_t lowTarget = ((swingGain * lowShare) >> 15) << 16;
+    int32_t highTarget = ((swingGain * highShare) >> 15) << 16;
+    int32_t humTarget =
+        duckStream ? (256 - ((level * SMOOTHSWING_HUM_DUCKING) >> 8)) << 16
+                   : 256 << 16;
+
+    int32_t lowStep = (lowTarget - low.gain) / frames;
+    int32_t highStep = (highTarget - high.gain) / frames;
+    int32_t humStep = (humTarget - humGain) / frames;
+    uint32_t step = streamRate ? (bankRate << 16) / streamRate : 1 << 16;
+    int16_t *out = samples;
+    for (uint16_t f = 0; f < frames; f++) {
+      low.gain += lowStep;
+      high.gain += highStep;
+      humGain += humStep;
+      int32_t swing = low.advance(bank, step) * (low.gain >> 16) +
+                      high.advance(bank, step) * (high.gain >> 16);
+      for (uint8_t c = 0; c < channels; c++) {
+        int32_t mixed = (out[c] * (humGain >> 16) + swing) >> 8;
+        out[c] = mixed > INT16_MAX ? INT16_MAX
+                                   : (mixed < INT16_MIN ? INT16_MIN : mixed);
+      }
+      out += channels;
+    }
+    // land exactly on the targets, the steps round toward zero
+    low.gain = lowTarget;
+    high.gain = highTarget;
+    humGain = humTarget;
+    if (!on && speed == 0) {
+      running = false;
+    }
+  }
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+// Packed effect sound bank, built from sounds/*.mp3 by soundbank.py and
+// flashed raw into the spiffs partition. All fields are little-endian.
+//
+//   SoundBankHeader
+//   SoundBankEntry[count]
+//   IMA-ADPCM mono data, one stream per clip, low nibble first
+
+#define SOUNDBANK_MAGIC "LSB1"
+#define SOUNDBANK_NAME_LEN 16
+
+struct SoundBankHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t count;
+  uint32_t sampleRate;
+  uint32_t reserved;
+};
+
+struct SoundBankEntry {
+  char name[SOUNDBANK_NAME_LEN]; // file name without extension
+  uint32_t offset;               // from the start of the bank
+  uint32_t bytes;
+  uint32_t frames;
+  uint32_t durationMs; // of the source MP3
+};
+
+static_assert(sizeof(SoundBankHeader) == 16, "bank header layout");
+static_assert(sizeof(SoundBankEntry) == 32, "bank entry layout");
+
+inline const SoundBankHeader *soundBankHeader(const uint8_t *bank) {
+  auto header = reinterpret_cast<const SoundBankHeader *>(bank);
+  if (!bank || memcmp(header->magic, SOUNDBANK_MAGIC, 4) != 0 ||
+      header->version != 1) {
+    return nullptr;
+  }
+  return header;
+}
+
+inline const SoundBankEntry *soundBankEntries(const uint8_t *bank) {
+  return reinterpret_cast<const SoundBankEntry *>(bank +
+                                                  sizeof(SoundBankHeader));
+}
+
+inline const SoundBankEntry *soundBankFind(const uint8_t *bank,
+                                           const char *name) {
+  auto header = soundBankHeader(bank);
+  if (!header) {
+    return nullptr;
+  }
+  auto entries = soundBankEntries(bank);
+  for (uint16_t i = 0; i < header->count; i++) {
+    if (strncmp(entries[i].name, name, SOUNDBANK_NAME_LEN) == 0) {
+      return &entries[i];
+    }
+  }
+  return nullptr;
+}
+
+// Streaming IMA-ADPCM decoder, must match the encoder in soundbank.py
+struct AdpcmDecoder {
+  const uint8_t *data;
+  uint32_t remaining; // frames left
+  int32_t predictor;
+  int8_t index;
+  bool highNibble;
+
+  void begin(const uint8_t *bank, const SoundBankEntry &entry) {
+    data = bank + entry.offset;
+    remaining = entry.frames;
+    predictor = 0;
+    index = 0;
+    highNibble = false;
+  }
+
+  int16_t next() {
+    static const int16_t steps[89] = {
+        7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+        19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+        50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+        130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+        337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+        876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+        2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+        5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+        15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+    static const int8_t indexSteps[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+    if (remaining == 0) {
+      return 0;
+    }
+    remaining--;
+    uint8_t code = highNibble ? (*data++ >> 4) : (*data & 0x0F);
+    highNibble = !highNibble;
+    int32_t step = steps[index];
+    int32_t delta = step >> 3;
+    if (code & 4) {
+      delta += step;
+    }
+    if (code & 2) {
+      delta += step >> 1;
+    }
+    if (code & 1) {
+      delta += step >> 2;
+    }
+    predictor += (code & 8) ? -delta : delta;
+    if (predictor > 32767) {
+      predictor = 32767;
+    } else if (predictor < -32768) {
+      predictor = -32768;
+    }
+    index += indexSteps[code & 7];
+    if (index < 0) {
+      index = 0;
+    } else if (index > 88) {
+      index = 88;
+    }
+    return predictor;
+  }
+};
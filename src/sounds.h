@@ -0,0 +1,9 @@
+#pragma once
+
+// Clip durations in ms as reported by getdurations.py for sounds/clashN.mp3
+// and sounds/swingN.mp3, checked against the sound bank by the native tests.
+const unsigned long strikeDurations[12] = {1128, 744,  1056, 792,  1200, 1128,
+                                           1128, 1008, 648,  1128, 984,  984};
+
+const unsigned long swingDurations[12] = {576, 576, 576, 576, 576, 576,
+                                          504, 504, 672, 600, 552, 672};
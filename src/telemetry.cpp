@@ -0,0 +1,243 @@
+#include "telemetry.h"
+
+#include <ESPAsyncWebServer.h>
+
+#include <atomic>
+
+#include "audioqueue.h"
+#include "config.h"
+#include "debug.h"
+#include "motion.h"
+
+#define TELEMETRY_EVENTS 16 // per frame, power of two
+
+static AsyncWebSocket ws("/telemetry");
+static TaskHandle_t telemetryTaskHandle = NULL;
+static std::atomic<bool> streaming{false};
+static std::atomic<uint8_t> rateHz{TELEMETRY_RATE_HZ};
+static std::atomic<uint8_t> decimation{TELEMETRY_DECIMATION};
+
+// detection events, loop() -> telemetry task
+static TelemetryEvent events[TELEMETRY_EVENTS];
+static std::atomic<uint32_t> eventHead{0};
+static std::atomic<uint32_t> eventTail{0};
+
+// render task counters, taken and zeroed by every frame
+static std::atomic<uint32_t> renderFrames{0};
+static std::atomic<uint32_t> renderLate{0};
+static std::atomic<uint32_t> frameTimeTotal{0};
+static std::atomic<uint32_t> frameTimeMax{0};
+static std::atomic<uint32_t> showTimeTotal{0};
+static std::atomic<uint32_t> showTimeMax{0};
+
+// uint32_t for the MotionSample alignment
+static uint32_t frameBuffer[(sizeof(TelemetryHeader) + sizeof(TelemetryAudio) +
+                             sizeof(TelemetryRender) +
+                             TELEMETRY_EVENTS * sizeof(TelemetryEvent) +
+                             TELEMETRY_MAX_SAMPLES * sizeof(MotionSample)) /
+                            4];
+
+void telemetryEvent(MotionEvent event, float magnitude) {
+  if (!streaming.load(std::memory_order_relaxed)) {
+    return;
+  }
+  uint32_t head = eventHead.load(std::memory_order_relaxed);
+  if (head - eventTail.load(std::memory_order_acquire) >= TELEMETRY_EVENTS) {
+    return;
+  }
+  TelemetryEvent &slot = events[head & (TELEMETRY_EVENTS - 1)];
+  slot.millis = millis();
+  slot.type = static_cast<uint8_t>(event);
+  slot.reserved = 0;
+  slot.magnitude = min(magnitude * 100, 65535.0f);
+  eventHead.store(head + 1, std::memory_order_release);
+}
+
+void telemetryRenderFrame(uint32_t frameUs, uint32_t showUs, bool late) {
+  if (!streaming.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // single writer, a max lost to the reader's exchange is one frame's worth
+  renderFrames.fetch_add(1, std::memory_order_relaxed);
+  renderLate.fetch_add(late, std::memory_order_relaxed);
+  frameTimeTotal.fetch_add(frameUs, std::memory_order_relaxed);
+  showTimeTotal.fetch_add(showUs, std::memory_order_relaxed);
+  if (frameUs > frameTimeMax.load(std::memory_order_relaxed)) {
+    frameTimeMax.store(frameUs, std::memory_order_relaxed);
+  }
+  if (showUs > showTimeMax.load(std::memory_order_relaxed)) {
+    showTimeMax.store(showUs, std::memory_order_relaxed);
+  }
+}
+
+static uint16_t clampU16(uint32_t value) {
+  return min(value, (uint32_t)65535);
+}
+
+static void takeRender(TelemetryRender &render) {
+  uint32_t frames = renderFrames.exchange(0, std::memory_order_relaxed);
+  uint32_t divisor = max(frames, (uint32_t)1);
+  render.frames = clampU16(frames);
+  render.late = clampU16(renderLate.exchange(0, std::memory_order_relaxed));
+  render.frameAvgUs = clampU16(
+      frameTimeTotal.exchange(0, std::memory_order_relaxed) / divisor);
+  render.frameMaxUs =
+      clampU16(frameTimeMax.exchange(0, std::memory_order_relaxed));
+  render.showAvgUs = clampU16(
+      showTimeTotal.exchange(0, std::memory_order_relaxed) / divisor);
+  render.showMaxUs =
+      clampU16(showTimeMax.exchange(0, std::memory_order_relaxed));
+}
+
+static uint8_t takeEvents(TelemetryEvent *out) {
+  uint32_t tail = eventTail.load(std::memory_order_relaxed);
+  uint32_t head = eventHead.load(std::memory_order_acquire);
+  uint8_t count = 0;
+  for (; tail != head; tail++) {
+    out[count++] = events[tail & (TELEMETRY_EVENTS - 1)];
+  }
+  eventTail.store(tail, std::memory_order_release);
+  return count;
+}
+
+// Decimated samples since the last frame, anything past the cap is skipped
+static uint16_t takeSamples(MotionReader &reader,
+                            TelemetryDecimator &decimator, MotionSample *out,
+                            uint32_t &lost) {
+  uint16_t count = 0;
+  while (count < TELEMETRY_MAX_SAMPLES) {
+    size_t room = TELEMETRY_MAX_SAMPLES - count;
+    size_t read = motionRead(reader, out + count, room);
+    count += decimator.apply(out + count, read);
+    if (read < room) {
+      return count;
+    }
+  }
+  uint32_t unread = motionHead.load(std::memory_order_acquire) - reader.tail;
+  if ((int32_t)unread > 0) {
+    lost += unread / decimator.factor;
+    motionSkip(reader);
+  }
+  return count;
+}
+
+static void telemetryTask(void *parameter) {
+  MotionReader reader = {};
+  TelemetryDecimator decimator;
+  uint32_t seq = 0;
+  uint32_t readerDropped = 0;
+  uint32_t framesDropped = 0;
+  TickType_t lastWake = xTaskGetTickCount();
+  while (true) {
+    if (!ws.count()) {
+      streaming = false;
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+      ws.cleanupClients();
+      if (!ws.count()) {
+        continue;
+      }
+      // start from now, not from what piled up while nobody listened
+      motionSkip(reader);
+      readerDropped = reader.dropped;
+      eventTail.store(eventHead.load());
+      TelemetryRender discard;
+      takeRender(discard);
+      framesDropped = 0;
+      lastWake = xTaskGetTickCount();
+      streaming = true;
+    }
+    uint8_t rate = rateHz.load();
+    xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1000 / rate));
+    if (seq % rate == 0) {
+      ws.cleanupClients();
+    }
+
+    auto header = reinterpret_cast<TelemetryHeader *>(frameBuffer);
+    auto audio = reinterpret_cast<TelemetryAudio *>(header + 1);
+    auto render = reinterpret_cast<TelemetryRender *>(audio + 1);
+    auto frameEvents = reinterpret_cast<TelemetryEvent *>(render + 1);
+    uint8_t eventCount = takeEvents(frameEvents);
+    auto samples = reinterpret_cast<MotionSample *>(frameEvents + eventCount);
+    decimator.factor = decimation.load();
+    uint32_t lost = 0;
+    uint16_t imuCount = takeSamples(reader, decimator, samples, lost);
+    lost += (reader.dropped - readerDropped) / decimator.factor;
+    readerDropped = reader.dropped;
+
+    memcpy(header->magic, TELEMETRY_MAGIC, 2);
+    header->version = TELEMETRY_VERSION;
+    header->decimation = decimator.factor;
+    header->seq = seq++;
+    header->millis = millis();
+    header->imuCount = imuCount;
+    header->imuDropped = clampU16(lost);
+    header->eventCount = eventCount;
+    memset(header->reserved, 0, sizeof(header->reserved));
+    header->framesDropped = framesDropped;
+    AudioPlayerState state = audioGetState();
+    audio->playing = state.playing;
+    audio->looping = state.looping;
+    audio->voices = state.voices;
+    audio->volume = currentVolume;
+    audio->position = state.position;
+    audio->completedSeq = state.completedSeq;
+    takeRender(*render);
+
+    // skip rather than queue behind a slow client
+    if (!ws.availableForWriteAll()) {
+      framesDropped++;
+      continue;
+    }
+    ws.binaryAll(reinterpret_cast<uint8_t *>(frameBuffer),
+                 telemetryFrameSize(eventCount, imuCount));
+  }
+}
+
+static void onTelemetryEvent(AsyncWebSocket *server,
+                             AsyncWebSocketClient *client, AwsEventType type,
+                             void *arg, uint8_t *data, size_t len) {
+  if (type == WS_EVT_CONNECT) {
+    LOG_I("Telemetry client %lu connected", (unsigned long)client->id());
+    xTaskNotifyGive(telemetryTaskHandle);
+    return;
+  }
+  if (type == WS_EVT_DISCONNECT) {
+    LOG_I("Telemetry client %lu disconnected", (unsigned long)client->id());
+    return;
+  }
+  if (type != WS_EVT_DATA) {
+    return;
+  }
+  AwsFrameInfo *info = static_cast<AwsFrameInfo *>(arg);
+  if (!info->final || info->index != 0 || info->len != len ||
+      info->opcode != WS_TEXT) {
+    return;
+  }
+  char command[32];
+  size_t n = min(len, sizeof(command) - 1);
+  memcpy(command, data, n);
+  command[n] = '\0';
+  unsigned value;
+  if (sscanf(command, "rate %u", &value) == 1) {
+    rateHz = constrain(value, 1u, (unsigned)TELEMETRY_MAX_RATE_HZ);
+  } else if (sscanf(command, "decimate %u", &value) == 1) {
+    decimation = constrain(value, 1u, (unsigned)TELEMETRY_MAX_DECIMATION);
+  }
+  client->printf("rate %u decimate %u", rateHz.load(), decimation.load());
+}
+
+bool telemetryInit(AsyncWebServer &server) {
+  ws.onEvent(onTelemetryEvent);
+  ws.setAuthentication("admin", "admin");
+  server.addHandler(&ws);
+  return xTaskCreatePinnedToCore(telemetryTask,      /* Function to implement
+                                                        the task */
+                                 "telemetry",        /* Name of the task */
+                                 4096,               /* Stack size in words */
+                                 NULL,               /* Task input parameter */
+                                 TELEMETRYTASK_PRIO, /* Priority of the task */
+                                 &telemetryTaskHandle, /* Task handle. */
+                                 TELEMETRYTASK_CORE /* Core where the task
+                                                       should run */
+                                 ) == pdPASS;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <Arduino.h>
+
+#include "detect.h"
+#include "telemetryframe.h"
+
+class AsyncWebServer;
+
+// Live telemetry over the /telemetry WebSocket. While a client is connected,
+// a low priority task follows the motion ring with its own reader and, at
+// the client-selected rate, batches the decimated IMU samples, detection
+// events, player state and render timing into one binary frame (see
+// telemetryframe.h). A frame is skipped rather than queued when a client's
+// send queue is full, so a slow link never backs up into the firmware.
+// Clients send text commands: "rate <hz>", "decimate <n>".
+
+// Registers the WebSocket on the server, call before server.begin()
+bool telemetryInit(AsyncWebServer &server);
+
+// From the detection path, cheap when nobody is connected
+void telemetryEvent(MotionEvent event, float magnitude);
+
+// From the render task after every frame
+void telemetryRenderFrame(uint32_t frameUs, uint32_t showUs, bool late);
@@ -0,0 +1,84 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "motionsample.h"
+
+// Binary telemetry frame sent over the /telemetry WebSocket, little endian:
+// a TelemetryHeader, TelemetryAudio, TelemetryRender, header.eventCount
+// TelemetryEvents and header.imuCount raw MotionSamples, back to back. Plain
+// C++ so dashboards and the native tests share the layout.
+
+#define TELEMETRY_MAGIC "LT"
+#define TELEMETRY_VERSION 1
+
+struct TelemetryHeader {
+  char magic[2];
+  uint8_t version;
+  uint8_t decimation; // every n-th motion sample is sent
+  uint32_t seq;
+  uint32_t millis;
+  uint16_t imuCount;
+  uint16_t imuDropped;  // samples lost since the last frame, ring or cap
+  uint8_t eventCount;
+  uint8_t reserved[3];
+  uint32_t framesDropped; // frames skipped for backpressure since connect
+};
+
+// Published player state when the frame was built
+struct TelemetryAudio {
+  uint8_t playing;
+  uint8_t looping;
+  uint8_t voices;
+  uint8_t volume;
+  uint32_t position;
+  uint32_t completedSeq;
+};
+
+// Render task frames since the last telemetry frame, times in us
+struct TelemetryRender {
+  uint16_t frames;
+  uint16_t late;
+  uint16_t frameAvgUs;
+  uint16_t frameMaxUs;
+  uint16_t showAvgUs;
+  uint16_t showMaxUs;
+};
+
+// A detection that fired, magnitude in m/s^2 (clash) or rad/s (swing) x 100
+struct TelemetryEvent {
+  uint32_t millis;
+  uint8_t type; // MotionEvent
+  uint8_t reserved;
+  uint16_t magnitude;
+};
+
+static_assert(sizeof(TelemetryHeader) == 24, "wire layout");
+static_assert(sizeof(TelemetryAudio) == 12, "wire layout");
+static_assert(sizeof(TelemetryRender) == 12, "wire layout");
+static_assert(sizeof(TelemetryEvent) == 8, "wire layout");
+
+inline size_t telemetryFrameSize(uint8_t events, uint16_t samples) {
+  return sizeof(TelemetryHeader) + sizeof(TelemetryAudio) +
+         sizeof(TelemetryRender) + events * sizeof(TelemetryEvent) +
+         samples * sizeof(MotionSample);
+}
+
+// Keeps every factor-th sample of a stream read in batches of any size
+struct TelemetryDecimator {
+  uint8_t factor = 1;
+  uint8_t phase = 0; // samples to skip before the next kept one
+
+  // Compacts the kept samples to the front, returns how many there are
+  size_t apply(MotionSample *samples, size_t count) {
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+      if (phase == 0) {
+        samples[kept++] = samples[i];
+        phase = factor;
+      }
+      phase--;
+    }
+    return kept;
+  }
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+#include "motionsample.h"
+
+// IMU trace file: a TraceHeader followed by raw MotionSamples, little endian,
+// exactly as the motion ring holds them. Written by the recorder, read by
+// tools/replay.
+
+#define TRACE_MAGIC "LIMU"
+#define TRACE_VERSION 1
+
+struct TraceHeader {
+  char magic[4];
+  uint16_t version;
+  uint16_t rateHz;
+  float accelLsbPerG;
+  float gyroLsbPerDps;
+  uint32_t samples; // patched in when the recording stops
+  uint32_t dropped; // samples the recorder lost to the ring wrapping
+  uint32_t reserved[2];
+};
+
+static_assert(sizeof(TraceHeader) == 32, "on-disk layout");
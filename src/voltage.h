@@ -3,11 +3,24 @@
 #include <esp_adc/adc_cali_scheme.h>
 #include <esp_adc/adc_oneshot.h>
 
+#include <atomic>
+
+#include "audioqueue.h"
 #include "config.h"
+#include "led.h"
+#include "power.h"
+
+// Battery monitor. A low priority task takes a short burst of one-shot reads
+// every BATTERY_PERIOD_MS, keeps the median, adds back the sag caused by the
+// current LED and audio load and smooths the result with an EMA. Readers only
+// ever see the cached voltage and state of charge.
 
 adc_oneshot_unit_handle_t adc_unit_handle;
 adc_cali_handle_t cali_handle = NULL;
 
+std::atomic<uint16_t> batteryMillivolts{0};
+std::atomic<uint8_t> batteryPercent{0};
+
 void calibrate_voltage() {
   adc_oneshot_unit_init_cfg_t init_cfg = {
       .unit_id = ADC_UNIT,
@@ -27,22 +40,6 @@ void calibrate_voltage() {
   ESP_ERROR_CHECK(adc_cali_create_scheme_line_fitting(&cfg, &cali_handle));
 }
 
-float read_voltage() {
-  int adc_reading = 0;
-  for (int i = 0; i < NO_OF_SAMPLES; i++) {
-    int temp;
-    ESP_ERROR_CHECK(adc_oneshot_read(adc_unit_handle, ADC_CHANNEL, &temp));
-    adc_reading += temp;
-  }
-  adc_reading /= NO_OF_SAMPLES;
-  int voltage_mv = 0;
-  ESP_ERROR_CHECK(
-      adc_cali_raw_to_voltage(cali_handle, adc_reading, &voltage_mv));
-  voltage_mv *= DIVIDER_COEFFICIENT;
-  voltage_mv += VOLTAGE_FIXUP;
-  return voltage_mv / 1000.0;
-}
-
 const int N_POINTS = 22;
 const float voltageTable[N_POINTS] = {
     4.20, 4.15, 4.11, 4.08, 4.02, 3.98, 3.95, 3.91, 3.87, 3.85, 3.84,
@@ -68,9 +65,110 @@ int voltageToPercent(float v) {
   return 0;
 }
 
+// voltageToPercent() sampled every 10 mV, built once by batteryInit()
+#define SOC_TABLE_MIN_MV 3000
+#define SOC_TABLE_STEP_MV 10
+#define SOC_TABLE_SIZE ((4200 - SOC_TABLE_MIN_MV) / SOC_TABLE_STEP_MV + 1)
+uint8_t socTable[SOC_TABLE_SIZE];
+
+uint8_t millivoltsToPercent(uint32_t mv) {
+  if (mv <= SOC_TABLE_MIN_MV) {
+    return socTable[0];
+  }
+  uint32_t i = (mv - SOC_TABLE_MIN_MV) / SOC_TABLE_STEP_MV;
+  return i < SOC_TABLE_SIZE ? socTable[i] : 100;
+}
+
+static int medianOf(int *values, int count) {
+  for (int i = 1; i < count; i++) {
+    int v = values[i], j = i - 1;
+    for (; j >= 0 && values[j] > v; j--) {
+      values[j + 1] = values[j];
+    }
+    values[j + 1] = v;
+  }
+  return values[count / 2];
+}
+
+// Estimated draw of what is running right now, in mA
+static uint32_t batteryLoadMa() {
+  uint32_t led = uint64_t(frameChannelSum()) * LED_MA_PER_CHANNEL *
+                 strip.GetLuminance() / (255 * 255);
+  uint32_t audioLoad =
+      audioGetState().playing ? AUDIO_LOAD_MA * currentVolume / 21 : 0;
+  return led + audioLoad;
+}
+
+static bool sampleBattery(uint32_t &mv) {
+  int reads[BATTERY_BURST];
+  for (int i = 0; i < BATTERY_BURST; i++) {
+    if (adc_oneshot_read(adc_unit_handle, ADC_CHANNEL, &reads[i]) != ESP_OK) {
+      return false;
+    }
+  }
+  int voltage_mv = 0;
+  if (adc_cali_raw_to_voltage(cali_handle, medianOf(reads, BATTERY_BURST),
+                              &voltage_mv) != ESP_OK) {
+    return false;
+  }
+  mv = voltage_mv * DIVIDER_COEFFICIENT + VOLTAGE_FIXUP +
+       batteryLoadMa() * BATTERY_RESISTANCE_MOHM / 1000;
+  return true;
+}
+
+static uint32_t batteryEma = 0; // Q(BATTERY_EMA_SHIFT) millivolts
+
+static void updateBattery() {
+  uint32_t mv;
+  if (!sampleBattery(mv)) {
+    return;
+  }
+  if (batteryEma == 0) {
+    batteryEma = mv << BATTERY_EMA_SHIFT;
+  } else {
+    batteryEma += mv - (batteryEma >> BATTERY_EMA_SHIFT);
+  }
+  uint32_t filtered = batteryEma >> BATTERY_EMA_SHIFT;
+  batteryMillivolts.store(filtered, std::memory_order_relaxed);
+  batteryPercent.store(millivoltsToPercent(filtered),
+                       std::memory_order_relaxed);
+}
+
+void batteryTask(void *parameter) {
+  TickType_t lastWake = xTaskGetTickCount();
+  while (true) {
+    // the EMA averages over ~16 periods, still fine at the idle period
+    xTaskDelayUntil(&lastWake, pdMS_TO_TICKS(powerIdle() ? POWER_IDLE_MS
+                                                         : BATTERY_PERIOD_MS));
+    updateBattery();
+  }
+}
+
+// Call after calibrate_voltage() and renderInit(), the task locks the frame
+void batteryInit() {
+  for (int i = 0; i < SOC_TABLE_SIZE; i++) {
+    socTable[i] =
+        voltageToPercent((SOC_TABLE_MIN_MV + i * SOC_TABLE_STEP_MV) / 1000.0);
+  }
+  // seed the cache so readers never see an empty value
+  updateBattery();
+  xTaskCreatePinnedToCore(batteryTask,      /* Function to implement the task
+                                             */
+                          "battery",        /* Name of the task */
+                          2048,             /* Stack size in words */
+                          NULL,             /* Task input parameter */
+                          BATTERYTASK_PRIO, /* Priority of the task */
+                          NULL,             /* Task handle. */
+                          BATTERYTASK_CORE  /* Core where the task should run
+                                             */
+  );
+}
+
+// Filtered and load compensated
+float read_voltage() {
+  return batteryMillivolts.load(std::memory_order_relaxed) / 1000.0;
+}
+
 uint8_t get_battery_percentage() {
-  float voltage = read_voltage();
-  float perc = voltageToPercent(voltage);
-  perc = constrain(perc, 0.0, 100.0);
-  return perc;
-}
\ No newline at end of file
+  return batteryPercent.load(std::memory_order_relaxed);
+}
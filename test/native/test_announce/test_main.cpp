@@ -0,0 +1,39 @@
+#include <unity.h>
+
+#include "announce.h"
+
+// Announcement tokens: each one names a clip in the bank and the words the
+// online fallback speaks in its place.
+
+void setUp() {}
+void tearDown() {}
+
+void test_tokens_map_to_clips() {
+  TEST_ASSERT_EQUAL_STRING("say0", announceClip('0'));
+  TEST_ASSERT_EQUAL_STRING("say9", announceClip('9'));
+  TEST_ASSERT_EQUAL_STRING("saypoint", announceClip('.'));
+  TEST_ASSERT_EQUAL_STRING("sayip", announceClip('I'));
+  TEST_ASSERT_NULL(announceClip('x'));
+  TEST_ASSERT_NULL(announceWords('x'));
+}
+
+// the online fallback says what the clips would have said
+void test_announce_speech() {
+  char text[128];
+  announceSpeech("I10.0.4.1", text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING(
+      "My IP address is one zero point zero point four point one", text);
+  announceSpeech("B3.87V54%", text, sizeof(text));
+  TEST_ASSERT_EQUAL_STRING("Battery voltage is three point eight seven volts "
+                           "five four percent",
+                           text);
+  TEST_ASSERT_EQUAL(16u, announceSpeech("I1", text, 20));
+  TEST_ASSERT_EQUAL_STRING("My IP address is", text);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tokens_map_to_clips);
+  RUN_TEST(test_announce_speech);
+  return UNITY_END();
+}
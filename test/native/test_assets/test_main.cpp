@@ -0,0 +1,148 @@
+#include <cstdio>
+#include <vector>
+
+#include <unity.h>
+
+#include "assetstore.h"
+#include "crc32.h"
+
+// Hot asset sync decisions: where the area goes after the sound bank, what
+// fits, which files have to be read and copied again, and that a manifest
+// only matches when every SD file is unchanged.
+
+static const uint32_t PARTITION = 0x70000;
+
+void setUp() {}
+void tearDown() {}
+
+static AssetSource source(const char *name, const std::vector<uint8_t> &data,
+                          uint32_t mtime = 1700000000) {
+  return {name, (uint32_t)data.size(), mtime,
+          crc32Update(0, data.data(), data.size())};
+}
+
+void test_area_follows_the_bank() {
+  TEST_ASSERT_EQUAL(0, assetAreaStart(0));
+  TEST_ASSERT_EQUAL(ASSET_SECTOR, assetAreaStart(1));
+  TEST_ASSERT_EQUAL(ASSET_SECTOR, assetAreaStart(ASSET_SECTOR));
+  TEST_ASSERT_EQUAL(0x5F000, assetAreaStart(0x5E001));
+}
+
+void test_layout_in_priority_order() {
+  std::vector<uint8_t> hum(105741, 1), carrier(32044, 2);
+  AssetSource sources[] = {source("/hum.mp3", hum),
+                           source("/silence.wav", carrier)};
+  uint32_t start = assetAreaStart(300000);
+  AssetManifest manifest = assetLayout(sources, 2, start, PARTITION - start);
+  TEST_ASSERT_EQUAL(2, manifest.count);
+  TEST_ASSERT_EQUAL(start, manifest.areaStart);
+  const AssetEntry *entry = assetFind(manifest, "/hum.mp3");
+  TEST_ASSERT_NOT_NULL(entry);
+  TEST_ASSERT_EQUAL(ASSET_SECTOR, entry->offset);
+  TEST_ASSERT_EQUAL(hum.size(), entry->size);
+  entry = assetFind(manifest, "/silence.wav");
+  TEST_ASSERT_NOT_NULL(entry);
+  // a file owns its sectors, rewriting one leaves the others alone
+  TEST_ASSERT_EQUAL(0, entry->offset % ASSET_SECTOR);
+  TEST_ASSERT_TRUE(entry->offset >= ASSET_SECTOR + hum.size());
+  TEST_ASSERT_NULL(assetFind(manifest, "/song.mp3"));
+  TEST_ASSERT_EQUAL(0, assetAreaUsed(manifest) % ASSET_SECTOR);
+  TEST_ASSERT_TRUE(assetAreaUsed(manifest) >= entry->offset + entry->size);
+}
+
+// a large bank leaves no room for the hum, the small carrier still fits
+void test_what_does_not_fit_stays_on_sd() {
+  std::vector<uint8_t> hum(105741, 1), carrier(32044, 2);
+  AssetSource sources[] = {source("/hum.mp3", hum),
+                           source("/silence.wav", carrier),
+                           {"/a/path/much/too/long/for/it.mp3", 10, 0, 0}};
+  uint32_t start = assetAreaStart(PARTITION - 60000);
+  AssetManifest manifest = assetLayout(sources, 3, start, PARTITION - start);
+  TEST_ASSERT_EQUAL(1, manifest.count);
+  TEST_ASSERT_NULL(assetFind(manifest, "/hum.mp3"));
+  TEST_ASSERT_NOT_NULL(assetFind(manifest, "/silence.wav"));
+  TEST_ASSERT_TRUE(start + assetAreaUsed(manifest) <= PARTITION);
+}
+
+void test_any_change_resyncs() {
+  std::vector<uint8_t> hum(50000, 1), carrier(32044, 2);
+  uint32_t start = assetAreaStart(200000);
+  AssetSource sources[] = {source("/hum.mp3", hum),
+                           source("/silence.wav", carrier)};
+  AssetManifest synced = assetLayout(sources, 2, start, PARTITION - start);
+  AssetManifest same = assetLayout(sources, 2, start, PARTITION - start);
+  TEST_ASSERT_TRUE(memcmp(&synced, &same, sizeof(synced)) == 0);
+
+  hum[1234] ^= 1; // same size, saved again
+  sources[0] = source("/hum.mp3", hum, 1700000100);
+  AssetManifest edited = assetLayout(sources, 2, start, PARTITION - start);
+  TEST_ASSERT_FALSE(memcmp(&synced, &edited, sizeof(synced)) == 0);
+
+  // the bank grew into the area
+  AssetManifest moved = assetLayout(sources, 2, assetAreaStart(210000),
+                                    PARTITION - assetAreaStart(210000));
+  TEST_ASSERT_FALSE(memcmp(&edited, &moved, sizeof(edited)) == 0);
+
+  // the hum was deleted from the card
+  AssetManifest fewer = assetLayout(sources + 1, 1, start, PARTITION - start);
+  TEST_ASSERT_FALSE(memcmp(&edited, &fewer, sizeof(edited)) == 0);
+}
+
+// only new and changed files are read, and only what moved is rewritten
+void test_unchanged_files_stay() {
+  std::vector<uint8_t> hum(50000, 1), carrier(32044, 2);
+  uint32_t start = assetAreaStart(200000);
+  AssetSource sources[] = {source("/hum.mp3", hum),
+                           source("/silence.wav", carrier)};
+  AssetManifest current = assetLayout(sources, 2, start, PARTITION - start);
+
+  // the sync doesn't know the CRC of what it only looked at
+  AssetSource seen = {"/silence.wav", (uint32_t)carrier.size(), 1700000000, 0};
+  const AssetEntry *known = assetUnchanged(current, seen);
+  TEST_ASSERT_NOT_NULL(known);
+  TEST_ASSERT_EQUAL_UINT32(sources[1].crc, known->crc);
+  seen.mtime++;
+  TEST_ASSERT_NULL(assetUnchanged(current, seen));
+  seen.mtime--;
+  seen.size--;
+  TEST_ASSERT_NULL(assetUnchanged(current, seen));
+  seen.name = "/song.mp3";
+  TEST_ASSERT_NULL(assetUnchanged(current, seen));
+
+  // a hum edited in place keeps the carrier's sectors
+  sources[0] = {"/hum.mp3", (uint32_t)hum.size(), 1700000100, 0};
+  AssetManifest wanted = assetLayout(sources, 2, start, PARTITION - start);
+  TEST_ASSERT_FALSE(assetInPlace(current, wanted.entries[0]));
+  TEST_ASSERT_TRUE(assetInPlace(current, wanted.entries[1]));
+
+  // a hum grown past its sectors moves the carrier too
+  sources[0].size += ASSET_SECTOR;
+  wanted = assetLayout(sources, 2, start, PARTITION - start);
+  TEST_ASSERT_FALSE(assetInPlace(current, wanted.entries[0]));
+  TEST_ASSERT_FALSE(assetInPlace(current, wanted.entries[1]));
+}
+
+void test_erased_flash_is_no_manifest() {
+  AssetManifest erased;
+  memset(&erased, 0xFF, sizeof(erased));
+  TEST_ASSERT_NULL(assetFind(erased, "/hum.mp3"));
+  AssetManifest empty = {};
+  TEST_ASSERT_NULL(assetFind(empty, "/hum.mp3"));
+
+  // a manifest of the older layout is synced over
+  AssetSource sources[] = {{"/hum.mp3", 100, 0, 0}};
+  AssetManifest old = assetLayout(sources, 1, 0, PARTITION);
+  old.version = 1;
+  TEST_ASSERT_NULL(assetFind(old, "/hum.mp3"));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_area_follows_the_bank);
+  RUN_TEST(test_layout_in_priority_order);
+  RUN_TEST(test_what_does_not_fit_stays_on_sd);
+  RUN_TEST(test_any_change_resyncs);
+  RUN_TEST(test_unchanged_files_stay);
+  RUN_TEST(test_erased_flash_is_no_manifest);
+  return UNITY_END();
+}
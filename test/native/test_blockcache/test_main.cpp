@@ -0,0 +1,204 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unity.h>
+
+#include "blockcache.h"
+#include "config.h"
+
+// SD block cache: reads through it match the file at any offset and length,
+// read-ahead turns a sequential stream into few large card reads, and the
+// parked handle table. The benchmark prices card reads with a simple SPI
+// cost model, a fixed command round trip plus the transfer at the clock.
+
+#define CMD_US 300.0  // command, card busy until the data token, FatFs
+#define OPEN_READS 3  // FAT directory sectors walked by a cold open
+
+typedef BlockCache<SDCACHE_BLOCK_SIZE, SDCACHE_BLOCKS, SDCACHE_READ_AHEAD>
+    Cache;
+
+struct FakeFile : BlockSource {
+  std::vector<uint8_t> data;
+  uint32_t reads = 0;
+  uint64_t bytes = 0;
+
+  explicit FakeFile(size_t size, uint32_t seed = 1) : data(size) {
+    for (size_t i = 0; i < size; i++) {
+      seed = seed * 1103515245 + 12345;
+      data[i] = seed >> 24;
+    }
+  }
+
+  size_t readAt(uint32_t offset, uint8_t *out, size_t len) override {
+    reads++;
+    if (offset >= data.size()) {
+      return 0;
+    }
+    size_t n = std::min(len, data.size() - offset);
+    memcpy(out, &data[offset], n);
+    bytes += n;
+    return n;
+  }
+
+  double cardUs(double mhz) const { return reads * CMD_US + bytes * 8 / mhz; }
+};
+
+static Cache cache;
+
+void setUp() { srand(1); }
+void tearDown() {}
+
+void test_reads_match_file() {
+  FakeFile file(100000);
+  cache.attach(file);
+  std::vector<uint8_t> out(5000);
+  for (int i = 0; i < 5000; i++) {
+    uint32_t offset = rand() % (file.data.size() + 100);
+    size_t len = rand() % out.size();
+    size_t expect =
+        offset < file.data.size() ? std::min(len, file.data.size() - offset)
+                                  : 0;
+    TEST_ASSERT_EQUAL(expect, cache.read(file, offset, out.data(), len));
+    TEST_ASSERT_TRUE(expect == 0 ||
+                     memcmp(out.data(), &file.data[offset], expect) == 0);
+  }
+  cache.detach(file);
+}
+
+void test_sequential_reads_ahead() {
+  FakeFile file(200000);
+  cache.attach(file);
+  uint8_t chunk[SD_BENCH_CHUNK];
+  uint32_t offset = 0;
+  size_t n;
+  while ((n = cache.read(file, offset, chunk, sizeof(chunk))) > 0) {
+    TEST_ASSERT_TRUE(memcmp(chunk, &file.data[offset], n) == 0);
+    offset += n;
+  }
+  TEST_ASSERT_EQUAL(file.data.size(), offset);
+  // the first block alone, then a run per miss
+  size_t run = SDCACHE_BLOCK_SIZE * SDCACHE_READ_AHEAD;
+  TEST_ASSERT_UINT32_WITHIN(2, file.data.size() / run + 1, file.reads);
+  cache.detach(file);
+}
+
+void test_random_reads_fetch_one_block() {
+  FakeFile file(1000000);
+  cache.attach(file);
+  uint8_t out[100];
+  for (int i = 0; i < 100; i++) {
+    // even blocks only, a read never continues where the last one ended
+    uint32_t block = (rand() % 450) * 2;
+    cache.read(file, block * SDCACHE_BLOCK_SIZE + 10, out, sizeof(out));
+  }
+  TEST_ASSERT_EQUAL(file.bytes, (uint64_t)file.reads * SDCACHE_BLOCK_SIZE);
+  cache.detach(file);
+}
+
+void test_files_share_the_cache() {
+  FakeFile hum(50000, 2), song(50000, 3);
+  cache.attach(hum);
+  cache.attach(song);
+  uint8_t a[700], b[700];
+  for (uint32_t offset = 0; offset < 40000; offset += 700) {
+    cache.read(hum, offset, a, sizeof(a));
+    cache.read(song, offset, b, sizeof(b));
+    TEST_ASSERT_TRUE(memcmp(a, &hum.data[offset], sizeof(a)) == 0);
+    TEST_ASSERT_TRUE(memcmp(b, &song.data[offset], sizeof(b)) == 0);
+  }
+  cache.detach(hum);
+  cache.detach(song);
+}
+
+void test_detach_forgets_blocks() {
+  FakeFile file(10000, 4);
+  uint8_t out[16];
+  cache.attach(file);
+  cache.read(file, 0, out, sizeof(out));
+  cache.detach(file);
+  file.data[0] ^= 0xFF; // rewritten while closed
+  cache.attach(file);
+  cache.read(file, 0, out, sizeof(out));
+  TEST_ASSERT_EQUAL(file.data[0], out[0]);
+  cache.detach(file);
+}
+
+void test_parked_handles() {
+  HandleCache<int, 2, 16> handles;
+  int handle = 0;
+  TEST_ASSERT_FALSE(handles.take("/hum.mp3", handle));
+  TEST_ASSERT_EQUAL(0, handles.park("/hum.mp3", 1));
+  TEST_ASSERT_EQUAL(0, handles.park("/song.mp3", 2));
+  TEST_ASSERT_TRUE(handles.contains("/hum.mp3"));
+  TEST_ASSERT_TRUE(handles.take("/hum.mp3", handle));
+  TEST_ASSERT_EQUAL(1, handle);
+  TEST_ASSERT_FALSE(handles.contains("/hum.mp3"));
+  TEST_ASSERT_EQUAL(0, handles.park("/hum.mp3", 1));
+  // full: the oldest goes back to the caller to close
+  TEST_ASSERT_EQUAL(2, handles.park("/other.mp3", 3));
+  TEST_ASSERT_FALSE(handles.contains("/song.mp3"));
+  TEST_ASSERT_EQUAL(4, handles.park("/a/much/too/long/path.mp3", 4));
+}
+
+// Sustained MP3-player reads at the clocks the probe can settle on, with the
+// player's reads going to the card one by one vs through the cache
+void test_benchmark() {
+  const size_t SIZE = 4 * 1024 * 1024;
+  FakeFile plain(SIZE), cached(SIZE);
+  static uint8_t chunk[SD_BENCH_CHUNK];
+  for (uint32_t offset = 0; offset < SIZE; offset += sizeof(chunk)) {
+    plain.readAt(offset, chunk, sizeof(chunk));
+  }
+  cache.attach(cached);
+  cache.resetStats();
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t offset = 0; offset < SIZE; offset += sizeof(chunk)) {
+    cache.read(cached, offset, chunk, sizeof(chunk));
+  }
+  double hostNs = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  BlockCacheStats stats = cache.stats();
+  cache.detach(cached);
+  printf("%zu B reads: %u card reads plain, %u cached (%u hits, %u misses),"
+         " cache overhead %.2f ns/byte on this host\n",
+         sizeof(chunk), plain.reads, cached.reads, stats.hits, stats.misses,
+         hostNs / SIZE);
+  const double clocks[] = {1, 4, 20, 40};
+  for (double mhz : clocks) {
+    printf("  %4.0f MHz: %6.0f KB/s plain, %6.0f KB/s cached\n", mhz,
+           SIZE / 1.024 / plain.cardUs(mhz) * 1000,
+           SIZE / 1.024 / cached.cardUs(mhz) * 1000);
+  }
+  TEST_ASSERT_LESS_THAN(plain.reads / 2, cached.reads);
+
+  // open: a cold open walks the directory, a parked handle costs nothing
+  HandleCache<int, SDCACHE_OPEN_FILES> handles;
+  int handle = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 100000; i++) {
+    handles.take("/hum.mp3", handle);
+    handles.park("/hum.mp3", 1);
+  }
+  double parkedNs = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - start)
+                        .count() /
+                    100000;
+  printf("open: cold %.0f us at 20 MHz (%d directory reads), parked %.0f ns"
+         " on this host\n",
+         OPEN_READS * (CMD_US + 512 * 8 / 20.0), OPEN_READS, parkedNs);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_reads_match_file);
+  RUN_TEST(test_sequential_reads_ahead);
+  RUN_TEST(test_random_reads_fetch_one_block);
+  RUN_TEST(test_files_share_the_cache);
+  RUN_TEST(test_detach_forgets_blocks);
+  RUN_TEST(test_parked_handles);
+  RUN_TEST(test_benchmark);
+  return UNITY_END();
+}
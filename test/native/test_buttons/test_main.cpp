@@ -0,0 +1,195 @@
+#include <vector>
+
+#include <unity.h>
+
+#include "buttongesture.h"
+
+// Button gestures in a simulation of the firmware: bouncy edges go through
+// an interrupt queue, and every 5 ms the buttons job drains it and samples
+// the pins, like buttonsPoll(). Checks clicks, long presses and that the
+// combo timing is what the Button2 handlers did.
+
+static const uint32_t JOB_MS = 5;
+
+struct Press {
+  uint8_t button;
+  uint32_t downMs;
+  uint32_t upMs;
+};
+
+struct Edge {
+  uint32_t ms;
+  uint8_t button;
+  bool pressed;
+};
+
+static std::vector<ButtonAction> actions;
+
+void setUp() { actions.clear(); }
+void tearDown() {}
+
+// Presses with 3 ms of contact bounce on both edges; lostEdges drops every
+// edge from the queue, as if it had overflowed
+static void simulate(const std::vector<Press> &presses, uint32_t endMs,
+                     bool lostEdges = false) {
+  std::vector<Edge> edges;
+  for (const Press &p : presses) {
+    for (uint32_t at : {p.downMs, p.upMs}) {
+      bool pressed = at == p.downMs;
+      edges.push_back({at, p.button, pressed});
+      edges.push_back({at + 1, p.button, !pressed});
+      edges.push_back({at + 3, p.button, pressed});
+    }
+  }
+  ButtonPanel panel = {};
+  std::vector<Edge> queue;
+  auto out = [](const ButtonAction &action) { actions.push_back(action); };
+  for (uint32_t ms = 0; ms <= endMs; ms++) {
+    for (const Edge &edge : edges) {
+      if (edge.ms == ms && !lostEdges) {
+        queue.push_back(edge);
+      }
+    }
+    if (ms % JOB_MS) {
+      continue;
+    }
+    for (const Edge &edge : queue) {
+      panel.update(edge.button, edge.pressed, edge.ms, out);
+    }
+    queue.clear();
+    for (uint8_t button = 0; button < BUTTON_COUNT; button++) {
+      bool level = false;
+      for (const Edge &edge : edges) {
+        if (edge.button == button && edge.ms <= ms) {
+          level = edge.pressed;
+        }
+      }
+      panel.update(button, level, ms, out);
+    }
+  }
+}
+
+static int count(ButtonEvent event, uint8_t button = 0) {
+  int n = 0;
+  for (const ButtonAction &action : actions) {
+    n += action.event == event && action.button == button;
+  }
+  return n;
+}
+
+// The combo of the run, 0xFF if there was more than one
+static ComboAction comboOf() {
+  ComboAction combo = ComboAction::NONE;
+  for (const ButtonAction &action : actions) {
+    if (action.combo != ComboAction::NONE) {
+      combo = combo == ComboAction::NONE ? action.combo : (ComboAction)0xFF;
+    }
+  }
+  return combo;
+}
+
+void test_bounce_is_one_click() {
+  simulate({{0, 1000, 1120}}, 2000);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::PRESSED));
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::RELEASED));
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::CLICK));
+  TEST_ASSERT_EQUAL(0, count(ButtonEvent::DOUBLE_CLICK));
+  TEST_ASSERT_EQUAL(3, actions.size());
+}
+
+void test_multi_clicks() {
+  simulate({{1, 1000, 1100}, {1, 1250, 1350}}, 2500);
+  TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK, 1));
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::DOUBLE_CLICK, 1));
+  actions.clear();
+  simulate({{0, 1000, 1100}, {0, 1250, 1350}, {0, 1500, 1600}}, 2500);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::TRIPLE_CLICK));
+  TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK));
+  // a pause longer than the window makes two clicks
+  actions.clear();
+  simulate({{0, 1000, 1100}, {0, 1500, 1600}}, 2500);
+  TEST_ASSERT_EQUAL(2, count(ButtonEvent::CLICK));
+}
+
+void test_long_press_is_no_click() {
+  simulate({{0, 1000, 2500}}, 3500);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::LONG_PRESS));
+  TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK));
+  TEST_ASSERT_EQUAL(ButtonEvent::LONG_PRESS, actions[1].event);
+}
+
+void test_combo_timing() {
+  struct {
+    uint32_t heldMs;
+    ComboAction combo;
+  } cases[] = {{400, ComboAction::ANNOUNCE_IP},
+               {999, ComboAction::ANNOUNCE_IP},
+               {1000, ComboAction::NONE},
+               {1500, ComboAction::SWITCH_AUDIO_MODE},
+               {2000, ComboAction::NONE},
+               {3000, ComboAction::TOGGLE_RADIO},
+               {5000, ComboAction::TOGGLE_RADIO},
+               {6000, ComboAction::RESET_WIFI}};
+  for (const auto &c : cases) {
+    actions.clear();
+    // the second press starts the combo, the last release ends it
+    simulate({{0, 1000, 1100 + c.heldMs}, {1, 1100, 1050 + c.heldMs}},
+             c.heldMs + 2000);
+    TEST_ASSERT_EQUAL_MESSAGE(c.combo, comboOf(), "combo");
+    TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK, 0));
+    TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK, 1));
+  }
+}
+
+// a click finished right after a combo is part of it, a later one is not
+void test_click_after_combo() {
+  simulate({{0, 1000, 1200}, {1, 1050, 1250}, {1, 1300, 1350}}, 2500);
+  TEST_ASSERT_EQUAL(ComboAction::ANNOUNCE_IP, comboOf());
+  TEST_ASSERT_EQUAL(0, count(ButtonEvent::CLICK, 1));
+  actions.clear();
+  simulate({{0, 1000, 1200}, {1, 1050, 1250}, {1, 1700, 1800}}, 2500);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::CLICK, 1));
+}
+
+// holding both past the long press also runs both volume handlers, as the
+// Button2 version did
+void test_long_combo_long_presses() {
+  simulate({{0, 1000, 2600}, {1, 1020, 2620}}, 3500);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::LONG_PRESS, 0));
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::LONG_PRESS, 1));
+  TEST_ASSERT_EQUAL(ComboAction::SWITCH_AUDIO_MODE, comboOf());
+}
+
+// without the queue, sampling the pins alone still sees the gestures
+void test_lost_edges() {
+  simulate({{0, 1000, 1100}, {0, 1250, 1350}}, 2500, true);
+  TEST_ASSERT_EQUAL(1, count(ButtonEvent::DOUBLE_CLICK));
+  actions.clear();
+  simulate({{0, 1000, 1300}, {1, 1050, 1350}}, 2500, true);
+  TEST_ASSERT_EQUAL(ComboAction::ANNOUNCE_IP, comboOf());
+}
+
+void test_busy() {
+  ButtonPanel panel = {};
+  auto ignore = [](const ButtonAction &) {};
+  TEST_ASSERT_FALSE(panel.busy());
+  panel.update(0, true, 1000, ignore);
+  TEST_ASSERT_TRUE(panel.busy());
+  panel.update(0, false, 1100, ignore);
+  TEST_ASSERT_TRUE(panel.busy()); // the click window is open
+  panel.update(0, false, 1100 + BUTTON_CLICK_WINDOW_MS, ignore);
+  TEST_ASSERT_FALSE(panel.busy());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bounce_is_one_click);
+  RUN_TEST(test_multi_clicks);
+  RUN_TEST(test_long_press_is_no_click);
+  RUN_TEST(test_combo_timing);
+  RUN_TEST(test_click_after_combo);
+  RUN_TEST(test_long_combo_long_presses);
+  RUN_TEST(test_lost_edges);
+  RUN_TEST(test_busy);
+  return UNITY_END();
+}
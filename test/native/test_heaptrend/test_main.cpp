@@ -0,0 +1,84 @@
+#include <unity.h>
+
+#include "heaptrend.h"
+
+// Heap trend slopes: a steady heap is flat, a leak or fragmentation shows as
+// bytes per hour, and the ring only keeps the last HEAP_TREND_SAMPLES.
+
+static HeapTrend trend;
+
+void setUp() { trend.reset(); }
+void tearDown() {}
+
+static const uint32_t MINUTE = 60000;
+
+void test_flat_until_two_samples() {
+  TEST_ASSERT_EQUAL_FLOAT(0, trend.largestSlope());
+  trend.add({0, 200000, 110000});
+  TEST_ASSERT_EQUAL_FLOAT(0, trend.largestSlope());
+  TEST_ASSERT_EQUAL(0, trend.spanMs());
+  trend.add({MINUTE, 200000, 110000});
+  TEST_ASSERT_EQUAL_FLOAT(0, trend.largestSlope());
+  TEST_ASSERT_EQUAL_FLOAT(0, trend.freeSlope());
+  TEST_ASSERT_EQUAL(MINUTE, trend.spanMs());
+}
+
+// the largest block loses 100 bytes a minute while the total holds
+void test_fragmentation_slope() {
+  for (uint32_t i = 0; i < 60; i++) {
+    trend.add({1000000 + i * MINUTE, 200000, 110000 - i * 100});
+  }
+  TEST_ASSERT_FLOAT_WITHIN(1, -6000, trend.largestSlope());
+  TEST_ASSERT_FLOAT_WITHIN(1, 0, trend.freeSlope());
+  TEST_ASSERT_EQUAL(110000 - 59 * 100, trend.lowestLargest);
+  TEST_ASSERT_EQUAL(59 * MINUTE, trend.spanMs());
+}
+
+// noise around a flat line averages out
+void test_noise_is_flat() {
+  for (uint32_t i = 0; i < 100; i++) {
+    uint32_t jitter = i % 2 ? 2000 : 0;
+    trend.add({i * MINUTE, 200000 + jitter, 110000 + jitter});
+  }
+  TEST_ASSERT_FLOAT_WITHIN(50, 0, trend.largestSlope());
+}
+
+// only the newest samples count once the ring is full, an early drop is gone
+void test_ring_wraps() {
+  trend.add({0, 200000, 20000});
+  for (uint32_t i = 1; i < HEAP_TREND_SAMPLES + 10; i++) {
+    trend.add({i * MINUTE, 200000, 110000});
+  }
+  TEST_ASSERT_EQUAL(HEAP_TREND_SAMPLES, trend.count);
+  TEST_ASSERT_EQUAL(10 * MINUTE, trend.at(0).ms);
+  TEST_ASSERT_EQUAL((HEAP_TREND_SAMPLES + 9) * MINUTE, trend.latest().ms);
+  TEST_ASSERT_EQUAL_FLOAT(0, trend.largestSlope());
+  TEST_ASSERT_EQUAL(20000, trend.lowestLargest);
+}
+
+// across millis() wrapping
+void test_clock_wrap() {
+  for (uint32_t i = 0; i < 10; i++) {
+    trend.add({0xFFFFFFFF - 3 * MINUTE + i * MINUTE, 200000 - i * 1000,
+               110000 - i * 1000});
+  }
+  TEST_ASSERT_FLOAT_WITHIN(1, -60000, trend.largestSlope());
+  TEST_ASSERT_FLOAT_WITHIN(1, -60000, trend.freeSlope());
+}
+
+void test_fragmentation() {
+  TEST_ASSERT_EQUAL_FLOAT(0, heapFragmentation({0, 0, 0}));
+  TEST_ASSERT_EQUAL_FLOAT(0, heapFragmentation({0, 100000, 100000}));
+  TEST_ASSERT_EQUAL_FLOAT(0.75, heapFragmentation({0, 100000, 25000}));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_flat_until_two_samples);
+  RUN_TEST(test_fragmentation_slope);
+  RUN_TEST(test_noise_is_flat);
+  RUN_TEST(test_ring_wraps);
+  RUN_TEST(test_clock_wrap);
+  RUN_TEST(test_fragmentation);
+  return UNITY_END();
+}
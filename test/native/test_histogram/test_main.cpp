@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unity.h>
+
+#include "histogram.h"
+
+// Profiler histogram: bucket edges, percentile error against exact order
+// statistics, and what a record costs.
+
+static const uint32_t BENCH_RECORDS = 1000000;
+
+static Histogram histogram;
+
+void setUp() { histogram.reset(); }
+void tearDown() {}
+
+void test_buckets_are_contiguous() {
+  TEST_ASSERT_EQUAL(0, histogramBucket(0));
+  TEST_ASSERT_EQUAL(HISTOGRAM_BUCKETS - 1, histogramBucket(UINT32_MAX));
+  TEST_ASSERT_EQUAL(UINT32_MAX, histogramBucketMax(HISTOGRAM_BUCKETS - 1));
+  for (uint32_t b = 0; b + 1 < HISTOGRAM_BUCKETS; b++) {
+    uint32_t last = histogramBucketMax(b);
+    TEST_ASSERT_EQUAL(b, histogramBucket(last));
+    TEST_ASSERT_EQUAL(b + 1, histogramBucket(last + 1));
+  }
+}
+
+void test_empty() {
+  TEST_ASSERT_EQUAL(0, histogram.percentile(0.5));
+  TEST_ASSERT_EQUAL(0, histogram.percentile(0.99));
+}
+
+void test_percentiles_within_bucket_error() {
+  std::vector<uint32_t> values;
+  srand(7);
+  for (int i = 0; i < 10000; i++) {
+    // mostly ~50 us stages with a long tail, in ns
+    uint32_t value = 40000 + rand() % 20000;
+    if (i % 100 == 0) {
+      value = 1000000 + rand() % 4000000;
+    }
+    values.push_back(value);
+    histogram.record(value);
+  }
+  std::sort(values.begin(), values.end());
+  for (float q : {0.5f, 0.9f, 0.99f, 0.999f}) {
+    uint32_t exact = values[(size_t)(q * values.size())];
+    uint32_t reported = histogram.percentile(q);
+    TEST_ASSERT_TRUE(reported >= exact);
+    TEST_ASSERT_TRUE(reported - exact <= exact / HISTOGRAM_SUB_BUCKETS);
+  }
+  TEST_ASSERT_EQUAL(values.back(), histogram.max);
+  TEST_ASSERT_EQUAL(values.back(), histogram.percentile(1));
+  TEST_ASSERT_EQUAL(10000, histogram.count);
+}
+
+void test_record_cost() {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_RECORDS; i++) {
+    histogram.record(i * 2654435761u >> 12);
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  printf("record %.2f ns, p50 %u\n", ns / BENCH_RECORDS,
+         histogram.percentile(0.5));
+  TEST_ASSERT_EQUAL(BENCH_RECORDS, histogram.count);
+  TEST_ASSERT_LESS_THAN(100.0, ns / BENCH_RECORDS);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_buckets_are_contiguous);
+  RUN_TEST(test_empty);
+  RUN_TEST(test_percentiles_within_bucket_error);
+  RUN_TEST(test_record_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,4 @@
+#define NUM_PIXELS 1000
+#define LED_BENCH_NS px1000
+#define LED_BENCH_FN benchLed1000
+#include "led_bench_impl.h"
@@ -0,0 +1,4 @@
+#define NUM_PIXELS 120
+#define LED_BENCH_NS px120
+#define LED_BENCH_FN benchLed120
+#include "led_bench_impl.h"
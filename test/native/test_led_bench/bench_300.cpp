@@ -0,0 +1,4 @@
+#define NUM_PIXELS 300
+#define LED_BENCH_NS px300
+#define LED_BENCH_FN benchLed300
+#include "led_bench_impl.h"
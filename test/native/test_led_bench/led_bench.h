@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+struct LedBenchRow {
+  const char *mode;
+  uint16_t pixels;
+  double nsPerFrame;
+  double floatOpsPerFrame;
+  double allocsPerFrame;
+  double showsPerFrame;
+};
+
+// Allocation counter maintained by the operator new override in test_main.cpp
+extern uint64_t benchAllocations;
+
+// One entry point per NUM_PIXELS build of led.h, see bench_*.cpp
+void benchLed120(uint32_t frames, std::vector<LedBenchRow> &rows);
+void benchLed300(uint32_t frames, std::vector<LedBenchRow> &rows);
+void benchLed1000(uint32_t frames, std::vector<LedBenchRow> &rows);
@@ -0,0 +1,51 @@
+#pragma once
+// Instantiates led.h for one NUM_PIXELS value inside its own namespace, so
+// several blade lengths can be linked into a single benchmark binary.
+// Define NUM_PIXELS, LED_BENCH_NS and LED_BENCH_FN before including.
+#include <chrono>
+#include <vector>
+
+#include <NeoPixelBusLg.h>
+
+#include "led_bench.h"
+
+namespace LED_BENCH_NS {
+#include "led.h"
+
+NeoPixelBusLg<NeoGrbFeature, NeoWs2812xMethod> strip(NUM_PIXELS, LED_PIN);
+
+const char *const modeNames[COLORMODE_COUNT] = {
+    "SOLID", "BLINK", "GLOW", "OCEAN", "COLOR_WIPE",
+    "ALIEN", "BLEND", "PULSE", "PARTY",
+};
+} // namespace LED_BENCH_NS
+
+void LED_BENCH_FN(uint32_t frames, std::vector<LedBenchRow> &rows) {
+  using namespace LED_BENCH_NS;
+  strip.Begin();
+  applyColor(Color::RED);
+  for (int m = 0; m < COLORMODE_COUNT; m++) {
+    auto mode = static_cast<ColorMode>(m);
+    shim::seedRandom(1);
+    shim::setMicros(0);
+    // warm up statics inside applyColorMode() outside of the measurement
+    applyColorMode(mode);
+    shim::resetCounters();
+    uint64_t allocsBefore = benchAllocations;
+    uint64_t elapsedNs = 0;
+    for (uint32_t f = 0; f < frames; f++) {
+      shim::advanceMillis(1000 / RENDER_FPS);
+      auto start = std::chrono::steady_clock::now();
+      applyColorMode(mode);
+      pushFrame();
+      auto end = std::chrono::steady_clock::now();
+      elapsedNs +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+              .count();
+    }
+    rows.push_back({modeNames[m], NUM_PIXELS, double(elapsedNs) / frames,
+                    double(shim::counters.floatOps) / frames,
+                    double(benchAllocations - allocsBefore) / frames,
+                    double(shim::counters.shows) / frames});
+  }
+}
@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <unity.h>
+
+#include "led_bench.h"
+
+// Frame rendering benchmark for led.h: ns/frame, float ops, heap allocations
+// and pushed frames per ColorMode at several blade lengths. Float ops only
+// cover what goes through the shim (HSB conversions, sin/sinf); inline float
+// arithmetic shows up in ns/frame.
+
+uint64_t benchAllocations = 0;
+
+void *operator new(std::size_t size) {
+  benchAllocations++;
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static const uint32_t FRAMES = 2000;
+
+void setUp() {}
+void tearDown() {}
+
+static void report(const std::vector<LedBenchRow> &rows) {
+  printf("%-12s %6s %12s %12s %10s %8s\n", "mode", "pixels", "ns/frame",
+         "float ops", "allocs", "shows");
+  for (const auto &row : rows) {
+    printf("%-12s %6u %12.0f %12.1f %10.2f %8.2f\n", row.mode, row.pixels,
+           row.nsPerFrame, row.floatOpsPerFrame, row.allocsPerFrame,
+           row.showsPerFrame);
+  }
+}
+
+static void checkRows(const std::vector<LedBenchRow> &rows) {
+  report(rows);
+  for (const auto &row : rows) {
+    // the render path runs every frame and must never touch the heap
+    TEST_ASSERT_EQUAL_FLOAT_MESSAGE(0.0, row.allocsPerFrame, row.mode);
+  }
+}
+
+void test_render_120() {
+  std::vector<LedBenchRow> rows;
+  rows.reserve(16);
+  benchLed120(FRAMES, rows);
+  checkRows(rows);
+}
+
+void test_render_300() {
+  std::vector<LedBenchRow> rows;
+  rows.reserve(16);
+  benchLed300(FRAMES, rows);
+  checkRows(rows);
+}
+
+void test_render_1000() {
+  std::vector<LedBenchRow> rows;
+  rows.reserve(16);
+  benchLed1000(FRAMES, rows);
+  checkRows(rows);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_render_120);
+  RUN_TEST(test_render_300);
+  RUN_TEST(test_render_1000);
+  return UNITY_END();
+}
@@ -0,0 +1,112 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include <unity.h>
+
+#include "logring.h"
+
+// Log ring: deferred formatting against snprintf, string copies, overflow
+// accounting, and what a push costs the caller.
+
+static const uint32_t BENCH_PUSHES = 200000;
+
+template <typename... Args>
+static bool push(LogRing<8> &ring, const char *format, const Args &...args) {
+  const LogArg packed[sizeof...(Args) + 1] = {logArg(args)...};
+  return ring.push(LOG_LEVEL_INFO, 1234, format, packed, sizeof...(Args));
+}
+
+static std::string popLine(LogRing<8> &ring) {
+  LogRecord record = {};
+  char line[256];
+  if (!ring.pop(record)) {
+    return "<empty>";
+  }
+  logFormat(record, line, sizeof(line));
+  return line;
+}
+
+static LogRing<8> ring;
+
+void setUp() {}
+void tearDown() {}
+
+void test_matches_snprintf() {
+  char expected[256];
+  unsigned long ms = 4000000000ul;
+  snprintf(expected, sizeof(expected),
+           "%d %u %lu %5.2f %x %08X %c %% %-4s|", -42, 7u, ms, 3.14159, 255u,
+           0xBEEFu, 'z', "ab");
+  push(ring, "%d %u %lu %5.2f %x %08X %c %% %-4s|", -42, 7u, ms, 3.14159,
+       255u, 0xBEEFu, 'z', "ab");
+  TEST_ASSERT_EQUAL_STRING(expected, popLine(ring).c_str());
+}
+
+void test_strings_are_copied() {
+  char buffer[16];
+  strcpy(buffer, "before");
+  std::string owned = "owned";
+  const char *missing = nullptr;
+  push(ring, "%s %s %s", buffer, owned, missing);
+  strcpy(buffer, "after");
+  owned = "changed";
+  TEST_ASSERT_EQUAL_STRING("before owned (null)", popLine(ring).c_str());
+}
+
+void test_long_strings_truncate() {
+  std::string first(200, 'a');
+  push(ring, "%s|%s", first, "tail");
+  std::string line = popLine(ring);
+  // the first argument fills the area, the second one comes out empty
+  TEST_ASSERT_EQUAL(LOG_STRING_BYTES - 1 + 1, line.size());
+  TEST_ASSERT_EQUAL('|', line.back());
+}
+
+void test_missing_arguments() {
+  push(ring, "%d and %s", 5);
+  TEST_ASSERT_EQUAL_STRING("5 and <?>", popLine(ring).c_str());
+}
+
+void test_full_ring_drops() {
+  uint32_t dropped = ring.dropped.load();
+  for (int i = 0; i < 10; i++) {
+    push(ring, "line %d", i);
+  }
+  TEST_ASSERT_EQUAL(dropped + 2, ring.dropped.load());
+  for (int i = 0; i < 8; i++) {
+    char expected[16];
+    snprintf(expected, sizeof(expected), "line %d", i);
+    TEST_ASSERT_EQUAL_STRING(expected, popLine(ring).c_str());
+  }
+  TEST_ASSERT_EQUAL_STRING("<empty>", popLine(ring).c_str());
+}
+
+void test_push_cost() {
+  LogRecord record = {};
+  uint32_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_PUSHES; i++) {
+    push(ring, "Button pressed, counter: %u (%s)", i, "btn1");
+    ring.pop(record);
+    checksum += record.argc;
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  printf("push+pop %.0f ns, checksum %u\n", ns / BENCH_PUSHES, checksum);
+  // well under a microsecond on the host, a few on the ESP32
+  TEST_ASSERT_LESS_THAN(1000.0, ns / BENCH_PUSHES);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_snprintf);
+  RUN_TEST(test_strings_are_copied);
+  RUN_TEST(test_long_strings_truncate);
+  RUN_TEST(test_missing_arguments);
+  RUN_TEST(test_full_ring_drops);
+  RUN_TEST(test_push_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,425 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+
+#include <unity.h>
+
+#include "otapack.h"
+#include "otaupload.h"
+
+// OTA packages from tools/ota through the streaming decoder, fed the way
+// POST /ota receives them: the body in TCP segment sized chunks, written to
+// a stand-in for the inactive slot, the delta base read from a stand-in for
+// the running one.
+
+struct FakeSlots : OtaTarget {
+  Bytes running; // base for deltas
+  Bytes written;
+  bool begun = false;
+
+  bool begin(const OtaHeader &header) override {
+    if (header.flags & OTA_DELTA) {
+      if (header.baseSize != running.size() ||
+          header.baseCrc != crc32Update(0, running.data(), running.size())) {
+        return false;
+      }
+    }
+    begun = true;
+    written.reserve(header.imageSize);
+    return true;
+  }
+
+  bool write(const uint8_t *data, size_t len) override {
+    written.insert(written.end(), data, data + len);
+    return true;
+  }
+
+  bool readBase(uint32_t offset, uint8_t *out, size_t len) override {
+    if (offset + len > running.size()) {
+      return false;
+    }
+    memcpy(out, &running[offset], len);
+    return true;
+  }
+};
+
+static OtaDecoder decoder;
+
+void setUp() { srand(1); }
+void tearDown() {}
+
+// code-like: repeated instruction patterns, tables and some noise
+static Bytes fakeFirmware(size_t size, uint32_t seed) {
+  Bytes image(size);
+  uint32_t x = seed;
+  for (size_t i = 0; i < size; i++) {
+    x = x * 1103515245 + 12345;
+    if ((i / 256) % 3 == 0) {
+      image[i] = x >> 24; // noise
+    } else {
+      image[i] = "\x36\x41\x00\x0c\x02\x1d\xf0\x91"[i % 8] + (i / 4096);
+    }
+  }
+  return image;
+}
+
+// a new build: some code changed in place, some inserted, shifting the rest
+static Bytes nextBuild(const Bytes &base) {
+  Bytes image = base;
+  for (size_t i = 1000; i < image.size(); i += 7919) {
+    image[i] ^= 0x5A;
+  }
+  Bytes inserted = fakeFirmware(3000, 99);
+  image.insert(image.begin() + image.size() / 3, inserted.begin(),
+               inserted.end());
+  return image;
+}
+
+static OtaStatus upload(const Bytes &package, FakeSlots &slots,
+                        bool randomChunks = true) {
+  decoder.begin(slots);
+  size_t pos = 0;
+  while (pos < package.size()) {
+    size_t n = randomChunks ? 1 + rand() % 1460 : 1460;
+    n = std::min(n, package.size() - pos);
+    if (!decoder.feed(&package[pos], n)) {
+      break;
+    }
+    pos += n;
+  }
+  return decoder.finish();
+}
+
+void test_raw_image() {
+  Bytes image = fakeFirmware(50000, 1);
+  FakeSlots slots;
+  TEST_ASSERT_TRUE(upload(otaPackage(image, {}, false), slots) ==
+                   OtaStatus::OK);
+  TEST_ASSERT_TRUE(slots.written == image);
+}
+
+void test_compressed_image() {
+  Bytes image = fakeFirmware(200000, 2);
+  Bytes package = otaPackage(image, {}, true);
+  FakeSlots slots;
+  TEST_ASSERT_TRUE(upload(package, slots) == OtaStatus::OK);
+  TEST_ASSERT_TRUE(slots.written == image);
+  printf("compressed: %zu -> %zu bytes\n", image.size(), package.size());
+  TEST_ASSERT_LESS_THAN(image.size() * 3 / 4, package.size());
+}
+
+void test_all_window_sizes() {
+  Bytes image = fakeFirmware(30000, 3);
+  for (uint8_t w = 4; w <= OTA_WINDOW_BITS_MAX; w++) {
+    for (uint8_t l = 1; l < w && l <= 8; l++) {
+      FakeSlots slots;
+      TEST_ASSERT_TRUE(upload(otaPackage(image, {}, true, w, l), slots) ==
+                       OtaStatus::OK);
+      TEST_ASSERT_TRUE(slots.written == image);
+    }
+  }
+}
+
+void test_delta_against_running_image() {
+  FakeSlots slots;
+  slots.running = fakeFirmware(300000, 4);
+  Bytes image = nextBuild(slots.running);
+  Bytes full = otaPackage(image, {}, true);
+  Bytes delta = otaPackage(image, slots.running, true);
+  TEST_ASSERT_TRUE(upload(delta, slots) == OtaStatus::OK);
+  TEST_ASSERT_TRUE(slots.written == image);
+  printf("delta: %zu bytes, full compressed %zu, image %zu\n", delta.size(),
+         full.size(), image.size());
+  TEST_ASSERT_LESS_THAN(full.size() / 10, delta.size());
+}
+
+void test_delta_needs_its_base() {
+  FakeSlots built;
+  built.running = fakeFirmware(20000, 5);
+  Bytes delta = otaPackage(nextBuild(built.running), built.running, true);
+  FakeSlots other;
+  other.running = fakeFirmware(20000, 6);
+  TEST_ASSERT_TRUE(upload(delta, other) == OtaStatus::REJECTED);
+  TEST_ASSERT_FALSE(other.begun);
+}
+
+void test_corruption_is_caught() {
+  Bytes image = fakeFirmware(40000, 7);
+  Bytes package = otaPackage(image, {}, true);
+  package[package.size() / 2] ^= 0x10;
+  FakeSlots slots;
+  OtaStatus status = upload(package, slots);
+  TEST_ASSERT_TRUE(status == OtaStatus::BAD_CRC ||
+                   status == OtaStatus::CORRUPT);
+}
+
+void test_truncated_upload() {
+  Bytes image = fakeFirmware(40000, 8);
+  Bytes package = otaPackage(image, {}, true);
+  package.resize(package.size() - 100);
+  FakeSlots slots;
+  TEST_ASSERT_TRUE(upload(package, slots) == OtaStatus::CORRUPT);
+}
+
+void test_not_a_package() {
+  Bytes image = fakeFirmware(1000, 9);
+  FakeSlots slots;
+  TEST_ASSERT_TRUE(upload(image, slots) == OtaStatus::BAD_HEADER);
+  TEST_ASSERT_FALSE(slots.begun);
+}
+
+void test_decode_speed() {
+  FakeSlots slots;
+  slots.running = fakeFirmware(1000000, 10);
+  Bytes delta = otaPackage(nextBuild(slots.running), slots.running, true);
+  Bytes full = otaPackage(slots.running, {}, true);
+  auto start = std::chrono::steady_clock::now();
+  TEST_ASSERT_TRUE(upload(full, slots, false) == OtaStatus::OK);
+  double fullMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+  slots.written.clear();
+  start = std::chrono::steady_clock::now();
+  TEST_ASSERT_TRUE(upload(delta, slots, false) == OtaStatus::OK);
+  double deltaMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("1 MB image: full %.1f ms (%zu bytes), delta %.1f ms (%zu bytes)\n",
+         fullMs, full.size(), deltaMs, delta.size());
+}
+
+// A stand-in for the web server in front of POST /ota. It takes the raw
+// HTTP request the way it comes off the socket, in TCP segments, and calls
+// the handlers like AsyncWebServer does: the file part of a multipart form
+// through the upload handler, a plain body through the body handler, and
+// the request handler once the body is through.
+
+struct FakeRequest {
+  bool authorized = false;
+  int code = 0;
+  std::string text;
+  std::function<void()> disconnected;
+
+  bool authenticate(const char *user, const char *password) {
+    return authorized && !strcmp(user, "admin") && !strcmp(password, "admin");
+  }
+  void requestAuthentication() { code = 401; }
+  void send(int status, const char *, const char *body) {
+    code = status;
+    text = body;
+  }
+  void onDisconnect(std::function<void()> handler) { disconnected = handler; }
+};
+
+struct FakeConnection {
+  FakeRequest request;
+  std::string raw;
+  size_t headerEnd = 0, fileStart = 0, fileEnd = 0, sent = 0;
+  bool multipart = false;
+
+  FakeConnection(const Bytes &package, bool asForm,
+                 const char *auth = "YWRtaW46YWRtaW4=") {
+    std::string payload(package.begin(), package.end());
+    std::string body;
+    if (asForm) {
+      body = "--XyZ\r\nContent-Disposition: form-data; name=\"firmware\"; "
+             "filename=\"fw.lota\"\r\nContent-Type: "
+             "application/octet-stream\r\n\r\n";
+      fileStart = body.size();
+      body += payload;
+      fileEnd = body.size();
+      body += "\r\n--XyZ--\r\n";
+    } else {
+      body = payload;
+    }
+    raw = "POST /ota HTTP/1.1\r\nHost: saber\r\nAuthorization: Basic ";
+    raw += auth;
+    raw += asForm ? "\r\nContent-Type: multipart/form-data; boundary=XyZ"
+                  : "\r\nContent-Type: application/octet-stream";
+    raw += "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    headerEnd = raw.size();
+    raw += body;
+  }
+
+  bool done() const { return sent == raw.size(); }
+
+  // Delivers the next segment, true once the response has been sent
+  bool deliver(OtaUpload<FakeRequest> &upload, size_t segment) {
+    if (!sent) {
+      std::string headers = raw.substr(0, raw.find("\r\n\r\n"));
+      request.authorized =
+          headers.find("Basic YWRtaW46YWRtaW4=") != std::string::npos;
+      multipart = headers.find("multipart/form-data") != std::string::npos;
+    }
+    size_t from = sent, to = std::min(raw.size(), sent + segment);
+    sent = to;
+    from = std::max(from, headerEnd);
+    const uint8_t *data = (const uint8_t *)raw.data();
+    if (multipart) {
+      size_t a = std::max(from, headerEnd + fileStart);
+      size_t b = std::min(to, headerEnd + fileEnd);
+      if (a < b) {
+        upload.upload(&request, a - headerEnd - fileStart, data + a, b - a,
+                      b == headerEnd + fileEnd);
+      }
+    } else if (from < to) {
+      upload.body(&request, data + from, to - from, from - headerEnd,
+                  raw.size() - headerEnd);
+    }
+    if (done()) {
+      upload.respond(&request);
+    }
+    return done();
+  }
+
+  void post(OtaUpload<FakeRequest> &upload, size_t segment = 1460) {
+    while (!deliver(upload, segment)) {
+    }
+  }
+
+  void drop() {
+    if (request.disconnected) {
+      request.disconnected();
+    }
+  }
+};
+
+static int endHookCalls;
+static OtaStatus endHookResult(OtaStatus status, uint32_t) {
+  endHookCalls++;
+  return status;
+}
+
+static bool failNothrowNew = false;
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  if (failNothrowNew) {
+    return nullptr;
+  }
+  try {
+    return ::operator new(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void test_http_multipart_upload() {
+  Bytes image = fakeFirmware(60000, 11);
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  endHookCalls = 0;
+  upload.setHooks(nullptr, endHookResult);
+  FakeConnection form(otaPackage(image, {}, true), true);
+  form.post(upload, 536);
+  TEST_ASSERT_EQUAL(200, form.request.code);
+  TEST_ASSERT_EQUAL_STRING("ok", form.request.text.c_str());
+  TEST_ASSERT_TRUE(slots.written == image);
+  TEST_ASSERT_EQUAL(1, endHookCalls);
+  TEST_ASSERT_FALSE(upload.busy());
+}
+
+void test_http_raw_body_upload() {
+  FakeSlots slots;
+  slots.running = fakeFirmware(80000, 12);
+  Bytes image = nextBuild(slots.running);
+  OtaUpload<FakeRequest> upload(slots);
+  FakeConnection body(otaPackage(image, slots.running, true), false);
+  body.post(upload);
+  TEST_ASSERT_EQUAL(200, body.request.code);
+  TEST_ASSERT_TRUE(slots.written == image);
+}
+
+void test_http_bad_package_is_400() {
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  FakeConnection form(fakeFirmware(5000, 13), true);
+  form.post(upload);
+  TEST_ASSERT_EQUAL(400, form.request.code);
+  TEST_ASSERT_EQUAL_STRING("not an OTA package", form.request.text.c_str());
+}
+
+void test_http_needs_credentials() {
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  FakeConnection form(otaPackage(fakeFirmware(5000, 14), {}, true), true,
+                      "Z3Vlc3Q6Z3Vlc3Q=");
+  form.post(upload);
+  TEST_ASSERT_EQUAL(401, form.request.code);
+  TEST_ASSERT_FALSE(slots.begun);
+  TEST_ASSERT_FALSE(upload.busy());
+}
+
+void test_http_out_of_memory_is_500() {
+  Bytes image = fakeFirmware(20000, 15);
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  FakeConnection first(otaPackage(image, {}, true), true);
+  failNothrowNew = true;
+  first.post(upload);
+  failNothrowNew = false;
+  TEST_ASSERT_EQUAL(500, first.request.code);
+  TEST_ASSERT_EQUAL_STRING("out of memory", first.request.text.c_str());
+  TEST_ASSERT_FALSE(slots.begun);
+  // the failed request released the update, the retry is not a 409
+  FakeConnection retry(otaPackage(image, {}, true), true);
+  retry.post(upload);
+  TEST_ASSERT_EQUAL(200, retry.request.code);
+  TEST_ASSERT_TRUE(slots.written == image);
+}
+
+void test_http_one_update_at_a_time() {
+  Bytes image = fakeFirmware(40000, 16);
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  FakeConnection first(otaPackage(image, {}, true), true);
+  first.deliver(upload, 4000);
+  TEST_ASSERT_TRUE(upload.busy());
+  FakeConnection second(otaPackage(image, {}, true), false);
+  second.post(upload);
+  TEST_ASSERT_EQUAL(409, second.request.code);
+  first.post(upload);
+  TEST_ASSERT_EQUAL(200, first.request.code);
+  TEST_ASSERT_TRUE(slots.written == image);
+}
+
+void test_http_dropped_upload_frees_the_slot() {
+  Bytes image = fakeFirmware(40000, 17);
+  FakeSlots slots;
+  OtaUpload<FakeRequest> upload(slots);
+  endHookCalls = 0;
+  upload.setHooks(nullptr, endHookResult);
+  FakeConnection dropped(otaPackage(image, {}, true), true);
+  dropped.deliver(upload, 4000);
+  dropped.drop();
+  TEST_ASSERT_EQUAL(1, endHookCalls);
+  TEST_ASSERT_FALSE(upload.busy());
+  slots.written.clear();
+  FakeConnection retry(otaPackage(image, {}, true), true);
+  retry.post(upload);
+  TEST_ASSERT_EQUAL(200, retry.request.code);
+  TEST_ASSERT_TRUE(slots.written == image);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_raw_image);
+  RUN_TEST(test_compressed_image);
+  RUN_TEST(test_all_window_sizes);
+  RUN_TEST(test_delta_against_running_image);
+  RUN_TEST(test_delta_needs_its_base);
+  RUN_TEST(test_corruption_is_caught);
+  RUN_TEST(test_truncated_upload);
+  RUN_TEST(test_not_a_package);
+  RUN_TEST(test_decode_speed);
+  RUN_TEST(test_http_multipart_upload);
+  RUN_TEST(test_http_raw_body_upload);
+  RUN_TEST(test_http_bad_package_is_400);
+  RUN_TEST(test_http_needs_credentials);
+  RUN_TEST(test_http_out_of_memory_is_500);
+  RUN_TEST(test_http_one_update_at_a_time);
+  RUN_TEST(test_http_dropped_upload_frees_the_slot);
+  return UNITY_END();
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <unity.h>
+
+#include "replay.h"
+
+// Runs synthetic traces through tools/replay, which drives detect.h the way
+// loop() does.
+
+static const uint32_t SAMPLE_US = 1000000 / 500;
+
+void setUp() {}
+void tearDown() {}
+
+// blade held still, gravity on z
+static Trace stillTrace(uint32_t durationMs) {
+  Trace trace = {};
+  memcpy(trace.header.magic, TRACE_MAGIC, 4);
+  trace.header.version = TRACE_VERSION;
+  trace.header.rateHz = 500;
+  trace.header.accelLsbPerG = MOTION_ACCEL_LSB_PER_G;
+  trace.header.gyroLsbPerDps = MOTION_GYRO_LSB_PER_DPS;
+  // start near the micros() wrap to cover it
+  uint32_t micros = 0xffffffffu - 500000;
+  for (uint32_t t = 0; t < durationMs * 1000; t += SAMPLE_US) {
+    MotionSample sample = {micros + t, {0, 0, 2048}, {0, 0, 0}};
+    trace.samples.push_back(sample);
+  }
+  return trace;
+}
+
+// accel in g on x, for durationMs from atMs
+static void addClash(Trace &trace, uint32_t atMs, float g,
+                     uint32_t durationMs = 4) {
+  for (uint32_t i = 0; i < durationMs * 1000 / SAMPLE_US; i++) {
+    trace.samples[atMs * 1000 / SAMPLE_US + i].accel[0] =
+        g * MOTION_ACCEL_LSB_PER_G;
+  }
+}
+
+// rotation in deg/s around y
+static void addSwing(Trace &trace, uint32_t atMs, float dps,
+                     uint32_t durationMs = 150) {
+  for (uint32_t i = 0; i < durationMs * 1000 / SAMPLE_US; i++) {
+    trace.samples[atMs * 1000 / SAMPLE_US + i].gyro[1] =
+        dps * MOTION_GYRO_LSB_PER_DPS;
+  }
+}
+
+void test_detects_labelled_events() {
+  Trace trace = stillTrace(6000);
+  addClash(trace, 1000, 4.0f);  // ~39 m/s^2
+  addSwing(trace, 3000, 200.0f); // ~3.5 rad/s
+  addClash(trace, 5000, 1.0f);  // bump, stays under STRIKE_LIGHT
+  std::vector<Label> labels = {{1000, MotionEvent::CLASH},
+                               {3000, MotionEvent::SWING}};
+  ReplayReport report = replay(trace, labels, MotionDetector(), {});
+  TEST_ASSERT_EQUAL_UINT32(2, report.detections.size());
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.hits);
+  TEST_ASSERT_EQUAL_UINT32(0, report.clash.falsePositives);
+  TEST_ASSERT_EQUAL_UINT32(1, report.swing.hits);
+  TEST_ASSERT_EQUAL_UINT32(0, report.swing.misses);
+  TEST_ASSERT_TRUE(report.detections[0].strong);
+  TEST_ASSERT_INT_WITHIN(2, 0, report.clash.latencyMax);
+  TEST_ASSERT_INT_WITHIN(2, 0, report.swing.latencyMax);
+  TEST_ASSERT_UINT32_WITHIN(2, 5998, report.durationMs);
+}
+
+void test_unlabelled_detection_is_false_positive() {
+  Trace trace = stillTrace(3000);
+  addClash(trace, 1000, 4.0f);
+  std::vector<Label> labels = {{2000, MotionEvent::CLASH}};
+  ReplayReport report = replay(trace, labels, MotionDetector(), {});
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.detections);
+  TEST_ASSERT_EQUAL_UINT32(0, report.clash.hits);
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.falsePositives);
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.misses);
+}
+
+void test_clash_effect_blocks_retrigger() {
+  Trace trace = stillTrace(4000);
+  addClash(trace, 1000, 4.0f);
+  addClash(trace, 1500, 4.0f); // past the cooldown, clash still playing
+  addSwing(trace, 1600, 200.0f);
+  std::vector<Detection> detections =
+      detectTrace(trace, MotionDetector(), {});
+  TEST_ASSERT_EQUAL_UINT32(1, detections.size());
+}
+
+void test_clash_interrupts_swing() {
+  Trace trace = stillTrace(3000);
+  addSwing(trace, 1000, 200.0f);
+  addClash(trace, 1200, 4.0f);
+  std::vector<Detection> detections =
+      detectTrace(trace, MotionDetector(), {});
+  TEST_ASSERT_EQUAL_UINT32(2, detections.size());
+  TEST_ASSERT_TRUE(detections[0].event == MotionEvent::SWING);
+  TEST_ASSERT_TRUE(detections[1].event == MotionEvent::CLASH);
+}
+
+void test_window_keeps_short_peaks() {
+  Trace trace = stillTrace(2000);
+  addClash(trace, 1001, 4.0f, 2);
+  ReplayOptions options;
+  options.windowMs = 20;
+  std::vector<Detection> detections =
+      detectTrace(trace, MotionDetector(), options);
+  TEST_ASSERT_EQUAL_UINT32(1, detections.size());
+  TEST_ASSERT_UINT32_WITHIN(20, 1010, detections[0].ms);
+}
+
+void test_trace_file_roundtrip() {
+  Trace trace = stillTrace(100);
+  addClash(trace, 50, 4.0f);
+  char path[] = "/tmp/test_replayXXXXXX";
+  int fd = mkstemp(path);
+  FILE *f = fdopen(fd, "wb");
+  fwrite(&trace.header, sizeof(trace.header), 1, f);
+  fwrite(trace.samples.data(), sizeof(MotionSample), trace.samples.size(), f);
+  fclose(f);
+
+  Trace loaded;
+  std::string error;
+  TEST_ASSERT_TRUE(loadTrace(path, loaded, error));
+  TEST_ASSERT_EQUAL_UINT32(trace.samples.size(), loaded.samples.size());
+  TEST_ASSERT_EQUAL_MEMORY(trace.samples.data(), loaded.samples.data(),
+                           trace.samples.size() * sizeof(MotionSample));
+
+  f = fopen(path, "r+b");
+  fputc('X', f);
+  fclose(f);
+  TEST_ASSERT_FALSE(loadTrace(path, loaded, error));
+  remove(path);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_detects_labelled_events);
+  RUN_TEST(test_unlabelled_detection_is_false_positive);
+  RUN_TEST(test_clash_effect_blocks_retrigger);
+  RUN_TEST(test_clash_interrupts_swing);
+  RUN_TEST(test_window_keeps_short_peaks);
+  RUN_TEST(test_trace_file_roundtrip);
+  return UNITY_END();
+}
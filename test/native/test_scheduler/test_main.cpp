@@ -0,0 +1,154 @@
+#include <string>
+
+#include <unity.h>
+
+#include "scheduler.h"
+
+// Loop job scheduler on a virtual clock: deadline order, phase keeping,
+// dropped releases after a stall, one-shots and the lateness and overrun
+// histograms.
+
+static uint32_t now;
+static std::string order;
+
+static uint32_t virtualClock() { return now; }
+
+void setUp() {
+  now = 0;
+  order.clear();
+}
+void tearDown() {}
+
+static void jobA() { order += 'a'; }
+static void jobB() { order += 'b'; }
+static void jobC() { order += 'c'; }
+static void slowJob() {
+  order += 's';
+  now += 3000;
+}
+
+void test_deadline_order() {
+  Scheduler scheduler(virtualClock);
+  scheduler.every("a", jobA, 10000, 0);       // deadline 10 ms
+  scheduler.every("b", jobB, 100000, 0, 2000); // deadline 2 ms
+  scheduler.every("c", jobC, 10000, 1);       // a's deadline, higher priority
+  scheduler.run();
+  TEST_ASSERT_EQUAL_STRING("bca", order.c_str());
+}
+
+void test_periodic_keeps_phase() {
+  Scheduler scheduler(virtualClock);
+  int id = scheduler.every("a", jobA, 5000, 0);
+  TEST_ASSERT_EQUAL(5000, scheduler.run());
+  for (now = 5300; now < 50000; now += 5000) {
+    TEST_ASSERT_EQUAL(4700, scheduler.run()); // next release, not now + 5 ms
+  }
+  TEST_ASSERT_EQUAL(10, scheduler.job(id).runs);
+  TEST_ASSERT_EQUAL(0, scheduler.job(id).skipped);
+  TEST_ASSERT_EQUAL(300, scheduler.job(id).lateness.max);
+}
+
+// after a 23 ms stall the job runs once for the releases it missed
+void test_stall_does_not_bunch() {
+  Scheduler scheduler(virtualClock);
+  int id = scheduler.every("a", jobA, 5000, 0);
+  scheduler.run();
+  now = 23000;
+  scheduler.run();
+  scheduler.run();
+  TEST_ASSERT_EQUAL_STRING("aa", order.c_str());
+  TEST_ASSERT_EQUAL(3, scheduler.job(id).skipped);
+  TEST_ASSERT_EQUAL(2000, scheduler.run()); // back in phase at 25 ms
+  TEST_ASSERT_EQUAL(18000, scheduler.job(id).lateness.max);
+}
+
+// each job runs at most once per run(), even if it is due again
+void test_once_per_run() {
+  Scheduler scheduler(virtualClock);
+  scheduler.every("s", slowJob, 1000, 0);
+  scheduler.every("a", jobA, 1000, 0, 5000);
+  TEST_ASSERT_EQUAL(0, scheduler.run());
+  TEST_ASSERT_EQUAL_STRING("sa", order.c_str());
+}
+
+void test_overrun_recorded() {
+  Scheduler scheduler(virtualClock);
+  int id = scheduler.every("s", slowJob, 10000, 0, 2000);
+  scheduler.run();
+  TEST_ASSERT_EQUAL(1, scheduler.job(id).overruns);
+  TEST_ASSERT_EQUAL(1000, scheduler.job(id).overrun.max);
+  scheduler.resetStats();
+  TEST_ASSERT_EQUAL(0, scheduler.job(id).overruns);
+  TEST_ASSERT_EQUAL(0, scheduler.job(id).overrun.count);
+}
+
+void test_one_shot() {
+  Scheduler scheduler(virtualClock);
+  int id = scheduler.after("a", jobA, 3000, 0, 1000);
+  TEST_ASSERT_EQUAL(3000, scheduler.run());
+  now = 3500;
+  TEST_ASSERT_EQUAL(UINT32_MAX, scheduler.run());
+  TEST_ASSERT_EQUAL_STRING("a", order.c_str());
+  TEST_ASSERT_FALSE(scheduler.job(id).active);
+  // the slot is free again
+  TEST_ASSERT_EQUAL(id, scheduler.after("b", jobB, 0, 0, 1000));
+}
+
+void test_cancel_and_full() {
+  Scheduler scheduler(virtualClock);
+  int ids[SCHEDULER_JOBS];
+  for (int i = 0; i < SCHEDULER_JOBS; i++) {
+    ids[i] = scheduler.every("a", jobA, 1000, 0);
+    TEST_ASSERT_TRUE(ids[i] >= 0);
+  }
+  TEST_ASSERT_EQUAL(-1, scheduler.every("b", jobB, 1000, 0));
+  for (int id : ids) {
+    scheduler.cancel(id);
+  }
+  TEST_ASSERT_EQUAL(UINT32_MAX, scheduler.run());
+  TEST_ASSERT_EQUAL_STRING("", order.c_str());
+}
+
+// an idle job slows down, an interrupt wakes it early
+void test_idle_period_and_wake() {
+  Scheduler scheduler(virtualClock);
+  int id = scheduler.every("a", jobA, 5000, 0);
+  scheduler.setPeriod(id, 100000);
+  TEST_ASSERT_EQUAL(100000, scheduler.run());
+  now = 30000;
+  scheduler.wake(id);
+  TEST_ASSERT_EQUAL(0, scheduler.untilNext(now));
+  scheduler.setPeriod(id, 5000);
+  TEST_ASSERT_EQUAL(5000, scheduler.run());
+  TEST_ASSERT_EQUAL_STRING("aa", order.c_str());
+  TEST_ASSERT_EQUAL(0, scheduler.job(id).lateness.max);
+  TEST_ASSERT_EQUAL(0, scheduler.job(id).skipped);
+}
+
+// micros() wraps every 71 minutes
+void test_clock_wrap() {
+  Scheduler scheduler(virtualClock);
+  now = UINT32_MAX - 1500;
+  scheduler.every("a", jobA, 1000, 0);
+  scheduler.after("b", jobB, 2500, 0, 100);
+  scheduler.run();
+  now += 1000;
+  scheduler.run();
+  now += 1500; // past the wrap
+  TEST_ASSERT_EQUAL(500, scheduler.run());
+  TEST_ASSERT_EQUAL_STRING("aaba", order.c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_deadline_order);
+  RUN_TEST(test_periodic_keeps_phase);
+  RUN_TEST(test_stall_does_not_bunch);
+  RUN_TEST(test_once_per_run);
+  RUN_TEST(test_overrun_recorded);
+  RUN_TEST(test_one_shot);
+  RUN_TEST(test_cancel_and_full);
+  RUN_TEST(test_idle_period_and_wake);
+  RUN_TEST(test_clock_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,165 @@
+#include <unity.h>
+
+#include "sim.h"
+
+// Scripted runs of tools/sim: the loop jobs on the virtual clock, button
+// gestures through bounce, trigger latency, job lateness and reproducibility.
+
+void setUp() {}
+void tearDown() {}
+
+static std::vector<SimEvent> parse(const char *const *lines, int count) {
+  std::vector<SimEvent> script;
+  for (int i = 0; i < count; i++) {
+    SimEvent events[4];
+    int n;
+    std::string error;
+    if (parseSimLine(lines[i], events, n, error)) {
+      script.insert(script.end(), events, events + n);
+    }
+  }
+  std::stable_sort(
+      script.begin(), script.end(),
+      [](const SimEvent &a, const SimEvent &b) { return a.ms < b.ms; });
+  return script;
+}
+
+static int countAudio(const SimReport &report, const char *prefix,
+                      uint32_t *firstMs = NULL) {
+  int count = 0;
+  for (const SimAudio &audio : report.audio) {
+    if (audio.command.compare(0, strlen(prefix), prefix) == 0) {
+      if (!count && firstMs) {
+        *firstMs = audio.ms;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+
+void test_parse_lines() {
+  SimEvent events[4];
+  int count;
+  std::string error;
+  TEST_ASSERT_TRUE(parseSimLine("100 hold 2 1500", events, count, error));
+  TEST_ASSERT_EQUAL_INT(2, count);
+  TEST_ASSERT_TRUE(events[0].input == SimInput::PRESS);
+  TEST_ASSERT_EQUAL_UINT32(1, events[0].button);
+  TEST_ASSERT_TRUE(events[1].input == SimInput::RELEASE);
+  TEST_ASSERT_EQUAL_UINT32(1600, events[1].ms);
+  TEST_ASSERT_TRUE(parseSimLine("200 clash 3.5", events, count, error));
+  TEST_ASSERT_EQUAL_UINT32(SIM_CLASH_MS, events[0].durationMs);
+  TEST_ASSERT_TRUE(parseSimLine("300 both 1200", events, count, error));
+  TEST_ASSERT_EQUAL_INT(4, count);
+  TEST_ASSERT_FALSE(parseSimLine("400 click 3", events, count, error));
+  TEST_ASSERT_FALSE(parseSimLine("500 jump", events, count, error));
+  TEST_ASSERT_FALSE(parseSimLine("click 1", events, count, error));
+}
+
+void test_ignition_lights_blade() {
+  const char *lines[] = {"500 click 1", "2500 end"};
+  SimReport report;
+  TEST_ASSERT_TRUE(simulate(parse(lines, 2), SimOptions(), report));
+  uint32_t ms = 0;
+  TEST_ASSERT_EQUAL_INT(1, countAudio(report, "effect poweron", &ms));
+  // a click is only a click once the double click window has passed
+  TEST_ASSERT_EQUAL_UINT32(500 + SIM_CLICK_MS + BUTTON_CLICK_WINDOW_MS, ms);
+  TEST_ASSERT_TRUE(strip.GetPixelColor(0) == RgbColor(255, 0, 0));
+  TEST_ASSERT_TRUE(strip.GetPixelColor(NUM_PIXELS / 2) == RgbColor(255, 0, 0));
+  TEST_ASSERT_EQUAL_UINT32(2500000 / (1000000 / RENDER_FPS) + 1,
+                           report.frames);
+}
+
+// while the saber idles the battery bar is drawn whole in one run
+void test_quiet_battery_bar() {
+  const char *lines[] = {"100 battery 50", "500 end"};
+  SimReport report;
+  simulate(parse(lines, 2), SimOptions(), report);
+  batteryBarQuiet = true;
+  showBatteryPercentage();
+  batteryBarQuiet = false;
+  TEST_ASSERT_TRUE(pushFrame());
+  long capacity = batteryBarCapacity();
+  TEST_ASSERT_TRUE(capacity > 0 && capacity < NUM_PIXELS / 2 - 1);
+  RgbColor color(red, green, blue);
+  TEST_ASSERT_TRUE(strip.GetPixelColor(0) == color);
+  TEST_ASSERT_TRUE(strip.GetPixelColor(capacity) == color);
+  TEST_ASSERT_TRUE(strip.GetPixelColor(NUM_PIXELS - 1 - capacity) == color);
+  TEST_ASSERT_TRUE(strip.GetPixelColor(capacity + 1) == RgbColor(0, 0, 0));
+  TEST_ASSERT_EQUAL_INT(-1, batteryBarPixel);
+}
+
+void test_bounce_is_one_click() {
+  const char *lines[] = {"500 click 1", "1500 click 2", "3000 end"};
+  SimOptions options;
+  options.bounceMs = BUTTON_DEBOUNCE_MS - 10;
+  SimReport report;
+  simulate(parse(lines, 3), options, report);
+  TEST_ASSERT_EQUAL_INT(1, countAudio(report, "effect poweron"));
+  TEST_ASSERT_EQUAL_INT(0, countAudio(report, "effect poweroff"));
+}
+
+void test_clash_latency() {
+  const char *lines[] = {"500 click 1", "2000 clash 4", "2500 clash 1",
+                         "4000 end"};
+  SimReport report;
+  simulate(parse(lines, 4), SimOptions(), report);
+  TEST_ASSERT_EQUAL_UINT32(2, report.clash.scripted);
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.hits);
+  TEST_ASSERT_EQUAL_UINT32(1, report.clash.misses); // under STRIKE_LIGHT
+  TEST_ASSERT_TRUE(report.clash.latencyMs.max <= JOB_MOTION_MS);
+  TEST_ASSERT_EQUAL_INT(1, countAudio(report, "effect clash"));
+}
+
+void test_slow_job_shows_as_lateness() {
+  const char *lines[] = {"500 click 1", "3000 end"};
+  SimOptions options;
+  SimReport report;
+  simulate(parse(lines, 2), options, report);
+  uint32_t fast = report.jobs[(int)SimJob::MOTION].lateness.max;
+  options.costUs[(int)SimJob::SERVICE] = 8000;
+  simulate(parse(lines, 2), options, report);
+  const SchedulerJob &motion = report.jobs[(int)SimJob::MOTION];
+  TEST_ASSERT_TRUE(motion.lateness.max > fast);
+  TEST_ASSERT_TRUE(motion.lateness.max >= 8000 - JOB_MOTION_MS * 1000);
+  TEST_ASSERT_TRUE(motion.skipped > 0);
+}
+
+void test_repeat_replays_script() {
+  const char *lines[] = {"1000 both 300", "3000 end"};
+  SimOptions options;
+  options.repeat = 3;
+  SimReport report;
+  simulate(parse(lines, 2), options, report);
+  TEST_ASSERT_EQUAL_UINT32(9000, report.durationMs);
+  TEST_ASSERT_EQUAL_INT(3, countAudio(report, "announce ip"));
+  // the first edge of a bouncing release counts
+  TEST_ASSERT_EQUAL_UINT32(7000 + 300, report.audio[2].ms);
+}
+
+void test_duel_is_reproducible() {
+  std::vector<SimEvent> script = duelScript(2, 7);
+  SimReport first, second;
+  simulate(script, SimOptions(), first);
+  simulate(script, SimOptions(), second);
+  TEST_ASSERT_TRUE(first.clash.scripted + first.swing.scripted > 40);
+  TEST_ASSERT_EQUAL_UINT32(first.frameHash, second.frameHash);
+  TEST_ASSERT_EQUAL_UINT32(first.audio.size(), second.audio.size());
+  TEST_ASSERT_EQUAL_UINT32(first.clash.hits, second.clash.hits);
+  TEST_ASSERT_EQUAL_UINT32(first.swing.latencyMs.sum,
+                           second.swing.latencyMs.sum);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_lines);
+  RUN_TEST(test_ignition_lights_blade);
+  RUN_TEST(test_quiet_battery_bar);
+  RUN_TEST(test_bounce_is_one_click);
+  RUN_TEST(test_clash_latency);
+  RUN_TEST(test_slow_job_shows_as_lateness);
+  RUN_TEST(test_repeat_replays_script);
+  RUN_TEST(test_duel_is_reproducible);
+  return UNITY_END();
+}
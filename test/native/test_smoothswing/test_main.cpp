@@ -0,0 +1,188 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unity.h>
+
+#include "smoothswing.h"
+
+// SmoothSwing engine: gain behaviour against a bank with silent loops, and
+// the per-block cost of update() + mix() against a bank with noisy ones.
+
+static const uint32_t RATE = 44100;
+static const uint16_t BLOCK = 1152; // one MP3 frame
+static const uint32_t BENCH_BLOCKS = 20000;
+
+static std::vector<uint8_t> bank;
+
+// two loops of the given ADPCM bytes, named like config.h expects
+static void buildBank(uint32_t frames, bool noise) {
+  uint32_t bytes = (frames + 1) / 2;
+  bank.assign(sizeof(SoundBankHeader) + 2 * sizeof(SoundBankEntry) + 2 * bytes,
+              0);
+  auto header = reinterpret_cast<SoundBankHeader *>(bank.data());
+  memcpy(header->magic, SOUNDBANK_MAGIC, 4);
+  header->version = 1;
+  header->count = 2;
+  header->sampleRate = 22050;
+  auto entries = reinterpret_cast<SoundBankEntry *>(bank.data() +
+                                                    sizeof(SoundBankHeader));
+  const char *names[2] = {SMOOTHSWING_LOW, SMOOTHSWING_HIGH};
+  for (int i = 0; i < 2; i++) {
+    strncpy(entries[i].name, names[i], SOUNDBANK_NAME_LEN);
+    entries[i].offset =
+        sizeof(SoundBankHeader) + 2 * sizeof(SoundBankEntry) + i * bytes;
+    entries[i].bytes = bytes;
+    entries[i].frames = frames;
+  }
+  if (noise) {
+    srand(1);
+    for (size_t i = entries[0].offset; i < bank.size(); i++) {
+      bank[i] = rand();
+    }
+  }
+}
+
+static MotionSample spin(float dps) {
+  MotionSample sample = {};
+  sample.gyro[2] = dps * MOTION_GYRO_LSB_PER_DPS;
+  return sample;
+}
+
+// runs blocks of a constant stream at a constant rotation, returns the
+// stream's first sample after the last one
+static int16_t run(SmoothSwing &swing, float dps, uint32_t blocks,
+                   bool duck = true) {
+  std::vector<int16_t> buffer(BLOCK * 2);
+  MotionSample sample = spin(dps);
+  for (uint32_t b = 0; b < blocks; b++) {
+    std::fill(buffer.begin(), buffer.end(), 1000);
+    swing.update(gyroPeakLsb(&sample, 1), BLOCK, RATE);
+    swing.mix(buffer.data(), BLOCK, 2, RATE, duck);
+  }
+  return buffer[0];
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_isqrt() {
+  for (uint32_t n : {0u, 1u, 2u, 99u, 100u, 65535u, 1u << 30, 3221225472u}) {
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)std::sqrt((double)n), isqrt32(n));
+  }
+  MotionSample sample = {0, {0, 0, 0}, {-32768, -32768, -32768}};
+  TEST_ASSERT_EQUAL_UINT32(56755, gyroPeakLsb(&sample, 1));
+}
+
+void test_missing_loops() {
+  buildBank(1000, false);
+  SmoothSwing swing = {};
+  TEST_ASSERT_FALSE(swing.begin(bank.data(), "nope", SMOOTHSWING_HIGH));
+  TEST_ASSERT_FALSE(swing.start());
+}
+
+void test_still_blade_leaves_stream() {
+  buildBank(1000, false);
+  SmoothSwing swing = {};
+  TEST_ASSERT_TRUE(swing.begin(bank.data(), SMOOTHSWING_LOW,
+                               SMOOTHSWING_HIGH));
+  TEST_ASSERT_TRUE(swing.start());
+  TEST_ASSERT_EQUAL_INT(1000, run(swing, SMOOTHSWING_THRESHOLD_DPS / 2, 50));
+  TEST_ASSERT_EQUAL_UINT32(0, swing.level);
+}
+
+void test_full_swing_ducks_hum() {
+  buildBank(1000, false);
+  SmoothSwing swing = {};
+  swing.begin(bank.data(), SMOOTHSWING_LOW, SMOOTHSWING_HIGH);
+  swing.start();
+  int16_t ducked = run(swing, SMOOTHSWING_SENSITIVITY_DPS * 2, 50);
+  TEST_ASSERT_EQUAL_UINT32(256, swing.level);
+  TEST_ASSERT_EQUAL_INT(1000 * (256 - SMOOTHSWING_HUM_DUCKING) / 256, ducked);
+  // music isn't ducked
+  TEST_ASSERT_EQUAL_INT(1000, run(swing, SMOOTHSWING_SENSITIVITY_DPS * 2, 2,
+                                  false));
+}
+
+void test_crossfade_is_equal_power() {
+  buildBank(1000, false);
+  SmoothSwing swing = {};
+  swing.begin(bank.data(), SMOOTHSWING_LOW, SMOOTHSWING_HIGH);
+  swing.start();
+  run(swing, SMOOTHSWING_SENSITIVITY_DPS, 50);
+  int32_t maxLow = 0, maxHigh = 0;
+  for (int i = 0; i < 200; i++) {
+    run(swing, SMOOTHSWING_SENSITIVITY_DPS, 1);
+    double low = (swing.low.gain >> 16) / 256.0;
+    double high = (swing.high.gain >> 16) / 256.0;
+    TEST_ASSERT_FLOAT_WITHIN(0.03, SMOOTHSWING_GAIN / 256.0,
+                             std::sqrt(low * low + high * high));
+    maxLow = std::max(maxLow, swing.low.gain >> 16);
+    maxHigh = std::max(maxHigh, swing.high.gain >> 16);
+  }
+  // the rotation sweeps all the way between the two tones
+  TEST_ASSERT_INT_WITHIN(3, SMOOTHSWING_GAIN, maxLow);
+  TEST_ASSERT_INT_WITHIN(3, SMOOTHSWING_GAIN, maxHigh);
+}
+
+void test_stop_fades_out() {
+  buildBank(1000, false);
+  SmoothSwing swing = {};
+  swing.begin(bank.data(), SMOOTHSWING_LOW, SMOOTHSWING_HIGH);
+  swing.start();
+  run(swing, SMOOTHSWING_SENSITIVITY_DPS, 50);
+  swing.stop();
+  run(swing, SMOOTHSWING_SENSITIVITY_DPS, 1);
+  TEST_ASSERT_TRUE(swing.running);
+  TEST_ASSERT_GREATER_THAN(0, swing.level);
+  run(swing, SMOOTHSWING_SENSITIVITY_DPS, 200);
+  TEST_ASSERT_FALSE(swing.running);
+  TEST_ASSERT_EQUAL_INT(1000, run(swing, 0, 1));
+}
+
+void test_block_cost() {
+  buildBank(22050, true);
+  SmoothSwing swing = {};
+  swing.begin(bank.data(), SMOOTHSWING_LOW, SMOOTHSWING_HIGH);
+  swing.start();
+  std::vector<int16_t> buffer(BLOCK * 2);
+  MotionSample samples[16];
+  for (int i = 0; i < 16; i++) {
+    samples[i] = spin(100 + i * 20);
+  }
+  int64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t b = 0; b < BENCH_BLOCKS; b++) {
+    for (uint16_t i = 0; i < BLOCK * 2; i++) {
+      buffer[i] = (int16_t)(i * 37);
+    }
+    swing.update(gyroPeakLsb(samples, 13), BLOCK, RATE);
+    swing.mix(buffer.data(), BLOCK, 2, RATE, true);
+    checksum += buffer[b % (BLOCK * 2)];
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  double nsPerBlock = ns / BENCH_BLOCKS;
+  double blockNs = 1e9 * BLOCK / RATE;
+  printf("%-10s %8s %12s %12s %12s\n", "block", "rate", "ns/block",
+         "ns/frame", "% of block");
+  printf("%-10u %8u %12.0f %12.2f %12.3f\n", BLOCK, RATE, nsPerBlock,
+         nsPerBlock / BLOCK, 100 * nsPerBlock / blockNs);
+  printf("checksum %lld\n", (long long)checksum);
+  TEST_ASSERT_LESS_THAN(blockNs, nsPerBlock);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_isqrt);
+  RUN_TEST(test_missing_loops);
+  RUN_TEST(test_still_blade_leaves_stream);
+  RUN_TEST(test_full_swing_ducks_hum);
+  RUN_TEST(test_crossfade_is_equal_power);
+  RUN_TEST(test_stop_fades_out);
+  RUN_TEST(test_block_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unity.h>
+
+#include "soundbank.h"
+#include "sounds.h"
+
+// Checks the bank built by soundbank.py against the MP3 durations that
+// getdurations.py reports (the tables in sounds.h).
+
+static std::vector<uint8_t> bank;
+
+// decoded length may differ from the MP3 header length by the encoder
+// delay/padding, allow two MP3 frames
+static const uint32_t DURATION_TOLERANCE_MS = 60;
+
+void setUp() {}
+void tearDown() {}
+
+static bool loadBank() {
+#ifdef SOUNDBANK_PATH
+  if (!bank.empty()) {
+    return true;
+  }
+  FILE *f = fopen(SOUNDBANK_PATH, "rb");
+  if (!f) {
+    return false;
+  }
+  fseek(f, 0, SEEK_END);
+  bank.resize(ftell(f));
+  fseek(f, 0, SEEK_SET);
+  size_t read = fread(bank.data(), 1, bank.size(), f);
+  fclose(f);
+  return read == bank.size();
+#else
+  return false;
+#endif
+}
+
+static void checkClips(const char *type, const unsigned long *durations) {
+  if (!loadBank()) {
+    TEST_IGNORE_MESSAGE("no sound bank, soundbank.py needs ffmpeg");
+  }
+  auto header = soundBankHeader(bank.data());
+  TEST_ASSERT_NOT_NULL(header);
+  for (int i = 0; i < 12; i++) {
+    char name[SOUNDBANK_NAME_LEN];
+    snprintf(name, sizeof(name), "%s%d", type, i + 1);
+    auto entry = soundBankFind(bank.data(), name);
+    TEST_ASSERT_NOT_NULL_MESSAGE(entry, name);
+    TEST_ASSERT_UINT32_WITHIN_MESSAGE(1, durations[i], entry->durationMs,
+                                      name);
+    uint32_t decodedMs = uint64_t(entry->frames) * 1000 / header->sampleRate;
+    TEST_ASSERT_UINT32_WITHIN_MESSAGE(DURATION_TOLERANCE_MS, durations[i],
+                                      decodedMs, name);
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE((entry->frames + 1) / 2, entry->bytes,
+                                     name);
+    TEST_ASSERT_TRUE_MESSAGE(entry->offset + entry->bytes <= bank.size(),
+                             name);
+  }
+}
+
+void test_clash_durations() { checkClips("clash", strikeDurations); }
+
+void test_swing_durations() { checkClips("swing", swingDurations); }
+
+void test_power_clips_present() {
+  if (!loadBank()) {
+    TEST_IGNORE_MESSAGE("no sound bank, soundbank.py needs ffmpeg");
+  }
+  TEST_ASSERT_NOT_NULL(soundBankFind(bank.data(), "poweron"));
+  TEST_ASSERT_NOT_NULL(soundBankFind(bank.data(), "poweroff"));
+  TEST_ASSERT_NULL(soundBankFind(bank.data(), "hum"));
+}
+
+void test_decoder_stays_in_clip() {
+  if (!loadBank()) {
+    TEST_IGNORE_MESSAGE("no sound bank, soundbank.py needs ffmpeg");
+  }
+  auto header = soundBankHeader(bank.data());
+  auto entries = soundBankEntries(bank.data());
+  for (uint16_t i = 0; i < header->count; i++) {
+    AdpcmDecoder decoder;
+    decoder.begin(bank.data(), entries[i]);
+    while (decoder.remaining) {
+      decoder.next();
+    }
+    const uint8_t *end = bank.data() + entries[i].offset + entries[i].bytes;
+    TEST_ASSERT_TRUE_MESSAGE(decoder.data <= end, entries[i].name);
+    TEST_ASSERT_EQUAL_INT(0, decoder.next());
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_clash_durations);
+  RUN_TEST(test_swing_durations);
+  RUN_TEST(test_power_clips_present);
+  RUN_TEST(test_decoder_stays_in_clip);
+  return UNITY_END();
+}
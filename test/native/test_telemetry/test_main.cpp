@@ -0,0 +1,64 @@
+#include <cstring>
+
+#include <unity.h>
+
+#include "telemetryframe.h"
+
+// Telemetry frames: decimation across batches of any size and the frame
+// size dashboards parse against.
+
+void setUp() {}
+void tearDown() {}
+
+static void fill(MotionSample *samples, size_t count, uint32_t first) {
+  memset(samples, 0, count * sizeof(MotionSample));
+  for (size_t i = 0; i < count; i++) {
+    samples[i].micros = first + i;
+  }
+}
+
+void test_no_decimation_keeps_everything() {
+  MotionSample samples[10];
+  TelemetryDecimator decimator;
+  fill(samples, 10, 0);
+  TEST_ASSERT_EQUAL(10, decimator.apply(samples, 10));
+  TEST_ASSERT_EQUAL(9, samples[9].micros);
+}
+
+void test_decimation_spans_batches() {
+  TelemetryDecimator decimator;
+  decimator.factor = 4;
+  MotionSample samples[7];
+  uint32_t kept[32];
+  size_t keptCount = 0;
+  uint32_t next = 0;
+  // 7 + 3 + 5 + 1 + 7 samples, every 4th kept regardless of the batching
+  const size_t batches[] = {7, 3, 5, 1, 7};
+  for (size_t batch : batches) {
+    fill(samples, batch, next);
+    next += batch;
+    size_t count = decimator.apply(samples, batch);
+    for (size_t i = 0; i < count; i++) {
+      kept[keptCount++] = samples[i].micros;
+    }
+  }
+  TEST_ASSERT_EQUAL(6, keptCount);
+  for (size_t i = 0; i < keptCount; i++) {
+    TEST_ASSERT_EQUAL(i * 4, kept[i]);
+  }
+}
+
+void test_frame_size() {
+  TEST_ASSERT_EQUAL(48, telemetryFrameSize(0, 0));
+  TEST_ASSERT_EQUAL(48 + 2 * 8 + 25 * 16, telemetryFrameSize(2, 25));
+  // samples stay 4 byte aligned after any number of events
+  TEST_ASSERT_EQUAL(0, telemetryFrameSize(3, 0) % 4);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_decimation_keeps_everything);
+  RUN_TEST(test_decimation_spans_batches);
+  RUN_TEST(test_frame_size);
+  return UNITY_END();
+}
@@ -0,0 +1,85 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "otapack.h"
+
+// Builds OTA packages for POST /ota (src/ota.h).
+//
+//   pio run -e otapack
+//   .pio/build/otapack/program [options] firmware.bin firmware.lota
+//
+// With --base the package is a delta against that image, which has to be
+// the firmware running on the saber. Packages are LZSS compressed unless
+// --raw is given.
+
+static bool readFile(const char *path, Bytes &out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+    out.insert(out.end(), chunk, chunk + n);
+  }
+  fclose(f);
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: otapack [options] firmware.bin out.lota\n"
+          "  --base OLD.bin     delta against the running firmware\n"
+          "  --raw              don't compress\n"
+          "  --window BITS      LZSS window, 4-12 (12)\n"
+          "  --lookahead BITS   LZSS longest match, below window (4)\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *basePath = nullptr;
+  bool compress = true;
+  int windowBits = 12, lookaheadBits = 4;
+  const char *paths[2];
+  int pathCount = 0;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--base") && i + 1 < argc) {
+      basePath = argv[++i];
+    } else if (!strcmp(argv[i], "--raw")) {
+      compress = false;
+    } else if (!strcmp(argv[i], "--window") && i + 1 < argc) {
+      windowBits = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--lookahead") && i + 1 < argc) {
+      lookaheadBits = atoi(argv[++i]);
+    } else if (argv[i][0] == '-' || pathCount == 2) {
+      usage();
+    } else {
+      paths[pathCount++] = argv[i];
+    }
+  }
+  if (pathCount != 2 || windowBits < 4 || windowBits > OTA_WINDOW_BITS_MAX ||
+      lookaheadBits < 1 || lookaheadBits >= windowBits) {
+    usage();
+  }
+  Bytes image, base;
+  if (!readFile(paths[0], image)) {
+    fprintf(stderr, "%s: can't read\n", paths[0]);
+    return 1;
+  }
+  if (basePath && !readFile(basePath, base)) {
+    fprintf(stderr, "%s: can't read\n", basePath);
+    return 1;
+  }
+  Bytes package = otaPackage(image, base, compress, windowBits, lookaheadBits);
+  FILE *f = fopen(paths[1], "wb");
+  if (!f || fwrite(package.data(), 1, package.size(), f) != package.size()) {
+    fprintf(stderr, "%s: can't write\n", paths[1]);
+    return 1;
+  }
+  fclose(f);
+  printf("%s: %zu bytes, %.1f%% of %zu%s\n", paths[1], package.size(),
+         100.0 * package.size() / image.size(), image.size(),
+         basePath ? " (delta)" : "");
+  return 0;
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "otastream.h"
+
+// Host side of src/otastream.h: builds OTA packages, optionally as a delta
+// against the firmware currently on the saber, optionally LZSS compressed.
+
+typedef std::vector<uint8_t> Bytes;
+
+inline void putVarint(Bytes &out, uint32_t value) {
+  while (value >= 0x80) {
+    out.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(value);
+}
+
+// Greedy delta: 16 byte blocks of the base are indexed, every image position
+// is looked up and extended both ways; the rest goes out as literals.
+inline Bytes deltaEncode(const Bytes &base, const Bytes &image) {
+  const size_t BLOCK = 16;
+  std::unordered_map<std::string, uint32_t> index;
+  for (size_t i = 0; i + BLOCK <= base.size(); i += 4) {
+    index.emplace(std::string((const char *)&base[i], BLOCK), i);
+  }
+  Bytes ops;
+  size_t literalStart = 0;
+  uint32_t baseNext = 0;
+  auto flushLiteral = [&](size_t end) {
+    if (end > literalStart) {
+      ops.push_back(0x00);
+      putVarint(ops, end - literalStart);
+      ops.insert(ops.end(), image.begin() + literalStart, image.begin() + end);
+    }
+  };
+  size_t pos = 0;
+  while (pos + BLOCK <= image.size()) {
+    // the spot right after the previous copy is the likeliest match
+    size_t from = SIZE_MAX;
+    if (baseNext + BLOCK <= base.size() &&
+        memcmp(&base[baseNext], &image[pos], BLOCK) == 0) {
+      from = baseNext;
+    } else {
+      auto hit = index.find(std::string((const char *)&image[pos], BLOCK));
+      if (hit != index.end()) {
+        from = hit->second;
+      }
+    }
+    if (from == SIZE_MAX) {
+      pos++;
+      continue;
+    }
+    size_t start = pos;
+    while (start > literalStart && from > 0 &&
+           image[start - 1] == base[from - 1]) {
+      start--;
+      from--;
+    }
+    size_t len = 0;
+    while (start + len < image.size() && from + len < base.size() &&
+           image[start + len] == base[from + len]) {
+      len++;
+    }
+    flushLiteral(start);
+    int32_t diff = (int32_t)from - (int32_t)baseNext;
+    ops.push_back(0x01);
+    putVarint(ops, ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31));
+    putVarint(ops, len);
+    baseNext = from + len;
+    pos = start + len;
+    literalStart = pos;
+  }
+  flushLiteral(image.size());
+  return ops;
+}
+
+class BitWriter {
+  Bytes &out;
+  uint32_t bits = 0;
+  uint8_t count = 0;
+
+public:
+  explicit BitWriter(Bytes &target) : out(target) {}
+
+  void put(uint32_t value, uint8_t n) {
+    while (n--) {
+      bits = bits << 1 | ((value >> n) & 1);
+      if (++count == 8) {
+        out.push_back(bits);
+        bits = 0;
+        count = 0;
+      }
+    }
+  }
+
+  void finish() {
+    if (count) {
+      out.push_back(bits << (8 - count));
+    }
+  }
+};
+
+// heatshrink-compatible LZSS, greedy longest match over hash chains
+inline Bytes lzssEncode(const Bytes &in, uint8_t windowBits,
+                        uint8_t lookaheadBits) {
+  const size_t window = 1u << windowBits;
+  const size_t maxLen = 1u << lookaheadBits;
+  const int CHAIN = 64;
+  // a back reference has to beat literals: 1 + w + l bits vs 9 per byte
+  const size_t minLen = (1 + windowBits + lookaheadBits) / 9 + 1;
+  Bytes out;
+  BitWriter writer(out);
+  std::vector<int32_t> head(1 << 16, -1), prev(in.size(), -1);
+  auto hash = [&](size_t i) {
+    return (in[i] << 8 ^ in[i + 1] << 4 ^ in[i + 2]) & 0xFFFF;
+  };
+  size_t pos = 0;
+  auto insert = [&](size_t i) {
+    if (i + 2 < in.size()) {
+      uint32_t h = hash(i);
+      prev[i] = head[h];
+      head[h] = i;
+    }
+  };
+  while (pos < in.size()) {
+    size_t bestLen = 0, bestDistance = 0;
+    if (pos + 2 < in.size()) {
+      int32_t candidate = head[hash(pos)];
+      for (int chain = 0; candidate >= 0 && chain < CHAIN; chain++) {
+        size_t distance = pos - candidate;
+        if (distance > window) {
+          break;
+        }
+        size_t len = 0;
+        while (len < maxLen && pos + len < in.size() &&
+               in[candidate + len] == in[pos + len]) {
+          len++;
+        }
+        if (len > bestLen) {
+          bestLen = len;
+          bestDistance = distance;
+        }
+        candidate = prev[candidate];
+      }
+    }
+    if (bestLen >= minLen) {
+      writer.put(0, 1);
+      writer.put(bestDistance - 1, windowBits);
+      writer.put(bestLen - 1, lookaheadBits);
+    } else {
+      bestLen = 1;
+      writer.put(1, 1);
+      writer.put(in[pos], 8);
+    }
+    for (size_t i = 0; i < bestLen; i++) {
+      insert(pos + i);
+    }
+    pos += bestLen;
+  }
+  writer.finish();
+  return out;
+}
+
+// base empty for a full image
+inline Bytes otaPackage(const Bytes &image, const Bytes &base, bool compress,
+                        uint8_t windowBits = 12, uint8_t lookaheadBits = 4) {
+  OtaHeader header = {};
+  memcpy(header.magic, OTA_MAGIC, 4);
+  header.version = OTA_VERSION;
+  header.imageSize = image.size();
+  header.imageCrc = crc32Update(0, image.data(), image.size());
+  Bytes body = image;
+  if (!base.empty()) {
+    header.flags |= OTA_DELTA;
+    header.baseSize = base.size();
+    header.baseCrc = crc32Update(0, base.data(), base.size());
+    body = deltaEncode(base, image);
+  }
+  if (compress) {
+    Bytes packed = lzssEncode(body, windowBits, lookaheadBits);
+    // already compressed data only grows
+    if (packed.size() < body.size()) {
+      header.flags |= OTA_COMPRESSED;
+      header.windowBits = windowBits;
+      header.lookaheadBits = lookaheadBits;
+      body.swap(packed);
+    }
+  }
+  Bytes package(sizeof(header) + body.size());
+  memcpy(package.data(), &header, sizeof(header));
+  if (!body.empty()) {
+    memcpy(package.data() + sizeof(header), body.data(), body.size());
+  }
+  return package;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+// Replays IMU traces recorded with the "trace start" WebSerial command
+// through the firmware's clash/swing detection.
+//
+//   pio run -e replay
+//   .pio/build/replay/program [options] trace000.imu [trace001.imu ...]
+//
+// Labels are read from the trace's sibling .csv (trace000.csv) when present.
+// Thresholds and cooldowns default to detect.h and can be overridden to try
+// new values against the whole recording library at once.
+
+static void usage() {
+  fprintf(stderr,
+          "usage: replay [options] trace.imu...\n"
+          "  --strike LIGHT[,STRONG]  clash thresholds, m/s^2\n"
+          "  --swing LIGHT[,STRONG]   swing thresholds, rad/s\n"
+          "  --strike-cooldown MS\n"
+          "  --swing-cooldown MS\n"
+          "  --window MS              detect on per-window peaks like loop()\n"
+          "  --match BEFORE,AFTER     label match window, ms\n"
+          "  -v                       list every detection\n");
+}
+
+static void parsePair(const char *arg, float &first, float &second) {
+  char *end;
+  first = strtof(arg, &end);
+  if (*end == ',') {
+    second = strtof(end + 1, NULL);
+  }
+}
+
+static void addStats(EventStats &total, const EventStats &stats) {
+  if (stats.hits) {
+    total.latencyMax = total.hits ? std::max(total.latencyMax, stats.latencyMax)
+                                  : stats.latencyMax;
+  }
+  total.labels += stats.labels;
+  total.detections += stats.detections;
+  total.hits += stats.hits;
+  total.falsePositives += stats.falsePositives;
+  total.misses += stats.misses;
+  total.latencyTotal += stats.latencyTotal;
+}
+
+static void printStats(const char *name, const EventStats &stats,
+                       uint32_t durationMs, bool labelled) {
+  float minutes = durationMs / 60000.0f;
+  printf("  %s: %u detected (%.1f/min)", name, stats.detections,
+         minutes > 0 ? stats.detections / minutes : 0.0f);
+  if (labelled) {
+    printf(", %u/%u labels hit, %u missed, %u false (%.1f/min)", stats.hits,
+           stats.labels, stats.misses, stats.falsePositives,
+           minutes > 0 ? stats.falsePositives / minutes : 0.0f);
+    if (stats.hits) {
+      printf(", latency mean %.1f ms max %d ms",
+             (double)stats.latencyTotal / stats.hits, stats.latencyMax);
+    }
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  MotionDetector detector;
+  ReplayOptions options;
+  bool verbose = false;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--strike") == 0 && hasValue) {
+      parsePair(argv[++i], detector.strike.lightTh, detector.strike.strongTh);
+    } else if (strcmp(arg, "--swing") == 0 && hasValue) {
+      parsePair(argv[++i], detector.swing.lightTh, detector.swing.strongTh);
+    } else if (strcmp(arg, "--strike-cooldown") == 0 && hasValue) {
+      detector.strike.cooldown = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--swing-cooldown") == 0 && hasValue) {
+      detector.swing.cooldown = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--window") == 0 && hasValue) {
+      options.windowMs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--match") == 0 && hasValue) {
+      float before = 0, after = options.matchAfterMs;
+      parsePair(argv[++i], before, after);
+      options.matchBeforeMs = before;
+      options.matchAfterMs = after;
+    } else if (strcmp(arg, "-v") == 0) {
+      verbose = true;
+    } else if (arg[0] == '-') {
+      usage();
+      return 2;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.empty()) {
+    usage();
+    return 2;
+  }
+
+  printf("clash %.1f/%.1f m/s^2 %lu ms, swing %.2f/%.2f rad/s %lu ms, "
+         "window %u ms\n",
+         detector.strike.lightTh, detector.strike.strongTh,
+         detector.strike.cooldown, detector.swing.lightTh,
+         detector.swing.strongTh, detector.swing.cooldown, options.windowMs);
+  EventStats clash = {}, swing = {};
+  uint32_t durationMs = 0, labelledMs = 0;
+  bool failed = false;
+  for (const char *path : paths) {
+    Trace trace;
+    std::string error;
+    if (!loadTrace(path, trace, error)) {
+      fprintf(stderr, "%s: %s\n", path, error.c_str());
+      failed = true;
+      continue;
+    }
+    std::string labelPath(path);
+    size_t dot = labelPath.rfind('.');
+    labelPath = labelPath.substr(0, dot) + ".csv";
+    std::vector<Label> labels;
+    bool labelled = loadLabels(labelPath.c_str(), labels);
+
+    ReplayReport report = replay(trace, labels, detector, options);
+    printf("%s: %u samples, %u dropped, %.1f s%s\n", path, report.samples,
+           report.dropped, report.durationMs / 1000.0f,
+           labelled ? "" : ", unlabelled");
+    if (verbose) {
+      for (const Detection &detection : report.detections) {
+        printf("  %8u ms %s%s\n", detection.ms, eventName(detection.event),
+               detection.strong ? " strong" : "");
+      }
+    }
+    printStats("clash", report.clash, report.durationMs, labelled);
+    printStats("swing", report.swing, report.durationMs, labelled);
+    // false-positive rates only make sense over labelled time
+    if (labelled) {
+      addStats(clash, report.clash);
+      addStats(swing, report.swing);
+      labelledMs += report.durationMs;
+    }
+    durationMs += report.durationMs;
+  }
+  if (paths.size() > 1 && labelledMs > 0) {
+    printf("total, %.1f s labelled of %.1f s:\n", labelledMs / 1000.0f,
+           durationMs / 1000.0f);
+    printStats("clash", clash, labelledMs, true);
+    printStats("swing", swing, labelledMs, true);
+  }
+  return failed ? 1 : 0;
+}
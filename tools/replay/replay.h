@@ -0,0 +1,233 @@
+#pragma once
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "detect.h"
+#include "sounds.h"
+#include "trace.h"
+
+// Host side of the IMU trace recorder: loads /traceNNN.imu files and runs
+// them through detect.h the way loop() does, optionally scored against hand
+// labelled events. Header only so the native tests can exercise it.
+
+struct Trace {
+  TraceHeader header;
+  std::vector<MotionSample> samples;
+};
+
+// Ground truth, one "ms,clash" or "ms,swing" line per event, ms from the
+// first sample of the trace. Lines starting with # are ignored.
+struct Label {
+  uint32_t ms;
+  MotionEvent event;
+};
+
+struct Detection {
+  uint32_t ms; // from the first sample
+  MotionEvent event;
+  bool strong;
+};
+
+struct ReplayOptions {
+  // 0 runs the detector on every sample, otherwise on the peaks of windowMs
+  // long windows like get_freq() does once per loop()
+  uint32_t windowMs = 0;
+  // a detection matches a label of the same kind within this window
+  uint32_t matchBeforeMs = 20;
+  uint32_t matchAfterMs = 250;
+};
+
+struct EventStats {
+  uint32_t labels;
+  uint32_t detections;
+  uint32_t hits;
+  uint32_t falsePositives;
+  uint32_t misses;
+  int64_t latencyTotal; // ms, over hits
+  int32_t latencyMax;
+};
+
+struct ReplayReport {
+  uint32_t durationMs;
+  uint32_t samples;
+  uint32_t dropped;
+  EventStats clash;
+  EventStats swing;
+  std::vector<Detection> detections;
+};
+
+inline const char *eventName(MotionEvent event) {
+  switch (event) {
+  case MotionEvent::CLASH:
+    return "clash";
+  case MotionEvent::SWING:
+    return "swing";
+  default:
+    return "none";
+  }
+}
+
+inline bool loadTrace(const char *path, Trace &trace, std::string &error) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    error = "cannot open";
+    return false;
+  }
+  bool ok = fread(&trace.header, sizeof(trace.header), 1, f) == 1;
+  if (!ok || memcmp(trace.header.magic, TRACE_MAGIC, 4) != 0) {
+    error = "not a trace file";
+    ok = false;
+  } else if (trace.header.version != TRACE_VERSION) {
+    error = "unsupported trace version";
+    ok = false;
+  } else if (trace.header.accelLsbPerG != MOTION_ACCEL_LSB_PER_G ||
+             trace.header.gyroLsbPerDps != MOTION_GYRO_LSB_PER_DPS) {
+    error = "recorded with different sensor ranges";
+    ok = false;
+  }
+  if (ok) {
+    // the header count is only patched on a clean stop, trust the length
+    MotionSample sample;
+    trace.samples.clear();
+    while (fread(&sample, sizeof(sample), 1, f) == 1) {
+      trace.samples.push_back(sample);
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+inline bool loadLabels(const char *path, std::vector<Label> &labels) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return false;
+  }
+  char line[64];
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long ms;
+    char kind[16];
+    if (line[0] == '#' || sscanf(line, "%lu,%15s", &ms, kind) != 2) {
+      continue;
+    }
+    if (strcmp(kind, "clash") == 0) {
+      labels.push_back({(uint32_t)ms, MotionEvent::CLASH});
+    } else if (strcmp(kind, "swing") == 0) {
+      labels.push_back({(uint32_t)ms, MotionEvent::SWING});
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+inline unsigned long meanDuration(const unsigned long *durations) {
+  unsigned long total = 0;
+  for (int i = 0; i < 12; i++) {
+    total += durations[i];
+  }
+  return total / 12;
+}
+
+// Effect lengths use the mean clip duration instead of the firmware's random
+// pick so runs are reproducible.
+inline std::vector<Detection> detectTrace(const Trace &trace,
+                                          MotionDetector detector,
+                                          const ReplayOptions &options) {
+  std::vector<Detection> detections;
+  if (trace.samples.empty()) {
+    return detections;
+  }
+  // keep "now" clear of zero so the detector starts outside its cooldowns
+  const unsigned long epoch = 60000;
+  uint64_t elapsedUs = 0;
+  uint32_t lastMicros = trace.samples[0].micros;
+  uint32_t windowEnd = options.windowMs;
+  float acc = 0, gyr = 0;
+  for (size_t i = 0; i < trace.samples.size(); i++) {
+    const MotionSample &sample = trace.samples[i];
+    elapsedUs += (uint32_t)(sample.micros - lastMicros); // wraps at 71 min
+    lastMicros = sample.micros;
+    uint32_t ms = elapsedUs / 1000;
+    acc = std::max(acc, accelMagnitude(sample));
+    gyr = std::max(gyr, gyroMagnitude(sample));
+    if (ms < windowEnd && i + 1 < trace.samples.size()) {
+      continue;
+    }
+    windowEnd = ms + options.windowMs;
+    unsigned long now = epoch + ms;
+    MotionEvent event = detectMotion(detector, acc, gyr, now);
+    if (event == MotionEvent::CLASH) {
+      effectStarted(detector, event, now, meanDuration(strikeDurations));
+      detections.push_back({ms, event, acc > detector.strike.strongTh});
+    } else if (event == MotionEvent::SWING) {
+      effectStarted(detector, event, now, meanDuration(swingDurations));
+      detections.push_back({ms, event, gyr > detector.swing.strongTh});
+    }
+    acc = 0;
+    gyr = 0;
+  }
+  return detections;
+}
+
+// Greedy in time order: each label takes the earliest unmatched detection
+// of its kind inside the match window.
+inline void scoreEvents(const std::vector<Label> &labels,
+                        const std::vector<Detection> &detections,
+                        MotionEvent event, const ReplayOptions &options,
+                        EventStats &stats) {
+  stats = {};
+  std::vector<bool> matched(detections.size(), false);
+  for (const Detection &detection : detections) {
+    if (detection.event == event) {
+      stats.detections++;
+    }
+  }
+  for (const Label &label : labels) {
+    if (label.event != event) {
+      continue;
+    }
+    stats.labels++;
+    bool hit = false;
+    for (size_t i = 0; i < detections.size() && !hit; i++) {
+      const Detection &detection = detections[i];
+      if (matched[i] || detection.event != event ||
+          detection.ms + options.matchBeforeMs < label.ms ||
+          detection.ms > label.ms + options.matchAfterMs) {
+        continue;
+      }
+      matched[i] = true;
+      hit = true;
+      int32_t latency = (int32_t)(detection.ms - label.ms);
+      stats.latencyTotal += latency;
+      stats.latencyMax =
+          stats.hits ? std::max(stats.latencyMax, latency) : latency;
+      stats.hits++;
+    }
+    if (!hit) {
+      stats.misses++;
+    }
+  }
+  stats.falsePositives = stats.detections - stats.hits;
+}
+
+inline ReplayReport replay(const Trace &trace,
+                           const std::vector<Label> &labels,
+                           const MotionDetector &detector,
+                           const ReplayOptions &options) {
+  ReplayReport report = {};
+  report.samples = trace.samples.size();
+  report.dropped = trace.header.dropped;
+  if (!trace.samples.empty()) {
+    report.durationMs =
+        (trace.samples.back().micros - trace.samples.front().micros) / 1000;
+  }
+  report.detections = detectTrace(trace, detector, options);
+  scoreEvents(labels, report.detections, MotionEvent::CLASH, options,
+              report.clash);
+  scoreEvents(labels, report.detections, MotionEvent::SWING, options,
+              report.swing);
+  return report;
+}
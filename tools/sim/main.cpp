@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "sim.h"
+
+// Runs the saber's loop on a virtual clock against scripted inputs.
+//
+//   pio run -e sim
+//   .pio/build/sim/program [options] script.txt
+//   .pio/build/sim/program [options] --duel MINUTES
+//
+// Prints the clash/swing trigger latency and every loop job's lateness,
+// optionally writes the audio commands with their timestamps and the LED
+// frames as a PPM image, one row per frame.
+
+static void usage() {
+  fprintf(stderr,
+          "usage: sim [options] script.txt | --duel MINUTES\n"
+          "  --duel MINUTES   random clashes and swings instead of a script\n"
+          "  --repeat N       run the script N times back to back\n"
+          "  --seed N         effect clips and --duel inputs\n"
+          "  --bounce MS      button contact bounce (default 3)\n"
+          "  --cost JOB=US    virtual CPU time per run of a loop job\n"
+          "  --audio FILE     audio command log, \"ms command\" per line\n"
+          "  --frames FILE    LED frames as a PPM, one row per frame\n"
+          "  --frame-every N  keep every N-th frame in the PPM\n");
+}
+
+static bool parseCost(const char *arg, SimOptions &options) {
+  const char *eq = strchr(arg, '=');
+  if (!eq) {
+    return false;
+  }
+  for (int i = 0; i < (int)SimJob::COUNT; i++) {
+    if (strncmp(arg, simJobNames[i], eq - arg) == 0 &&
+        simJobNames[i][eq - arg] == 0) {
+      options.costUs[i] = strtoul(eq + 1, NULL, 10);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void printTriggers(const char *name, const SimTriggers &stats) {
+  printf("%s: %u scripted, %u detected, %u hit, %u missed", name,
+         stats.scripted, stats.detected, stats.hits, stats.misses);
+  if (stats.hits) {
+    printf(", latency mean %.1f ms p99 %u ms max %u ms",
+           (double)stats.latencyMs.sum / stats.latencyMs.count,
+           stats.latencyMs.percentile(0.99), stats.latencyMs.max);
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  SimOptions options;
+  uint32_t duelMinutes = 0;
+  const char *scriptPath = NULL;
+  const char *audioPath = NULL;
+  const char *framesPath = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--duel") == 0 && hasValue) {
+      duelMinutes = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--repeat") == 0 && hasValue) {
+      options.repeat = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      options.seed = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--bounce") == 0 && hasValue) {
+      options.bounceMs = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--cost") == 0 && hasValue) {
+      if (!parseCost(argv[++i], options)) {
+        usage();
+        return 2;
+      }
+    } else if (strcmp(arg, "--audio") == 0 && hasValue) {
+      audioPath = argv[++i];
+    } else if (strcmp(arg, "--frames") == 0 && hasValue) {
+      framesPath = argv[++i];
+    } else if (strcmp(arg, "--frame-every") == 0 && hasValue) {
+      options.frameEvery = strtoul(argv[++i], NULL, 10);
+    } else if (arg[0] == '-' || scriptPath) {
+      usage();
+      return 2;
+    } else {
+      scriptPath = arg;
+    }
+  }
+  if (!scriptPath == !duelMinutes || !options.repeat) {
+    usage();
+    return 2;
+  }
+
+  std::vector<SimEvent> script;
+  if (scriptPath) {
+    std::string error;
+    if (!loadScript(scriptPath, script, error)) {
+      fprintf(stderr, "%s: %s\n", scriptPath, error.c_str());
+      return 1;
+    }
+  } else {
+    script = duelScript(duelMinutes, options.seed);
+  }
+  // the height is patched in once the frame count is known
+  const char *header = "P6\n%d %-10u\n255\n";
+  if (framesPath) {
+    options.frames = fopen(framesPath, "wb");
+    if (!options.frames) {
+      fprintf(stderr, "%s: cannot create\n", framesPath);
+      return 1;
+    }
+    fprintf(options.frames, header, NUM_PIXELS, 0u);
+  }
+
+  SimReport report;
+  auto start = std::chrono::steady_clock::now();
+  if (!simulate(script, options, report)) {
+    fprintf(stderr, "empty script\n");
+    return 1;
+  }
+  double wall = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+
+  if (options.frames) {
+    uint32_t rows = (report.frames + options.frameEvery - 1) /
+                    std::max(options.frameEvery, 1u);
+    fseek(options.frames, 0, SEEK_SET);
+    fprintf(options.frames, header, NUM_PIXELS, rows);
+    fclose(options.frames);
+  }
+  if (audioPath) {
+    FILE *f = fopen(audioPath, "w");
+    if (!f) {
+      fprintf(stderr, "%s: cannot create\n", audioPath);
+      return 1;
+    }
+    for (const SimAudio &audio : report.audio) {
+      fprintf(f, "%u %s\n", audio.ms, audio.command.c_str());
+    }
+    fclose(f);
+  }
+
+  printf("%.1f s simulated in %.2f s (%.0fx), %u frames, %u shown, "
+         "hash %08x, %zu audio commands\n",
+         report.durationMs / 1000.0, wall,
+         wall > 0 ? report.durationMs / 1000.0 / wall : 0.0, report.frames,
+         report.shows, report.frameHash, report.audio.size());
+  printTriggers("clash", report.clash);
+  printTriggers("swing", report.swing);
+  for (const SchedulerJob &job : report.jobs) {
+    printf("%-9s n=%u late p50=%uus p99=%uus max=%uus, %u overruns "
+           "(max %uus), %u skipped\n",
+           job.name, job.runs, job.lateness.percentile(0.5),
+           job.lateness.percentile(0.99), job.lateness.max, job.overruns,
+           job.overrun.max, job.skipped);
+  }
+  return 0;
+}
@@ -0,0 +1,602 @@
+#pragma once
+#include <Arduino.h>
+#include <NeoPixelBusLg.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "buttongesture.h"
+#include "detect.h"
+#include "histogram.h"
+#include "led.h"
+#include "motion.h"
+#include "motionsample.h"
+#include "saber.h"
+#include "scheduler.h"
+#include "sounds.h"
+
+// Host simulation of the saber's loop on the native shim's virtual clock.
+// The loop jobs of main.cpp run on the real scheduler.h, fed by scripted
+// buttons (through buttongesture.h, edges timestamped as the ISR does),
+// scripted IMU motion at MOTION_RATE_HZ (through detect.h) and a scripted
+// battery level. The render task's frames come from led.h at RENDER_FPS.
+// Each job advances the clock by a configurable cost, so lateness comes out
+// of the same histograms the firmware reports. The saber itself (ignition,
+// effects, volume, the battery bar, the frames) is saber.h, the code the
+// firmware runs, on a SimPlatform; Wi-Fi, the web services and the audio
+// decoder are not simulated, audio commands are only logged. Everything is
+// deterministic for a given script and seed. Header only so the native tests
+// can exercise it; like led.h, include it once per program.
+
+#define SIM_EPOCH_US 60000000ull // keeps the detector clear of its cooldowns
+#define SIM_CLICK_MS 80
+#define SIM_CLASH_MS 4
+#define SIM_SWING_MS 150
+#define SIM_MATCH_MS 250 // an onset is missed if nothing detects it sooner
+
+enum class SimInput : uint8_t { PRESS, RELEASE, CLASH, SWING, BATTERY, END };
+
+// One scripted input, ms from the start of the run
+struct SimEvent {
+  uint32_t ms;
+  SimInput input;
+  uint8_t button;      // PRESS/RELEASE, 0 or 1
+  float value;         // g for CLASH, deg/s for SWING, % for BATTERY
+  uint32_t durationMs; // CLASH/SWING
+};
+
+enum class SimJob : uint8_t {
+  MOTION,
+  BUTTONS,
+  AUDIO,
+  SERVICE,
+  BATTERY,
+  VOLUME,
+  SETTINGS,
+  COUNT
+};
+
+static const char *const simJobNames[] = {
+    "motion", "buttons", "audio", "service", "battery", "volume", "settings"};
+
+struct SimOptions {
+  uint32_t repeat = 1; // the script back to back
+  uint32_t seed = 1;
+  uint32_t bounceMs = 3; // contact bounce on every scripted press and release
+  // virtual CPU time per run, us; the defaults are rough, measure them with
+  // the "jobs" and "profile" WebSerial commands
+  uint32_t costUs[(int)SimJob::COUNT] = {150, 20, 80, 300, 40, 10, 30};
+  FILE *frames = NULL; // PPM, one row per rendered frame
+  uint32_t frameEvery = 1;
+};
+
+// A level change as the button ISR queues it
+struct SimEdge {
+  uint32_t ms;
+  uint8_t button;
+  bool pressed;
+};
+
+struct SimAudio {
+  uint32_t ms; // from the start of the run
+  std::string command;
+};
+
+struct SimTriggers {
+  uint32_t scripted; // onsets while the blade was on
+  uint32_t detected;
+  uint32_t hits;
+  uint32_t misses;
+  Histogram latencyMs; // onset -> detection, over hits
+};
+
+struct SimReport {
+  uint32_t durationMs;
+  uint32_t frames;
+  uint32_t shows; // frames that changed
+  uint32_t frameHash;
+  SimTriggers clash;
+  SimTriggers swing;
+  std::vector<SimAudio> audio;
+  SchedulerJob jobs[(int)SimJob::COUNT];
+};
+
+inline bool parseSimLine(const char *line, SimEvent *events, int &count,
+                         std::string &error) {
+  unsigned long ms;
+  char command[16];
+  int used = 0;
+  count = 0;
+  if (sscanf(line, "%lu %15s %n", &ms, command, &used) != 2) {
+    error = "expected: MS COMMAND [ARGS]";
+    return false;
+  }
+  const char *args = line + used;
+  unsigned button = 0;
+  float value = 0;
+  unsigned long duration = 0;
+  SimEvent event = {(uint32_t)ms, SimInput::END, 0, 0, 0};
+  if (strcmp(command, "press") == 0 || strcmp(command, "release") == 0) {
+    if (sscanf(args, "%u", &button) != 1 || button < 1 || button > 2) {
+      error = "button 1 or 2";
+      return false;
+    }
+    event.input = command[0] == 'p' ? SimInput::PRESS : SimInput::RELEASE;
+    event.button = button - 1;
+    events[count++] = event;
+  } else if (strcmp(command, "click") == 0 || strcmp(command, "hold") == 0) {
+    int n = sscanf(args, "%u %lu", &button, &duration);
+    if (n < 1 || button < 1 || button > 2 || (command[0] == 'h' && n < 2)) {
+      error = command[0] == 'h' ? "hold BUTTON MS" : "click BUTTON";
+      return false;
+    }
+    event.input = SimInput::PRESS;
+    event.button = button - 1;
+    events[count++] = event;
+    event.ms += command[0] == 'h' ? duration : SIM_CLICK_MS;
+    event.input = SimInput::RELEASE;
+    events[count++] = event;
+  } else if (strcmp(command, "both") == 0) {
+    if (sscanf(args, "%lu", &duration) != 1) {
+      error = "both MS";
+      return false;
+    }
+    for (uint8_t b = 0; b < BUTTON_COUNT; b++) {
+      events[count++] = {(uint32_t)ms, SimInput::PRESS, b, 0, 0};
+      events[count++] = {(uint32_t)(ms + duration), SimInput::RELEASE, b, 0,
+                         0};
+    }
+  } else if (strcmp(command, "clash") == 0 || strcmp(command, "swing") == 0) {
+    bool clash = command[0] == 'c';
+    duration = clash ? SIM_CLASH_MS : SIM_SWING_MS;
+    if (sscanf(args, "%f %lu", &value, &duration) < 1) {
+      error = clash ? "clash G [MS]" : "swing DEG_PER_S [MS]";
+      return false;
+    }
+    event.input = clash ? SimInput::CLASH : SimInput::SWING;
+    event.value = value;
+    event.durationMs = duration;
+    events[count++] = event;
+  } else if (strcmp(command, "battery") == 0) {
+    if (sscanf(args, "%f", &value) != 1) {
+      error = "battery PERCENT";
+      return false;
+    }
+    event.input = SimInput::BATTERY;
+    event.value = value;
+    events[count++] = event;
+  } else if (strcmp(command, "end") == 0) {
+    events[count++] = event;
+  } else {
+    error = "unknown command";
+    return false;
+  }
+  return true;
+}
+
+// One "MS COMMAND [ARGS]" per line, # starts a comment:
+//   press|release BUTTON, click BUTTON, hold BUTTON MS, both MS,
+//   clash G [MS], swing DEG_PER_S [MS], battery PERCENT, end
+inline bool loadScript(const char *path, std::vector<SimEvent> &script,
+                       std::string &error) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    error = "cannot open";
+    return false;
+  }
+  char line[128];
+  int number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    number++;
+    char *comment = strchr(line, '#');
+    if (comment) {
+      *comment = 0;
+    }
+    if (strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+    SimEvent events[4];
+    int count;
+    ok = parseSimLine(line, events, count, error);
+    if (!ok) {
+      error = "line " + std::to_string(number) + ": " + error;
+    }
+    script.insert(script.end(), events, events + count);
+  }
+  fclose(f);
+  // stable, so same-ms inputs keep their order
+  std::stable_sort(
+      script.begin(), script.end(),
+      [](const SimEvent &a, const SimEvent &b) { return a.ms < b.ms; });
+  return ok;
+}
+
+// Ignition, then a clash or a swing every 0.4-3 s, and a retraction
+inline std::vector<SimEvent> duelScript(uint32_t minutes, uint32_t seed) {
+  std::vector<SimEvent> script;
+  uint32_t state = seed ? seed : 1;
+  auto next = [&state](uint32_t range) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % range;
+  };
+  uint32_t endMs = minutes * 60000 + 2000;
+  script.push_back({1000, SimInput::PRESS, 0, 0, 0});
+  script.push_back({1000 + SIM_CLICK_MS, SimInput::RELEASE, 0, 0, 0});
+  for (uint32_t ms = 2500; ms < endMs - 1500; ms += 400 + next(2600)) {
+    if (next(3) == 0) {
+      script.push_back({ms, SimInput::CLASH, 0, 2.0f + next(40) / 10.0f,
+                        SIM_CLASH_MS});
+    } else {
+      script.push_back({ms, SimInput::SWING, 0, 120.0f + next(200),
+                        100 + next(200)});
+    }
+  }
+  script.push_back({endMs - 1000, SimInput::PRESS, 0, 0, 0});
+  script.push_back({endMs - 1000 + SIM_CLICK_MS, SimInput::RELEASE, 0, 0, 0});
+  script.push_back({endMs, SimInput::END, 0, 0, 0});
+  return script;
+}
+
+// What the firmware keeps around saber.h
+struct SimState {
+  SimOptions options;
+  SimReport *report;
+  uint64_t startUs;
+  float batteryPercent;
+  bool streamPlaying, streamLooping; // the decoder, as far as commands go
+  // buttons: levels as wired, edges as the ISR queues them
+  bool levels[BUTTON_COUNT];
+  std::vector<SimEdge> edges;
+  ButtonPanel panel;
+  // IMU
+  std::vector<MotionSample> ring; // unread samples, oldest first
+  uint64_t clashFromUs, clashUntilUs, swingFromUs, swingUntilUs;
+  float clashG, swingDps;
+  std::vector<uint32_t> clashOnsets, swingOnsets; // ms, awaiting detection
+  int jobIds[(int)SimJob::COUNT];
+};
+
+SimState sim;
+NeoPixelBusLg<NeoGrbFeature, NeoWs2812xMethod> strip(NUM_PIXELS, LED_PIN);
+
+inline uint32_t simClock() { return micros(); }
+
+Scheduler loopJobs(simClock);
+
+inline uint32_t simMs() { return (micros() - sim.startUs) / 1000; }
+
+inline void simAudio(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+inline void simAudio(const char *format, ...) {
+  char command[96];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(command, sizeof(command), format, args);
+  va_end(args);
+  sim.report->audio.push_back({simMs(), command});
+}
+
+inline void simSpend(SimJob job) {
+  shim::advanceMicros(sim.options.costUs[(int)job]);
+}
+
+inline void simSetPeriod(SimJob job, bool active, uint32_t ms) {
+  loopJobs.setPeriod(sim.jobIds[(int)job],
+                     (active ? ms : JOB_IDLE_MS) * 1000);
+}
+
+// Matches a detection to the earliest pending onset of its kind
+inline void simDetected(std::vector<uint32_t> &onsets, SimTriggers &stats) {
+  stats.detected++;
+  uint32_t now = simMs();
+  for (size_t i = 0; i < onsets.size(); i++) {
+    if (onsets[i] <= now) {
+      stats.hits++;
+      stats.latencyMs.record(now - onsets[i]);
+      onsets.erase(onsets.begin() + i);
+      return;
+    }
+  }
+}
+
+inline void simExpire(std::vector<uint32_t> &onsets, SimTriggers &stats) {
+  uint32_t now = simMs();
+  while (!onsets.empty() && now - onsets[0] > SIM_MATCH_MS) {
+    stats.misses++;
+    onsets.erase(onsets.begin());
+  }
+}
+
+// Audio commands go to the report, every clip is in the sound bank, there
+// is no network and the SmoothSwing loops are never there
+class SimPlatform : public SaberPlatform {
+public:
+  void stopSong() override {
+    sim.streamPlaying = sim.streamLooping = false;
+    simAudio("stop");
+  }
+  void playFile(const char *path, uint32_t pos, bool loop) override {
+    sim.streamPlaying = true;
+    sim.streamLooping = loop;
+    simAudio("file %s %lu%s", path, (unsigned long)pos, loop ? " loop" : "");
+  }
+  void playStation(const char *url) override {
+    sim.streamPlaying = true;
+    sim.streamLooping = false;
+    simAudio("station %s", url);
+  }
+  bool hasEffect(const char *) override { return true; }
+  void playEffect(const char *name, bool endsStream) override {
+    // clips take no time here, a stream that ends with one ends now
+    if (endsStream) {
+      sim.streamPlaying = sim.streamLooping = false;
+    }
+    simAudio("effect %s", name);
+  }
+  void stopEffects() override { simAudio("effects stop"); }
+  void smoothSwing(bool on) override {
+    simAudio("smoothswing %s", on ? "on" : "off");
+  }
+  void setVolume(uint32_t volume) override {
+    simAudio("volume %lu", (unsigned long)volume);
+  }
+  bool audioPending() override { return false; }
+  bool audioPlaying() override { return sim.streamPlaying; }
+  bool audioLooping() override { return sim.streamLooping; }
+  bool networkReady() override { return false; }
+  void save(Setting, uint32_t) override {}
+  uint8_t batteryPercent() override { return sim.batteryPercent; }
+  void ignited() override {
+    sim.ring.clear();
+    loopJobs.wake(sim.jobIds[(int)SimJob::MOTION]);
+  }
+  void motionEvent(MotionEvent event, float) override {
+    if (event == MotionEvent::CLASH) {
+      simDetected(sim.clashOnsets, sim.report->clash);
+    } else {
+      simDetected(sim.swingOnsets, sim.report->swing);
+    }
+  }
+  void reportDebugInfo() override { simAudio("announce battery"); }
+  void announceIP() override { simAudio("announce ip"); }
+  void resetWiFi() override { simAudio("announce wifi reset"); }
+};
+
+SimPlatform simPlatform;
+
+inline void simMotionJob() {
+  simSpend(SimJob::MOTION);
+  simSetPeriod(SimJob::MOTION, sword_on, JOB_MOTION_MS);
+  if (updating || !sword_on) {
+    return;
+  }
+  // get_freq(): peaks over at most 32 samples
+  size_t count = std::min<size_t>(sim.ring.size(), 32);
+  float acc = 0, gyr = 0;
+  for (size_t i = 0; i < count; i++) {
+    acc = std::max(acc, accelMagnitude(sim.ring[i]));
+    gyr = std::max(gyr, gyroMagnitude(sim.ring[i]));
+  }
+  sim.ring.erase(sim.ring.begin(), sim.ring.begin() + count);
+  triggerEffects(acc, gyr);
+  updateStatic();
+  simExpire(sim.clashOnsets, sim.report->clash);
+  simExpire(sim.swingOnsets, sim.report->swing);
+}
+
+inline void simButtonsJob() {
+  simSpend(SimJob::BUTTONS);
+  for (const SimEdge &edge : sim.edges) {
+    sim.panel.update(edge.button, edge.pressed, edge.ms, saberButtonAction);
+  }
+  sim.edges.clear();
+  for (uint8_t i = 0; i < BUTTON_COUNT; i++) {
+    sim.panel.update(i, sim.levels[i], millis(), saberButtonAction);
+  }
+  simSetPeriod(SimJob::BUTTONS, sim.panel.busy(), JOB_BUTTONS_MS);
+}
+
+inline void simAudioJob() {
+  simSpend(SimJob::AUDIO);
+  simSetPeriod(SimJob::AUDIO, sword_on || sim.streamPlaying, JOB_AUDIO_MS);
+}
+
+inline void simServiceJob() { simSpend(SimJob::SERVICE); }
+
+inline void simSettingsJob() { simSpend(SimJob::SETTINGS); }
+
+inline void simVolumeJob() {
+  simSpend(SimJob::VOLUME);
+  volumeStep();
+}
+
+inline void simBatteryJob() {
+  simSpend(SimJob::BATTERY);
+  if (batteryBarAllowed()) {
+    showBatteryPercentage();
+  }
+}
+
+// the render task: composeFrame() and pushFrame()
+inline void simRender(uint8_t *row) {
+  composeFrame();
+  SimReport &report = *sim.report;
+  if (pushFrame()) {
+    report.shows++;
+  }
+  for (int i = 0; i < NUM_PIXELS; i++) {
+    RgbColor pixel = strip.GetPixelColor(i);
+    row[i * 3] = pixel.R;
+    row[i * 3 + 1] = pixel.G;
+    row[i * 3 + 2] = pixel.B;
+  }
+  // FNV-1a over every frame, equal hashes mean equal light shows
+  for (int i = 0; i < NUM_PIXELS * 3; i++) {
+    report.frameHash = (report.frameHash ^ row[i]) * 16777619u;
+  }
+  if (sim.options.frames && report.frames % sim.options.frameEvery == 0) {
+    fwrite(row, 3, NUM_PIXELS, sim.options.frames);
+  }
+  report.frames++;
+}
+
+inline MotionSample simSample(uint64_t us) {
+  MotionSample sample = {(uint32_t)us, {0, 0, (int16_t)MOTION_ACCEL_LSB_PER_G},
+                         {0, 0, 0}};
+  if (us >= sim.clashFromUs && us < sim.clashUntilUs) {
+    sample.accel[0] = sim.clashG * MOTION_ACCEL_LSB_PER_G;
+  }
+  if (us >= sim.swingFromUs && us < sim.swingUntilUs) {
+    sample.gyro[1] = sim.swingDps * MOTION_GYRO_LSB_PER_DPS;
+  }
+  return sample;
+}
+
+inline void simEdge(uint8_t button, bool pressed, uint32_t ms) {
+  sim.levels[button] = pressed;
+  sim.edges.push_back({ms, button, pressed});
+}
+
+inline void simApply(const SimEvent &event, uint64_t atUs) {
+  uint32_t ms = atUs / 1000;
+  switch (event.input) {
+  case SimInput::PRESS:
+  case SimInput::RELEASE: {
+    bool pressed = event.input == SimInput::PRESS;
+    // the contact chatters for bounceMs, 1 ms per flip
+    for (uint32_t i = 0; i < sim.options.bounceMs; i++) {
+      simEdge(event.button, i % 2 == 0 ? pressed : !pressed, ms + i);
+    }
+    simEdge(event.button, pressed, ms + sim.options.bounceMs);
+    loopJobs.wake(sim.jobIds[(int)SimJob::BUTTONS]);
+    break;
+  }
+  case SimInput::CLASH:
+  case SimInput::SWING: {
+    bool clash = event.input == SimInput::CLASH;
+    (clash ? sim.clashG : sim.swingDps) = event.value;
+    (clash ? sim.clashFromUs : sim.swingFromUs) = atUs;
+    (clash ? sim.clashUntilUs : sim.swingUntilUs) =
+        atUs + event.durationMs * 1000ull;
+    if (sword_on) {
+      (clash ? sim.report->clash : sim.report->swing).scripted++;
+      (clash ? sim.clashOnsets : sim.swingOnsets)
+          .push_back((atUs - sim.startUs) / 1000);
+    }
+    break;
+  }
+  case SimInput::BATTERY:
+    sim.batteryPercent = event.value;
+    break;
+  case SimInput::END:
+    break;
+  }
+}
+
+inline void simStartJobs() {
+  // same periods and priorities as startJobs()
+  static const SchedulerFn fns[] = {simMotionJob,  simButtonsJob,
+                                    simAudioJob,   simServiceJob,
+                                    simBatteryJob, simVolumeJob,
+                                    simSettingsJob};
+  static const uint32_t periods[] = {JOB_MOTION_MS,  JOB_BUTTONS_MS,
+                                     JOB_AUDIO_MS,   JOB_SERVICE_MS,
+                                     JOB_BATTERY_MS, JOB_VOLUME_MS,
+                                     JOB_SETTINGS_MS};
+  static const uint8_t priorities[] = {3, 2, 2, 1, 1, 0, 0};
+  for (int i = 0; i < (int)SimJob::COUNT; i++) {
+    sim.jobIds[i] = loopJobs.every(simJobNames[i], fns[i], periods[i] * 1000,
+                                   priorities[i]);
+  }
+}
+
+// Runs the script options.repeat times, returns false without a script
+inline bool simulate(const std::vector<SimEvent> &script,
+                     const SimOptions &options, SimReport &report) {
+  report = SimReport();
+  if (script.empty()) {
+    return false;
+  }
+  uint32_t scriptMs = script.back().ms;
+  report.durationMs = scriptMs * options.repeat;
+  sim = SimState();
+  sim.options = options;
+  sim.options.frameEvery = std::max(options.frameEvery, 1u);
+  sim.report = &report;
+  sim.batteryPercent = 100;
+  saberBegin(simPlatform);
+  // the default settings
+  currentColorMode = 0;
+  currentColor = 0;
+  currentVolume = 10;
+  currentStation = 0;
+  currentSDFile = 0;
+  internetRadioMode = false;
+  shim::seedRandom(options.seed);
+  shim::setMicros(SIM_EPOCH_US);
+  sim.startUs = SIM_EPOCH_US;
+  // led.h keeps its frames across runs
+  for (RgbColor *frame : frameBuffers) {
+    std::fill(frame, frame + NUM_PIXELS, RgbColor());
+  }
+  frameReady = false;
+  bladeAnimation = BladeAnimation::NONE;
+  strip.ClearTo(RgbColor());
+  strip.Begin();
+  applyColor(static_cast<Color>(currentColor));
+  loopJobs = Scheduler(simClock);
+  simStartJobs();
+
+  const uint64_t samplePeriod = 1000000 / MOTION_RATE_HZ;
+  const uint64_t framePeriod = 1000000 / RENDER_FPS;
+  const uint64_t endUs = sim.startUs + report.durationMs * 1000ull;
+  uint64_t nextSample = sim.startUs, nextFrame = sim.startUs;
+  uint64_t roundUs = sim.startUs; // start of the current repetition
+  size_t next = 0;
+  uint8_t row[NUM_PIXELS * 3];
+  auto sampleUntil = [&](uint64_t us) {
+    for (; nextSample <= us; nextSample += samplePeriod) {
+      sim.ring.push_back(simSample(nextSample));
+    }
+    if (sim.ring.size() > MOTION_RING_SIZE) {
+      sim.ring.erase(sim.ring.begin(), sim.ring.end() - MOTION_RING_SIZE);
+    }
+  };
+  while (micros() < endUs) {
+    uint64_t now = micros();
+    // inputs due, as the ISRs and the motion and render tasks see them
+    uint64_t at;
+    while ((at = roundUs + script[next].ms * 1000ull) <= now) {
+      sampleUntil(at - 1);
+      simApply(script[next], at);
+      if (++next == script.size()) {
+        next = 0;
+        roundUs += scriptMs * 1000ull;
+      }
+    }
+    sampleUntil(now);
+    for (; nextFrame <= now; nextFrame += framePeriod) {
+      simRender(row);
+    }
+    uint32_t wait = loopJobs.run();
+    // jobsRun() blocks until the next release or an interrupt
+    uint64_t until = std::min<uint64_t>(micros() + wait, endUs);
+    until = std::min<uint64_t>(until, roundUs + script[next].ms * 1000ull);
+    until = std::min<uint64_t>(until, nextFrame);
+    if (until > micros()) {
+      shim::setMicros(until);
+    }
+  }
+  for (int i = 0; i < (int)SimJob::COUNT; i++) {
+    report.jobs[i] = loopJobs.job(sim.jobIds[i]);
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Records the announcement clips (see src/announce.h) into sounds/say*.mp3
+with an offline speech synthesizer, so soundbank.py packs them into the
+sound bank with the effects. Replace any of them with your own recordings,
+the names are all that matters. soundbank.py runs this for missing clips
+on every build.
+
+Usage:  python tools/voice.py [sounds_dir] [--voice en-us] [--force]
+
+Needs espeak-ng (or espeak) and ffmpeg on PATH.
+"""
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+
+WORDS = {
+    "say0": "zero", "say1": "one", "say2": "two", "say3": "three",
+    "say4": "four", "say5": "five", "say6": "six", "say7": "seven",
+    "say8": "eight", "say9": "nine",
+    "saypoint": "point",
+    "sayvolts": "volts",
+    "saypercent": "percent",
+    "sayip": "My IP address is",
+    "saybattery": "Battery voltage is",
+    "saywifireset": "Resetting Wi-Fi binding",
+}
+
+
+def synthesize(engine, voice, text, output):
+    wav = subprocess.run([engine, "-v", voice, "-s", "160", "--stdout", text],
+                         check=True, stdout=subprocess.PIPE).stdout
+    # trim the synthesizer's leading and trailing silence so clips chain tight
+    trim = ("silenceremove=start_periods=1:start_threshold=-50dB,"
+            "areverse,silenceremove=start_periods=1:start_threshold=-50dB,"
+            "areverse")
+    subprocess.run(["ffmpeg", "-v", "error", "-y", "-i", "-", "-af", trim,
+                    "-ac", "1", "-ar", "22050", "-b:a", "64k", output],
+                   input=wav, check=True)
+
+
+def find_engine():
+    engine = shutil.which("espeak-ng") or shutil.which("espeak")
+    return engine if engine and shutil.which("ffmpeg") else None
+
+
+def missing_clips(directory):
+    return [name for name in WORDS
+            if not os.path.exists(os.path.join(directory, name + ".mp3"))]
+
+
+def record(engine, directory, names, voice="en-us"):
+    for name in names:
+        output = os.path.join(directory, name + ".mp3")
+        synthesize(engine, voice, WORDS[name], output)
+        print(f"{output}: {WORDS[name]}")
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Record announcement clips")
+    parser.add_argument("directory", nargs="?", default="sounds")
+    parser.add_argument("--voice", default="en-us")
+    parser.add_argument("--force", action="store_true",
+                        help="overwrite existing clips")
+    args = parser.parse_args(argv)
+    engine = find_engine()
+    if engine is None:
+        print("Error: needs espeak-ng and ffmpeg on PATH", file=sys.stderr)
+        return 1
+    names = list(WORDS) if args.force else missing_clips(args.directory)
+    record(engine, args.directory, names, args.voice)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))